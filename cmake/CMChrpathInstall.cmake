@@ -0,0 +1,134 @@
+### CMChrpathInstall
+#
+# Batch the runtime path edits of an install into one cmchrpath run.
+#
+#   cmchrpath_install_rpath(TARGETS <target>... | FILES <file>...
+#                           DESTINATION <dir>
+#                           RPATH <path> | REMOVE
+#                           [COMPONENT <component>])
+#
+# Adds an install rule that records the installed copies of the targets or
+# files (under $ENV{DESTDIR}, relative DESTINATION under the install
+# prefix) in a manifest instead of editing them one by one. Call it after
+# the install() rule that copies them.
+#
+#   cmchrpath_install_finalize()
+#
+# Adds the install rule that runs cmchrpath over everything recorded: once
+# with the manifest of replacements and once for the removals, each with
+# -j workers. It must be the last install rule of the project, so call it at
+# the end of the top-level CMakeLists.txt. Files recorded after it has run
+# (for instance by a subdirectory whose rules come later under policy
+# CMP0082 OLD) are edited one at a time as they are installed.
+#
+# Like file(RPATH_CHANGE), cmchrpath rewrites the RPATH or RUNPATH string in
+# place: the new path must fit in the one the file was built with.
+#
+# Variables:
+#
+#   CMCHRPATH_EXECUTABLE    the cmchrpath to run; defaults to the cmchrpath
+#                           target of this build or the one in PATH.
+#   CMCHRPATH_INSTALL_JOBS  workers per stage, 0 (the default) for the
+#                           number of logical cores of the installing host.
+
+if(CMAKE_VERSION VERSION_LESS 3.14)
+  message(FATAL_ERROR "CMChrpathInstall requires CMake 3.14 or later")
+endif()
+include_guard(GLOBAL)
+
+set(_CMCHRPATH_SCRIPT "${CMAKE_CURRENT_LIST_DIR}/CMChrpathInstallScript.cmake")
+# Installed as <prefix>/share/cmchrpath/cmake next to <prefix>/bin.
+get_filename_component(_CMCHRPATH_BINDIR "${CMAKE_CURRENT_LIST_DIR}/../../../bin"
+  ABSOLUTE)
+set(CMCHRPATH_INSTALL_JOBS 0 CACHE STRING
+  "cmchrpath workers per stage at install time, 0 for all cores")
+
+function(_cmchrpath_executable out)
+  if(CMCHRPATH_EXECUTABLE)
+    set(${out} "${CMCHRPATH_EXECUTABLE}" PARENT_SCOPE)
+  elseif(TARGET cmchrpath)
+    set(${out} "$<TARGET_FILE:cmchrpath>" PARENT_SCOPE)
+  else()
+    find_program(CMCHRPATH_EXECUTABLE cmchrpath HINTS "${_CMCHRPATH_BINDIR}")
+    if(NOT CMCHRPATH_EXECUTABLE)
+      message(FATAL_ERROR "cmchrpath not found, set CMCHRPATH_EXECUTABLE")
+    endif()
+    set(${out} "${CMCHRPATH_EXECUTABLE}" PARENT_SCOPE)
+  endif()
+endfunction()
+
+# The install code every rule starts with: load the helpers and say where
+# the manifests live, what to run, and which component the flush is in
+# (empty when it runs for all of them).
+function(_cmchrpath_prologue out)
+  _cmchrpath_executable(exe)
+  set(component "")
+  if(CMAKE_VERSION VERSION_LESS 3.21)
+    set(component "Unspecified")
+    if(CMAKE_INSTALL_DEFAULT_COMPONENT_NAME)
+      set(component "${CMAKE_INSTALL_DEFAULT_COMPONENT_NAME}")
+    endif()
+  endif()
+  set(${out} "include([==[${_CMCHRPATH_SCRIPT}]==])
+_cmchrpath_setup([==[${CMAKE_BINARY_DIR}/CMChrpath]==] [==[${exe}]==]
+  ${CMCHRPATH_INSTALL_JOBS} [==[${component}]==])
+" PARENT_SCOPE)
+endfunction()
+
+function(cmchrpath_install_rpath)
+  cmake_parse_arguments(PARSE_ARGV 0 arg "REMOVE"
+    "DESTINATION;RPATH;COMPONENT" "TARGETS;FILES")
+  if(arg_UNPARSED_ARGUMENTS)
+    message(FATAL_ERROR
+      "cmchrpath_install_rpath: unknown arguments: ${arg_UNPARSED_ARGUMENTS}")
+  endif()
+  if(NOT DEFINED arg_DESTINATION)
+    message(FATAL_ERROR "cmchrpath_install_rpath: DESTINATION is required")
+  endif()
+  if((arg_REMOVE AND DEFINED arg_RPATH) OR
+     (NOT arg_REMOVE AND NOT DEFINED arg_RPATH))
+    message(FATAL_ERROR
+      "cmchrpath_install_rpath: give exactly one of RPATH and REMOVE")
+  endif()
+  set(names)
+  foreach(target IN LISTS arg_TARGETS)
+    list(APPEND names "$<TARGET_FILE_NAME:${target}>")
+  endforeach()
+  foreach(file IN LISTS arg_FILES)
+    get_filename_component(name "${file}" NAME)
+    list(APPEND names "${name}")
+  endforeach()
+  if(NOT names)
+    return()
+  endif()
+
+  _cmchrpath_prologue(code)
+  string(APPEND code "_cmchrpath_record([==[${arg_DESTINATION}]==] ")
+  if(arg_REMOVE)
+    string(APPEND code "REMOVE \"\"")
+  else()
+    string(APPEND code "RPATH [==[${arg_RPATH}]==]")
+  endif()
+  foreach(name IN LISTS names)
+    string(APPEND code " [==[${name}]==]")
+  endforeach()
+  string(APPEND code ")\n")
+  if(DEFINED arg_COMPONENT)
+    install(CODE "${code}" COMPONENT "${arg_COMPONENT}")
+  else()
+    install(CODE "${code}")
+  endif()
+endfunction()
+
+function(cmchrpath_install_finalize)
+  _cmchrpath_prologue(code)
+  string(APPEND code "_cmchrpath_flush()\n")
+  # The flush belongs to every component being installed. Before 3.21 it
+  # can only be in the default one, and the rules of an install of another
+  # component edit their files right away instead of recording them.
+  if(CMAKE_VERSION VERSION_LESS 3.21)
+    install(CODE "${code}")
+  else()
+    install(CODE "${code}" ALL_COMPONENTS)
+  endif()
+endfunction()
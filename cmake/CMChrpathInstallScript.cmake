@@ -0,0 +1,117 @@
+### CMChrpathInstallScript
+#
+# The install-time half of CMChrpathInstall, included by the rules it
+# generates. State lives in global properties, which last for the whole
+# run of cmake_install.cmake and the scripts of its subdirectories.
+
+include_guard(GLOBAL)
+
+function(_cmchrpath_setup dir exe jobs component)
+  set_property(GLOBAL PROPERTY _CMCHRPATH_DIR "${dir}")
+  set_property(GLOBAL PROPERTY _CMCHRPATH_EXE "${exe}")
+  if(jobs EQUAL 0)
+    cmake_host_system_information(RESULT jobs
+      QUERY NUMBER_OF_LOGICAL_CORES)
+  endif()
+  set_property(GLOBAL PROPERTY _CMCHRPATH_JOBS "${jobs}")
+  set_property(GLOBAL PROPERTY _CMCHRPATH_COMPONENT "${component}")
+endfunction()
+
+# Run cmchrpath with args; stop the install with its output on failure.
+function(_cmchrpath_run)
+  get_property(exe GLOBAL PROPERTY _CMCHRPATH_EXE)
+  execute_process(COMMAND "${exe}" ${ARGN}
+    RESULT_VARIABLE result
+    OUTPUT_VARIABLE output
+    ERROR_VARIABLE output)
+  if(NOT result EQUAL 0)
+    string(REPLACE ";" " " command "${ARGN}")
+    message(FATAL_ERROR "cmchrpath ${command} failed (${result}):\n${output}")
+  endif()
+endfunction()
+
+# Whether the flush rule is part of this install. It is missing only from
+# the install of a single component other than its own.
+function(_cmchrpath_batching out)
+  get_property(flushed GLOBAL PROPERTY _CMCHRPATH_FLUSHED)
+  get_property(component GLOBAL PROPERTY _CMCHRPATH_COMPONENT)
+  if(flushed)
+    set(${out} FALSE PARENT_SCOPE)
+  elseif(component AND CMAKE_INSTALL_COMPONENT AND
+         NOT CMAKE_INSTALL_COMPONENT STREQUAL component)
+    set(${out} FALSE PARENT_SCOPE)
+  else()
+    set(${out} TRUE PARENT_SCOPE)
+  endif()
+endfunction()
+
+# _cmchrpath_record(<destination> RPATH <path> | REMOVE "" <name>...)
+function(_cmchrpath_record destination mode rpath)
+  if(IS_ABSOLUTE "${destination}")
+    set(prefix "$ENV{DESTDIR}${destination}")
+  else()
+    set(prefix "$ENV{DESTDIR}${CMAKE_INSTALL_PREFIX}/${destination}")
+  endif()
+  _cmchrpath_batching(batching)
+  if(NOT batching)
+    foreach(name IN LISTS ARGN)
+      if(mode STREQUAL "REMOVE")
+        _cmchrpath_run(-d "${prefix}/${name}")
+      else()
+        _cmchrpath_run(-r "${rpath}" "${prefix}/${name}")
+      endif()
+    endforeach()
+    return()
+  endif()
+
+  # The first record of a run starts the manifests afresh.
+  get_property(dir GLOBAL PROPERTY _CMCHRPATH_DIR)
+  get_property(started GLOBAL PROPERTY _CMCHRPATH_STARTED)
+  if(NOT started)
+    file(MAKE_DIRECTORY "${dir}")
+    file(WRITE "${dir}/change.txt" "")
+    file(WRITE "${dir}/remove.txt" "")
+    set_property(GLOBAL PROPERTY _CMCHRPATH_STARTED TRUE)
+  endif()
+  set(lines "")
+  foreach(name IN LISTS ARGN)
+    if(mode STREQUAL "REMOVE")
+      string(APPEND lines "${prefix}/${name}\n")
+    else()
+      string(APPEND lines "${prefix}/${name}\t${rpath}\n")
+    endif()
+  endforeach()
+  if(mode STREQUAL "REMOVE")
+    file(APPEND "${dir}/remove.txt" "${lines}")
+  else()
+    file(APPEND "${dir}/change.txt" "${lines}")
+  endif()
+  list(LENGTH ARGN count)
+  set_property(GLOBAL APPEND PROPERTY _CMCHRPATH_COUNT ${count})
+endfunction()
+
+function(_cmchrpath_flush)
+  set_property(GLOBAL PROPERTY _CMCHRPATH_FLUSHED TRUE)
+  get_property(started GLOBAL PROPERTY _CMCHRPATH_STARTED)
+  if(NOT started)
+    return()
+  endif()
+  get_property(dir GLOBAL PROPERTY _CMCHRPATH_DIR)
+  get_property(jobs GLOBAL PROPERTY _CMCHRPATH_JOBS)
+  get_property(counts GLOBAL PROPERTY _CMCHRPATH_COUNT)
+  set(total 0)
+  foreach(count IN LISTS counts)
+    math(EXPR total "${total} + ${count}")
+  endforeach()
+  message(STATUS "Set runtime path of ${total} files with cmchrpath -j ${jobs}")
+  # A manifest line with a TAB carries its own new rpath; the plain lines
+  # of the removals take -d.
+  file(SIZE "${dir}/change.txt" size)
+  if(size GREATER 0)
+    _cmchrpath_run(-j ${jobs} --manifest "${dir}/change.txt")
+  endif()
+  file(SIZE "${dir}/remove.txt" size)
+  if(size GREATER 0)
+    _cmchrpath_run(-d -j ${jobs} --manifest "${dir}/remove.txt")
+  endif()
+endfunction()
@@ -0,0 +1,2 @@
+///
+int cmchrpath_fixture() { return 0; }
@@ -0,0 +1,112 @@
+# Builds small libraries and programs with CC in WORK, then checks what
+# cmchrpath --reorder-rpath, --shrink-rpath and --prune-needed make of
+# them.
+#
+#   cmake -DCC=<cc> -DCMCHRPATH=<exe> -DELFINFO=<exe> -DWORK=<dir>
+#         -P optimize.cmake
+
+file(REMOVE_RECURSE "${WORK}")
+file(MAKE_DIRECTORY "${WORK}/a" "${WORK}/b" "${WORK}/c" "${WORK}/empty")
+
+function(run)
+  execute_process(COMMAND ${ARGN}
+    RESULT_VARIABLE result
+    OUTPUT_VARIABLE out
+    ERROR_VARIABLE out
+  )
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${ARGN} failed:\n${out}")
+  endif()
+  set(out "${out}" PARENT_SCOPE)
+endfunction()
+
+# lib<name>.so in dir, defining <name>().
+function(library dir name)
+  file(WRITE "${WORK}/${name}.c" "int ${name}(void) { return 0; }\n")
+  run(${CC} -shared -fPIC -Wl,-soname,lib${name}.so
+    -o "${WORK}/${dir}/lib${name}.so" "${WORK}/${name}.c")
+endfunction()
+
+# A program calling each of calls, linked against libs from dirs and
+# run from runpath.
+function(program name calls libs dirs runpath)
+  set(src "")
+  set(body "")
+  foreach(f IN LISTS calls)
+    string(APPEND src "int ${f}(void);\n")
+    string(APPEND body "${f}() + ")
+  endforeach()
+  file(WRITE "${WORK}/${name}.c" "${src}int main(void) { return ${body}0; }\n")
+  set(link "")
+  foreach(d IN LISTS dirs)
+    list(APPEND link "-L${WORK}/${d}")
+  endforeach()
+  foreach(l IN LISTS libs)
+    list(APPEND link "-l${l}")
+  endforeach()
+  run(${CC} -o "${WORK}/${name}" "${WORK}/${name}.c"
+    -Wl,--no-as-needed -Wl,--enable-new-dtags "-Wl,-rpath,${runpath}"
+    ${link})
+endfunction()
+
+function(expect_runpath name want)
+  run(${CMCHRPATH} --stdout -l "${WORK}/${name}")
+  if(NOT out STREQUAL "${WORK}/${name}: RUNPATH=${want}\n")
+    message(FATAL_ERROR "${name}: want RUNPATH=${want}, got:\n${out}")
+  endif()
+endfunction()
+
+library(a p)
+library(b p)
+library(b q)
+library(b r)
+library(c q)
+library(c r)
+
+# b provides two of the libraries and a one, but b also holds a libp.so:
+# moving it first would load that one instead.
+program(shadowed "p;q;r" "p;q;r" "a;b" "${WORK}/a:${WORK}/b")
+run(${CMCHRPATH} --reorder-rpath "${WORK}/shadowed")
+expect_runpath(shadowed "${WORK}/a:${WORK}/b")
+
+# Without the shadowing copy, the entry with more hits goes first.
+program(reordered "p;q;r" "p;q;r" "a;c" "${WORK}/a:${WORK}/c")
+run(${CMCHRPATH} --reorder-rpath "${WORK}/reordered")
+expect_runpath(reordered "${WORK}/c:${WORK}/a")
+
+# empty provides nothing.
+program(shrunk "p" "p" "a" "${WORK}/empty:${WORK}/a:${WORK}/empty")
+run(${CMCHRPATH} --shrink-rpath "${WORK}/shrunk")
+expect_runpath(shrunk "${WORK}/a")
+
+# libq.so is linked but nothing of it is used.
+program(pruned "p" "p;q" "a;c" "${WORK}/a:${WORK}/c")
+run(${ELFINFO} --stdout "${WORK}/pruned")
+if(NOT out MATCHES "libq\\.so")
+  message(FATAL_ERROR "pruned: libq.so not linked:\n${out}")
+endif()
+run(${CMCHRPATH} --prune-needed "${WORK}/pruned")
+run(${ELFINFO} --stdout "${WORK}/pruned")
+if(out MATCHES "libq\\.so" OR NOT out MATCHES "libp\\.so")
+  message(FATAL_ERROR "pruned: want libp.so and not libq.so:\n${out}")
+endif()
+
+# A program that only reads data of libcounter.so holds a copy of it,
+# defined in the program and filled from the library by a copy
+# relocation, so the library stays.
+file(WRITE "${WORK}/counter.c" "int counter = 42;\n")
+run(${CC} -shared -fPIC -Wl,-soname,libcounter.so
+  -o "${WORK}/a/libcounter.so" "${WORK}/counter.c")
+foreach(pie IN ITEMS -no-pie -pie)
+  set(name copied${pie})
+  file(WRITE "${WORK}/${name}.c"
+    "extern int counter;\nint main(void) { return counter - 42; }\n")
+  run(${CC} ${pie} -o "${WORK}/${name}" "${WORK}/${name}.c"
+    -Wl,--enable-new-dtags "-Wl,-rpath,${WORK}/a" "-L${WORK}/a" -lcounter)
+  run(${CMCHRPATH} --prune-needed "${WORK}/${name}")
+  run(${ELFINFO} --stdout "${WORK}/${name}")
+  if(NOT out MATCHES "libcounter\\.so")
+    message(FATAL_ERROR "${name}: libcounter.so pruned:\n${out}")
+  endif()
+  run("${WORK}/${name}")
+endforeach()
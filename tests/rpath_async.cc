@@ -0,0 +1,92 @@
+/// Drives the coroutine edits of cmRPathAsync.h on a copy of a library
+/// whose RUNPATH is /rpath/async/fixture.
+#include "cmELF.h"
+#include "cmRPathAsync.h"
+#include <cstdio>
+#include <future>
+#include <string>
+
+#if !defined(__cpp_impl_coroutine)
+#error "rpath_async needs coroutines"
+#endif
+
+namespace {
+
+int Failures = 0;
+
+void Expect(bool ok, const char *what, std::string const &detail = "") {
+  if (!ok) {
+    fprintf(stderr, "FAILED: %s %s\n", what, detail.c_str());
+    Failures++;
+  }
+}
+
+std::string RunPath(std::string const &file) {
+  cmELF elf(file.c_str());
+  cmELF::StringEntry const *se = elf.GetRunPath();
+  return se != nullptr ? se->Value : "<none>";
+}
+
+// Start a task from plain code and wait for its result.
+template <typename T> T Wait(cmake::RPathTask<T> task) {
+  std::promise<T> done;
+  auto result = done.get_future();
+  std::move(task).Start([&done](T value) { done.set_value(std::move(value)); });
+  return result.get();
+}
+
+// One task awaiting others: both halves of two edits in sequence.
+cmake::RPathTask<int> ChangeThenRemove(cmake::RPathExecutor &executor,
+                                       std::string file) {
+  auto change = cmake::ChangeRPathAsync(executor, file, "/rpath/async/fixture",
+                                        "/rpath/async");
+  cmake::RPathResult changed = co_await change;
+  Expect(changed.Ok && changed.Changed, "change", changed.Error);
+  Expect(RunPath(file) == "/rpath/async", "changed RUNPATH", RunPath(file));
+  auto remove = cmake::RemoveRPathAsync(executor, file);
+  cmake::RPathResult removed = co_await remove;
+  Expect(removed.Ok && removed.Changed, "remove", removed.Error);
+  co_return 0;
+}
+
+bool Copy(const char *from, const char *to) {
+  FILE *in = fopen(from, "rb");
+  FILE *out = fopen(to, "wb");
+  bool ok = in != nullptr && out != nullptr;
+  char buf[64 * 1024];
+  size_t n;
+  while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    ok = fwrite(buf, 1, n, out) == n;
+  }
+  if (in != nullptr) {
+    fclose(in);
+  }
+  if (out != nullptr && fclose(out) != 0) {
+    ok = false;
+  }
+  return ok;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <fixture> <copy>\n", argv[0]);
+    return 2;
+  }
+  std::string file = argv[2];
+  if (!Copy(argv[1], argv[2])) {
+    fprintf(stderr, "cannot copy %s to %s\n", argv[1], argv[2]);
+    return 2;
+  }
+  Expect(RunPath(file) == "/rpath/async/fixture", "fixture RUNPATH",
+         RunPath(file));
+  cmake::RPathThreadPool pool(2);
+  Wait(ChangeThenRemove(pool, file));
+  Expect(RunPath(file) == "<none>", "removed RUNPATH", RunPath(file));
+  // A failed read is reported in the result, not thrown.
+  cmake::RPathResult missing = Wait(cmake::ChangeRPathAsync(
+      pool, file + ".missing", "/rpath/async/fixture", "/rpath/async"));
+  Expect(!missing.Ok && !missing.Error.empty(), "missing file");
+  return Failures == 0 ? 0 : 1;
+}
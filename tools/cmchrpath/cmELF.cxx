@@ -5,11 +5,14 @@
 //#include "cm_kwiml.h"
 //#include "cmsys/FStream.hxx"
 //#include "FStream.hxx"
-#include <fstream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
 #include <map>
 #include <memory> // IWYU pragma: keep
-#include <sstream>
 #include <stddef.h>
+#include <unistd.h>
 #include <utility>
 #include <vector>
 
@@ -89,13 +92,97 @@ template <typename T> void cmELFByteSwap(T &x) {
   cmELFByteSwap(reinterpret_cast<char *>(&x), cmELFByteSwapSize<sizeof(T)>());
 }
 
+// The subset of std::istream the parser uses, over pread(2) with one
+// block of buffer, or over a caller's copy of the file in memory.
+// std::ifstream would drag the iostream and locale initialization into
+// every run of the tool, which costs more than the parse of a typical
+// file.  As with a stream, a failed read is sticky: every later read and
+// seek fails too.
+class cmELFStream {
+public:
+  explicit cmELFStream(const char *fname)
+      : Fd(open(fname, O_RDONLY | O_CLOEXEC)), Window(this->Buf) {}
+  // The whole file is the window; reading past it is end of file.
+  cmELFStream(const char *data, size_t size)
+      : BufLength(size), Window(data) {}
+  cmELFStream(cmELFStream const &) = delete;
+  cmELFStream &operator=(cmELFStream const &) = delete;
+  ~cmELFStream() {
+    if (this->Fd != -1) {
+      close(this->Fd);
+    }
+  }
+
+  bool is_open() const { return this->Fd != -1 || this->Window != this->Buf; }
+  bool fail() const { return this->Failed || !this->is_open(); }
+  explicit operator bool() const { return !this->fail(); }
+
+  bool seekg(unsigned long pos) {
+    if (this->fail()) {
+      return false;
+    }
+    this->Pos = pos;
+    return true;
+  }
+
+  bool read(char *data, size_t n) {
+    if (this->fail()) {
+      return false;
+    }
+    while (n > 0) {
+      if (this->Pos >= this->BufBegin &&
+          this->Pos < this->BufBegin + this->BufLength) {
+        size_t offset = static_cast<size_t>(this->Pos - this->BufBegin);
+        size_t count = std::min(n, this->BufLength - offset);
+        memcpy(data, this->Window + offset, count);
+        data += count;
+        n -= count;
+        this->Pos += count;
+      } else if (!this->Fill()) {
+        this->Failed = true;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool get(char &c) { return this->read(&c, 1); }
+
+private:
+  // Load the block holding Pos.  Fails at end of file.
+  bool Fill() {
+    if (this->Window != this->Buf) {
+      return false;
+    }
+    ssize_t n;
+    do {
+      n = pread(this->Fd, this->Buf, sizeof(this->Buf),
+                static_cast<off_t>(this->Pos));
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+      return false;
+    }
+    this->BufBegin = this->Pos;
+    this->BufLength = static_cast<size_t>(n);
+    return true;
+  }
+
+  int Fd = -1;
+  bool Failed = false;
+  unsigned long Pos = 0;
+  unsigned long BufBegin = 0;
+  size_t BufLength = 0;
+  const char *Window;
+  char Buf[4096];
+};
+
 class cmELFInternal {
 public:
   typedef cmELF::StringEntry StringEntry;
   enum ByteOrderType { ByteOrderMSB, ByteOrderLSB };
 
   // Construct and take ownership of the file stream object.
-  cmELFInternal(cmELF *external, std::unique_ptr<std::ifstream> &fin,
+  cmELFInternal(cmELF *external, std::unique_ptr<cmELFStream> &fin,
                 ByteOrderType order)
       : External(external), Stream(*fin.release()), ByteOrder(order),
         ELFType(cmELF::FileTypeInvalid) {
@@ -124,7 +211,14 @@ public:
   virtual std::vector<char>
   EncodeDynamicEntries(const cmELF::DynamicEntryList &) = 0;
   virtual StringEntry const *GetDynamicSectionString(unsigned int tag) = 0;
-  virtual void PrintInfo(std::ostream &os) const = 0;
+  virtual std::vector<std::string> GetDynamicSectionStrings(unsigned int tag) = 0;
+  virtual void GetHeaderInfo(cmELF::HeaderInfo &info) const = 0;
+  virtual void PrintInfo(std::string &out) const = 0;
+
+  // Save the identification block for GetHeaderInfo.
+  void SetIdent(char const *ident) {
+    memcpy(this->Ident, ident, EI_NIDENT);
+  }
 
   // Lookup the SONAME in the DYNAMIC section.
   StringEntry const *GetSOName() {
@@ -144,6 +238,31 @@ public:
   // Return the recorded ELF type.
   cmELF::FileType GetFileType() const { return this->ELFType; }
 
+  // Lookup the NEEDED entries in the DYNAMIC section.
+  std::vector<std::string> GetNeeded() {
+    return this->GetDynamicSectionStrings(DT_NEEDED);
+  }
+
+  // Return the ranges of the file read so far.
+  cmELF::ReadRangeList const &GetReadRanges() const {
+    return this->ReadRanges;
+  }
+
+  // Record that [pos, pos+len) was read, merging with the previous range
+  // when it is adjacent or overlapping.
+  void NoteRead(unsigned long pos, unsigned long len) {
+    if (!this->ReadRanges.empty()) {
+      cmELF::ReadRange &last = this->ReadRanges.back();
+      if (pos >= last.first && pos <= last.first + last.second) {
+        if (pos + len > last.first + last.second) {
+          last.second = pos + len - last.first;
+        }
+        return;
+      }
+    }
+    this->ReadRanges.emplace_back(pos, len);
+  }
+
 protected:
   // Data common to all ELF class implementations.
 
@@ -151,7 +270,7 @@ protected:
   cmELF *External;
 
   // The stream from which to read.
-  std::istream &Stream;
+  cmELFStream &Stream;
 
   // The byte order of the ELF file.
   ByteOrderType ByteOrder;
@@ -168,11 +287,18 @@ protected:
   // Helper methods for subclasses.
   void SetErrorMessage(const char *msg) {
     this->External->ErrorMessage = msg;
+    this->External->ErrorStatus = cmELF::StatusMalformed;
     this->ELFType = cmELF::FileTypeInvalid;
   }
 
   // Store string table entry states.
   std::map<unsigned int, StringEntry> DynamicSectionStrings;
+
+  // The ranges of the file read so far.
+  cmELF::ReadRangeList ReadRanges;
+
+  // The identification block, saved by SetIdent.
+  unsigned char Ident[EI_NIDENT];
 };
 
 // Configure the implementation template for 32-bit ELF files.
@@ -208,7 +334,7 @@ public:
   typedef typename Types::tagtype tagtype;
 
   // Construct with a stream and byte swap indicator.
-  cmELFInternalImpl(cmELF *external, std::unique_ptr<std::ifstream> &fin,
+  cmELFInternalImpl(cmELF *external, std::unique_ptr<cmELFStream> &fin,
                     ByteOrderType order);
 
   // Return the number of sections as specified by the ELF header.
@@ -226,38 +352,53 @@ public:
   // Lookup a string from the dynamic section with the given tag.
   StringEntry const *GetDynamicSectionString(unsigned int tag) override;
 
+  // Lookup every string from the dynamic section with the given tag.
+  std::vector<std::string> GetDynamicSectionStrings(unsigned int tag) override;
+
+  // Report the identification and header fields.
+  void GetHeaderInfo(cmELF::HeaderInfo &info) const override {
+    info.Class = sizeof(ELF_Ehdr) == sizeof(Elf32_Ehdr) ? 32 : 64;
+    info.MSB = this->ByteOrder == ByteOrderMSB;
+    info.Type = static_cast<unsigned int>(this->ELFHeader.e_type);
+    info.Machine = static_cast<unsigned int>(this->ELFHeader.e_machine);
+    info.Version = this->Ident[EI_VERSION];
+    info.OSABI = this->Ident[EI_OSABI];
+    info.ABIVersion = this->Ident[EI_ABIVERSION];
+  }
+
   // Print information about the ELF file.
-  void PrintInfo(std::ostream &os) const override {
-    os << "ELF " << Types::GetName();
+  void PrintInfo(std::string &out) const override {
+    out += "ELF ";
+    out += Types::GetName();
     if (this->ByteOrder == ByteOrderMSB) {
-      os << " MSB";
+      out += " MSB";
     } else if (this->ByteOrder == ByteOrderLSB) {
-      os << " LSB";
+      out += " LSB";
     }
     switch (this->ELFType) {
     case cmELF::FileTypeInvalid:
-      os << " invalid file";
+      out += " invalid file";
       break;
     case cmELF::FileTypeRelocatableObject:
-      os << " relocatable object";
+      out += " relocatable object";
       break;
     case cmELF::FileTypeExecutable:
-      os << " executable";
+      out += " executable";
       break;
     case cmELF::FileTypeSharedLibrary:
-      os << " shared library";
+      out += " shared library";
       break;
     case cmELF::FileTypeCore:
-      os << " core file";
+      out += " core file";
       break;
     case cmELF::FileTypeSpecificOS:
-      os << " os-specific type";
+      out += " os-specific type";
       break;
     case cmELF::FileTypeSpecificProc:
-      os << " processor-specific type";
+      out += " processor-specific type";
       break;
     }
-    os << "\n";
+    out += "\n";
   }
 
 private:
@@ -320,6 +461,7 @@ private:
 
   bool Read(ELF_Ehdr &x) {
     // Read the header from the file.
+    this->NoteRead(0, sizeof(x));
     if (!this->Stream.read(reinterpret_cast<char *>(&x), sizeof(x))) {
       return false;
     }
@@ -365,8 +507,10 @@ private:
 
   bool LoadSectionHeader(ELF_Half i) {
     // Read the section header from the file.
-    this->Stream.seekg(this->ELFHeader.e_shoff +
-                       this->ELFHeader.e_shentsize * i);
+    unsigned long pos = static_cast<unsigned long>(
+        this->ELFHeader.e_shoff + this->ELFHeader.e_shentsize * i);
+    this->Stream.seekg(pos);
+    this->NoteRead(pos, sizeof(ELF_Shdr));
     if (!this->Read(this->SectionHeaders[i])) {
       return false;
     }
@@ -392,7 +536,7 @@ private:
 
 template <class Types>
 cmELFInternalImpl<Types>::cmELFInternalImpl(cmELF *external,
-                                            std::unique_ptr<std::ifstream> &fin,
+                                            std::unique_ptr<cmELFStream> &fin,
                                             ByteOrderType order)
     : cmELFInternal(external, fin, order) {
   // Read the main header.
@@ -432,9 +576,9 @@ cmELFInternalImpl<Types>::cmELFInternalImpl(cmELF *external,
       break;
     }
 #endif
-    std::ostringstream e;
-    e << "Unknown ELF file type " << eti;
-    this->SetErrorMessage(e.str().c_str());
+    std::string e = "Unknown ELF file type ";
+    e += std::to_string(eti);
+    this->SetErrorMessage(e.c_str());
     return;
   }
   }
@@ -473,7 +617,10 @@ template <class Types> bool cmELFInternalImpl<Types>::LoadDynamicSection() {
   // Read each entry.
   for (int j = 0; j < n; ++j) {
     // Seek to the beginning of the section entry.
-    this->Stream.seekg(sec.sh_offset + sec.sh_entsize * j);
+    unsigned long pos =
+        static_cast<unsigned long>(sec.sh_offset + sec.sh_entsize * j);
+    this->Stream.seekg(pos);
+    this->NoteRead(pos, sizeof(ELF_Dyn));
     ELF_Dyn &dyn = this->DynamicSectionEntries[j];
 
     // Try reading the entry.
@@ -606,6 +753,8 @@ cmELFInternalImpl<Types>::GetDynamicSectionString(unsigned int tag) {
           terminated = true;
         }
       }
+      this->NoteRead(static_cast<unsigned long>(strtab.sh_offset + first),
+                     last - first + (last != end ? 1 : 0));
 
       // Make sure the whole value was read.
       if (!this->Stream) {
@@ -625,6 +774,49 @@ cmELFInternalImpl<Types>::GetDynamicSectionString(unsigned int tag) {
   return nullptr;
 }
 
+template <class Types>
+std::vector<std::string>
+cmELFInternalImpl<Types>::GetDynamicSectionStrings(unsigned int tag) {
+  std::vector<std::string> result;
+  if (!this->LoadDynamicSection()) {
+    return result;
+  }
+  ELF_Shdr const &sec = this->SectionHeaders[this->DynamicSectionIndex];
+  if (sec.sh_link >= this->SectionHeaders.size()) {
+    this->SetErrorMessage("Section DYNAMIC has invalid string table index.");
+    return result;
+  }
+  ELF_Shdr const &strtab = this->SectionHeaders[sec.sh_link];
+  for (ELF_Dyn const &dyn : this->DynamicSectionEntries) {
+    if (static_cast<tagtype>(dyn.d_tag) != static_cast<tagtype>(tag)) {
+      continue;
+    }
+    if (dyn.d_un.d_val >= strtab.sh_size) {
+      this->SetErrorMessage("Section DYNAMIC references string beyond "
+                            "the end of its string section.");
+      return std::vector<std::string>();
+    }
+    unsigned long first = static_cast<unsigned long>(dyn.d_un.d_val);
+    unsigned long last = first;
+    unsigned long end = static_cast<unsigned long>(strtab.sh_size);
+    this->Stream.seekg(strtab.sh_offset + first);
+    std::string value;
+    char c;
+    while (last != end && this->Stream.get(c) && c) {
+      ++last;
+      value += c;
+    }
+    if (!this->Stream) {
+      this->SetErrorMessage("Dynamic section specifies unreadable string.");
+      return std::vector<std::string>();
+    }
+    this->NoteRead(static_cast<unsigned long>(strtab.sh_offset + first),
+                   last - first + 1);
+    result.push_back(value);
+  }
+  return result;
+}
+
 //============================================================================
 // External class implementation.
 
@@ -639,22 +831,34 @@ const long cmELF::TagMipsRldMapRel = 0;
 
 cmELF::cmELF(const char *fname) : Internal(nullptr) {
   // Try to open the file.
-  std::unique_ptr<std::ifstream> fin(new std::ifstream(fname));
+  std::unique_ptr<cmELFStream> fin(new cmELFStream(fname));
 
   // Quit now if the file could not be opened.
-  if (!fin.get() || !*fin) {
+  if (!fin->is_open()) {
     this->ErrorMessage = "Error opening input file.";
+    this->ErrorStatus = StatusOpenFailed;
     return;
   }
+  this->Load(fin);
+}
+
+cmELF::cmELF(const void *data, unsigned long size) : Internal(nullptr) {
+  std::unique_ptr<cmELFStream> fin(
+      new cmELFStream(static_cast<const char *>(data), size));
+  this->Load(fin);
+}
 
+void cmELF::Load(std::unique_ptr<cmELFStream> &fin) {
   // Read the ELF identification block.
   char ident[EI_NIDENT];
   if (!fin->read(ident, EI_NIDENT)) {
     this->ErrorMessage = "Error reading ELF identification.";
+    this->ErrorStatus = StatusReadFailed;
     return;
   }
   if (!fin->seekg(0)) {
     this->ErrorMessage = "Error seeking to beginning of file.";
+    this->ErrorStatus = StatusReadFailed;
     return;
   }
 
@@ -662,6 +866,7 @@ cmELF::cmELF(const char *fname) : Internal(nullptr) {
   if (!(ident[EI_MAG0] == ELFMAG0 && ident[EI_MAG1] == ELFMAG1 &&
         ident[EI_MAG2] == ELFMAG2 && ident[EI_MAG3] == ELFMAG3)) {
     this->ErrorMessage = "File does not have a valid ELF identification.";
+    this->ErrorStatus = StatusNotELF;
     return;
   }
 
@@ -675,6 +880,7 @@ cmELF::cmELF(const char *fname) : Internal(nullptr) {
     order = cmELFInternal::ByteOrderMSB;
   } else {
     this->ErrorMessage = "ELF file is not LSB or MSB encoded.";
+    this->ErrorStatus = StatusMalformed;
     return;
   }
 
@@ -692,8 +898,10 @@ cmELF::cmELF(const char *fname) : Internal(nullptr) {
 #endif
   else {
     this->ErrorMessage = "ELF file class is not 32-bit or 64-bit.";
+    this->ErrorStatus = StatusMalformed;
     return;
   }
+  this->Internal->SetIdent(ident);
 }
 
 cmELF::~cmELF() { delete this->Internal; }
@@ -774,10 +982,33 @@ cmELF::StringEntry const *cmELF::GetRunPath() {
   return nullptr;
 }
 
-void cmELF::PrintInfo(std::ostream &os) const {
+bool cmELF::GetHeaderInfo(HeaderInfo &info) const {
+  if (this->Valid()) {
+    this->Internal->GetHeaderInfo(info);
+    return true;
+  }
+  return false;
+}
+
+std::vector<std::string> cmELF::GetNeeded() {
+  if (this->Valid()) {
+    return this->Internal->GetNeeded();
+  }
+  return std::vector<std::string>();
+}
+
+cmELF::ReadRangeList const &cmELF::GetReadRanges() const {
+  static const ReadRangeList empty;
+  if (this->Internal) {
+    return this->Internal->GetReadRanges();
+  }
+  return empty;
+}
+
+void cmELF::PrintInfo(std::string &out) const {
   if (this->Valid()) {
-    this->Internal->PrintInfo(os);
+    this->Internal->PrintInfo(out);
   } else {
-    os << "Not a valid ELF file.\n";
+    out += "Not a valid ELF file.\n";
   }
 }
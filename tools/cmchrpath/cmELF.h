@@ -5,7 +5,7 @@
 
 //#include "cmConfigure.h" // IWYU pragma: keep
 
-#include <iosfwd>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -15,6 +15,7 @@
 // #endif
 
 class cmELFInternal;
+class cmELFStream;
 
 /** \class cmELF
  * \brief Executable and Link Format (ELF) parser.
@@ -24,6 +25,10 @@ public:
   /** Construct with the name of the ELF input file to parse.  */
   cmELF(const char *fname);
 
+  /** Construct over a copy of the file in memory, which must outlive the
+      parser.  */
+  cmELF(const void *data, unsigned long size);
+
   /** Destruct.   */
   ~cmELF();
 
@@ -33,6 +38,18 @@ public:
   /** Boolean conversion.  True if the ELF file is valid.  */
   operator bool() const { return this->Valid(); }
 
+  /** Why the file is not valid, for callers that need more than a message.
+      StatusValid does not imply validity before a lookup has run, since
+      later reads may still find the file malformed.  */
+  enum Status {
+    StatusValid,
+    StatusOpenFailed,
+    StatusReadFailed,
+    StatusNotELF,
+    StatusMalformed
+  };
+  Status GetStatus() const { return this->ErrorStatus; }
+
   /** Enumeration of ELF file types.  */
   enum FileType {
     FileTypeInvalid,
@@ -60,12 +77,35 @@ public:
     int IndexInSection;
   };
 
+  /** Identification and header fields of the file.  */
+  struct HeaderInfo {
+    // 32 or 64.
+    unsigned int Class;
+    // Most significant byte first.
+    bool MSB;
+    // The raw e_type, e_machine and EI_VERSION/EI_OSABI/EI_ABIVERSION
+    // values.
+    unsigned int Type;
+    unsigned int Machine;
+    unsigned int Version;
+    unsigned int OSABI;
+    unsigned int ABIVersion;
+  };
+
+  /** Represent a byte range of the file read by the parser.  */
+  typedef std::pair<unsigned long, unsigned long> ReadRange;
+  typedef std::vector<ReadRange> ReadRangeList;
+
   /** Represent entire dynamic section header */
   typedef std::vector<std::pair<long, unsigned long>> DynamicEntryList;
 
   /** Get the type of the file opened.  */
   FileType GetFileType() const;
 
+  /** Get the identification and header fields.  Returns false if the
+      file is not valid.  */
+  bool GetHeaderInfo(HeaderInfo &info) const;
+
   /** Get the number of ELF sections present.  */
   unsigned int GetNumberOfSections() const;
 
@@ -85,14 +125,22 @@ public:
   bool GetSOName(std::string &soname);
   StringEntry const *GetSOName();
 
+  /** Get the DT_NEEDED entries in the order they appear.  */
+  std::vector<std::string> GetNeeded();
+
   /** Get the RPATH field if any.  */
   StringEntry const *GetRPath();
 
   /** Get the RUNPATH field if any.  */
   StringEntry const *GetRunPath();
 
-  /** Print human-readable information about the ELF file.  */
-  void PrintInfo(std::ostream &os) const;
+  /** Get the (offset, length) ranges of the file read so far, merged where
+      contiguous.  Callers use this to drop the pages from the page cache
+      once they are done with the file.  */
+  ReadRangeList const &GetReadRanges() const;
+
+  /** Append human-readable information about the ELF file to out.  */
+  void PrintInfo(std::string &out) const;
 
   /** Interesting dynamic tags.
       If the tag is 0, it does not exist in the host ELF implementation */
@@ -100,9 +148,11 @@ public:
 
 private:
   friend class cmELFInternal;
+  void Load(std::unique_ptr<cmELFStream> &fin);
   bool Valid() const;
   cmELFInternal *Internal;
   std::string ErrorMessage;
+  Status ErrorStatus = StatusValid;
 };
 
 #endif
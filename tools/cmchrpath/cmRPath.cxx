@@ -0,0 +1,637 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file Copyright.txt or https://cmake.org/licensing for details.  */
+#include "cmRPath.h"
+#include "cmELF.h"
+#include "summary.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utility>
+
+namespace cmake {
+namespace {
+// Write all of data at pos, retrying on EINTR and short writes.
+bool WriteAt(int fd, char const *data, size_t size, unsigned long pos) {
+  while (size > 0) {
+    ssize_t n = pwrite(fd, data, size, static_cast<off_t>(pos));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+    pos += static_cast<unsigned long>(n);
+  }
+  return true;
+}
+
+// Closes the file on every way out of ApplyRPathPlan.
+struct FileCloser {
+  int Fd;
+  ~FileCloser() { close(this->Fd); }
+};
+
+// Plan rewriting the DYNAMIC table without the entries erase selects.  The
+// entries after them move up; what is left of the old table past the
+// moved DT_NULL is never read.
+template <typename Erase>
+bool EraseDynamicEntries(cmELF &elf, Erase erase, RPathPlan &plan,
+                         std::string *emsg) {
+  // Obtain a copy of the dynamic entries
+  cmELF::DynamicEntryList dentries = elf.GetDynamicEntries();
+  if (dentries.empty()) {
+    // This should happen only for invalid ELF files where a DT_NULL
+    // appears before the end of the table.
+    if (emsg) {
+      *emsg = "DYNAMIC section contains a DT_NULL before the end.";
+    }
+    plan.Error = RPathPlan::ErrorMalformed;
+    return false;
+  }
+
+  // Get size of one DYNAMIC entry
+  unsigned long const sizeof_dentry =
+      elf.GetDynamicEntryPosition(1) - elf.GetDynamicEntryPosition(0);
+
+  unsigned long entriesErased = 0;
+  for (cmELF::DynamicEntryList::iterator it = dentries.begin();
+       it != dentries.end();) {
+    if (erase(*it)) {
+      it = dentries.erase(it);
+      entriesErased++;
+      continue;
+    }
+    if (cmELF::TagMipsRldMapRel != 0 && it->first == cmELF::TagMipsRldMapRel) {
+      // Background: debuggers need to know the "linker map" which contains
+      // the addresses each dynamic object is loaded at. Most arches use
+      // the DT_DEBUG tag which the dynamic linker writes to (directly) and
+      // contain the location of the linker map, however on MIPS the
+      // .dynamic section is always read-only so this is not possible. MIPS
+      // objects instead contain a DT_MIPS_RLD_MAP tag which contains the
+      // address where the dynamic linker will write to (an indirect
+      // version of DT_DEBUG). Since this doesn't work when using PIE, a
+      // relative equivalent was created - DT_MIPS_RLD_MAP_REL. Since this
+      // version contains a relative offset, moving it changes the
+      // calculated address. This may cause the dynamic linker to write
+      // into memory it should not be changing.
+      //
+      // To fix this, we adjust the value of DT_MIPS_RLD_MAP_REL here. If
+      // we move it up by n bytes, we add n bytes to the value of this tag.
+      it->second += entriesErased * sizeof_dentry;
+    }
+
+    it++;
+  }
+
+  // Encode new entries list
+  plan.Remove = true;
+  plan.DynamicBytes = elf.EncodeDynamicEntries(dentries);
+  plan.DynamicBegin = elf.GetDynamicEntryPosition(0);
+  return true;
+}
+} // namespace
+
+bool PlanRemoveRPath(cmELF &elf, RPathPlan &plan, std::string *emsg) {
+  plan = RPathPlan();
+
+  // Get the RPATH and RUNPATH entries from it and sort them by index
+  // in the dynamic section header.
+  int se_count = 0;
+  cmELF::StringEntry const *se[2] = {nullptr, nullptr};
+  const char *se_name[2] = {nullptr, nullptr};
+  if (cmELF::StringEntry const *se_rpath = elf.GetRPath()) {
+    se[se_count] = se_rpath;
+    se_name[se_count] = "RPATH";
+    ++se_count;
+  }
+  if (cmELF::StringEntry const *se_runpath = elf.GetRunPath()) {
+    se[se_count] = se_runpath;
+    se_name[se_count] = "RUNPATH";
+    ++se_count;
+  }
+  if (se_count == 0) {
+    // There is no RPATH or RUNPATH anyway.
+    return true;
+  }
+  if (se_count == 2 && se[1]->IndexInSection < se[0]->IndexInSection) {
+    std::swap(se[0], se[1]);
+    std::swap(se_name[0], se_name[1]);
+  }
+
+  // Save information about the string entries to be zeroed.
+  plan.Count = se_count;
+  for (int i = 0; i < se_count; ++i) {
+    plan.Entries[i].Position = se[i]->Position;
+    plan.Entries[i].Size = se[i]->Size;
+    plan.Entries[i].Name = se_name[i];
+  }
+
+  // Adjust the entry list as necessary to remove the run path
+  return EraseDynamicEntries(
+      elf,
+      [](std::pair<long, unsigned long> const &entry) {
+        return entry.first == cmELF::TagRPath ||
+               entry.first == cmELF::TagRunPath;
+      },
+      plan, emsg);
+}
+
+bool PlanRemoveNeeded(cmELF &elf, std::vector<std::string> const &names,
+                      RPathPlan &plan, std::string *emsg) {
+  plan = RPathPlan();
+  std::vector<std::string> needed = elf.GetNeeded();
+  if (!elf) {
+    if (emsg) {
+      *emsg = elf.GetErrorMessage();
+    }
+    plan.Error = RPathPlan::ErrorMalformed;
+    return false;
+  }
+  bool any = false;
+  for (std::string const &name : names) {
+    if (std::find(needed.begin(), needed.end(), name) == needed.end()) {
+      if (emsg) {
+        *emsg = "The file does not need ";
+        *emsg += name;
+        *emsg += ".";
+      }
+      plan.Error = RPathPlan::ErrorMismatch;
+      return false;
+    }
+    any = true;
+  }
+  if (!any) {
+    return true;
+  }
+
+  // The DT_NEEDED entries come in the order GetNeeded returns their
+  // strings.  The strings stay in the string table; nothing else refers to
+  // them, and the table is shared with the other dynamic strings.
+  size_t index = 0;
+  return EraseDynamicEntries(
+      elf,
+      [&](std::pair<long, unsigned long> const &entry) {
+        if (entry.first != DT_NEEDED || index >= needed.size()) {
+          return false;
+        }
+        std::string const &name = needed[index++];
+        return std::find(names.begin(), names.end(), name) != names.end();
+      },
+      plan, emsg);
+}
+
+bool ApplyRPathPlan(std::string const &file, RPathPlan const &plan,
+                    std::string *emsg, bool *changed) {
+  if (changed) {
+    *changed = false;
+  }
+
+  // If no runtime path needs to be changed, we are done.
+  if (plan.Empty()) {
+    return true;
+  }
+
+  // Open the file for update.
+  int fd = open(file.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd == -1) {
+    if (emsg) {
+      *emsg = "Error opening file for update.";
+    }
+    return false;
+  }
+  FileCloser closer{fd};
+  return ApplyRPathPlan(fd, plan, emsg, changed);
+}
+
+bool ApplyRPathPlan(int fd, RPathPlan const &plan, std::string *emsg,
+                    bool *changed) {
+  if (changed) {
+    *changed = false;
+  }
+  if (plan.Empty()) {
+    return true;
+  }
+
+  if (plan.Remove) {
+    // Write the new DYNAMIC table header.
+    if (!WriteAt(fd, plan.DynamicBytes.data(), plan.DynamicBytes.size(),
+                 plan.DynamicBegin)) {
+      if (emsg) {
+        *emsg = "Error replacing DYNAMIC table header.";
+      }
+      return false;
+    }
+  }
+
+  // Store the new RPATH and RUNPATH strings.  A removal stores empty
+  // strings, which fills the entries with zero bytes.
+  std::string bytes;
+  for (int i = 0; i < plan.Count; ++i) {
+    RPathPlan::Entry const &rp = plan.Entries[i];
+
+    // Write the new rpath.  Follow it with enough null terminators to
+    // fill the string table entry.
+    bytes.assign(rp.Value);
+    if (bytes.size() < rp.Size) {
+      bytes.resize(rp.Size, '\0');
+    }
+    if (!WriteAt(fd, bytes.data(), bytes.size(), rp.Position)) {
+      if (emsg) {
+        *emsg = "Error writing the new ";
+        *emsg += rp.Name;
+        *emsg += " string to the file.";
+      }
+      return false;
+    }
+  }
+
+  // Everything was updated successfully.
+  if (changed) {
+    *changed = true;
+  }
+  return true;
+}
+
+bool ApplyRPathPlan(char *data, unsigned long size, RPathPlan const &plan,
+                    bool *changed) {
+  if (changed) {
+    *changed = false;
+  }
+  if (plan.Empty()) {
+    return true;
+  }
+  // Check every range before touching anything, so a plan made for
+  // another file leaves the buffer as it was.
+  auto fits = [size](unsigned long pos, unsigned long len) {
+    return pos <= size && len <= size - pos;
+  };
+  if (plan.Remove && !fits(plan.DynamicBegin, plan.DynamicBytes.size())) {
+    return false;
+  }
+  for (int i = 0; i < plan.Count; ++i) {
+    RPathPlan::Entry const &rp = plan.Entries[i];
+    if (!fits(rp.Position, std::max<unsigned long>(rp.Size, rp.Value.size()))) {
+      return false;
+    }
+  }
+  if (plan.Remove) {
+    memcpy(data + plan.DynamicBegin, plan.DynamicBytes.data(),
+           plan.DynamicBytes.size());
+  }
+  for (int i = 0; i < plan.Count; ++i) {
+    RPathPlan::Entry const &rp = plan.Entries[i];
+    memcpy(data + rp.Position, rp.Value.data(), rp.Value.size());
+    if (rp.Value.size() < rp.Size) {
+      memset(data + rp.Position + rp.Value.size(), 0,
+             rp.Size - rp.Value.size());
+    }
+  }
+  if (changed) {
+    *changed = true;
+  }
+  return true;
+}
+
+bool RemoveRPath(std::string const &file, std::string *emsg, bool *removed) {
+  RPathPlan plan;
+  {
+    // Parse the ELF binary.
+    cmELF elf(file.c_str());
+    if (!PlanRemoveRPath(elf, plan, emsg)) {
+      if (removed) {
+        *removed = false;
+      }
+      return false;
+    }
+  }
+  return ApplyRPathPlan(file, plan, emsg, removed);
+}
+
+std::string::size_type cmSystemToolsFindRPath(std::string const &have,
+                                              std::string const &want) {
+  std::string::size_type pos = 0;
+  while (pos < have.size()) {
+    // Look for an occurrence of the string.
+    std::string::size_type const beg = have.find(want, pos);
+    if (beg == std::string::npos) {
+      return std::string::npos;
+    }
+
+    // Make sure it is separated from preceding entries.
+    if (beg > 0 && have[beg - 1] != ':') {
+      pos = beg + 1;
+      continue;
+    }
+
+    // Make sure it is separated from following entries.
+    std::string::size_type const end = beg + want.size();
+    if (end < have.size() && have[end] != ':') {
+      pos = beg + 1;
+      continue;
+    }
+
+    // Return the position of the path portion.
+    return beg;
+  }
+
+  // The desired rpath was not found.
+  return std::string::npos;
+}
+
+bool PlanChangeRPath(cmELF &elf, std::string const &oldRPath,
+                     std::string const &newRPath, RPathPlan &plan,
+                     std::string *emsg) {
+  plan = RPathPlan();
+  bool remove_rpath = true;
+
+  // Get the RPATH and RUNPATH entries from it.
+  int se_count = 0;
+  cmELF::StringEntry const *se[2] = {nullptr, nullptr};
+  const char *se_name[2] = {nullptr, nullptr};
+  if (cmELF::StringEntry const *se_rpath = elf.GetRPath()) {
+    se[se_count] = se_rpath;
+    se_name[se_count] = "RPATH";
+    ++se_count;
+  }
+  if (cmELF::StringEntry const *se_runpath = elf.GetRunPath()) {
+    se[se_count] = se_runpath;
+    se_name[se_count] = "RUNPATH";
+    ++se_count;
+  }
+  if (se_count == 0) {
+    if (newRPath.empty()) {
+      // The new rpath is empty and there is no rpath anyway so it is
+      // okay.
+      return true;
+    }
+    if (emsg) {
+      *emsg = "No valid ELF RPATH or RUNPATH entry exists in the file; ";
+      *emsg += elf.GetErrorMessage();
+    }
+    plan.Error = elf ? RPathPlan::ErrorNoEntry : RPathPlan::ErrorMalformed;
+    return false;
+  }
+
+  int &rp_count = plan.Count;
+  RPathPlan::Entry *rp = plan.Entries;
+  for (int i = 0; i < se_count; ++i) {
+    // If both RPATH and RUNPATH refer to the same string literal it
+    // needs to be changed only once.
+    if (rp_count && rp[0].Position == se[i]->Position) {
+      continue;
+    }
+
+    // Make sure the current rpath contains the old rpath.
+    std::string::size_type pos =
+        cmSystemToolsFindRPath(se[i]->Value, oldRPath);
+    if (pos == std::string::npos) {
+      // If it contains the new rpath instead then it is okay.
+      if (cmSystemToolsFindRPath(se[i]->Value, newRPath) !=
+          std::string::npos) {
+        remove_rpath = false;
+        continue;
+      }
+      if (emsg) {
+        *emsg = "The current ";
+        *emsg += se_name[i];
+        *emsg += " is:\n  ";
+        *emsg += se[i]->Value;
+        *emsg += "\nwhich does not contain:\n  ";
+        *emsg += oldRPath;
+        *emsg += "\nas was expected.";
+      }
+      plan.Error = RPathPlan::ErrorMismatch;
+      return false;
+    }
+
+    // Store information about the entry in the file.
+    rp[rp_count].Position = se[i]->Position;
+    rp[rp_count].Size = se[i]->Size;
+    rp[rp_count].Name = se_name[i];
+
+    std::string::size_type prefix_len = pos;
+
+    // If oldRPath was at the end of the file's RPath, and newRPath is empty,
+    // we should remove the unnecessary ':' at the end.
+    if (newRPath.empty() && pos > 0 && se[i]->Value[pos - 1] == ':' &&
+        pos + oldRPath.length() == se[i]->Value.length()) {
+      prefix_len--;
+    }
+
+    // Construct the new value which preserves the part of the path
+    // not being changed.
+    rp[rp_count].Value = se[i]->Value.substr(0, prefix_len);
+    rp[rp_count].Value += newRPath;
+    rp[rp_count].Value += se[i]->Value.substr(pos + oldRPath.length());
+
+    if (!rp[rp_count].Value.empty()) {
+      remove_rpath = false;
+    }
+
+    // Make sure there is enough room to store the new rpath and at
+    // least one null terminator.
+    if (rp[rp_count].Size < rp[rp_count].Value.length() + 1) {
+      if (emsg) {
+        *emsg = "The replacement path is too long for the ";
+        *emsg += se_name[i];
+        *emsg += " entry.";
+      }
+      plan.Error = RPathPlan::ErrorTooLong;
+      return false;
+    }
+
+    // This entry is ready for update.
+    ++rp_count;
+  }
+
+  // If the resulting rpath is empty, just remove the entire entry instead.
+  if (rp_count != 0 && remove_rpath) {
+    return PlanRemoveRPath(elf, plan, emsg);
+  }
+  return true;
+}
+
+bool PlanSelectRPath(cmELF &elf, std::vector<unsigned> const Select[2],
+                     RPathPlan &plan, std::string *emsg) {
+  plan = RPathPlan();
+  cmELF::StringEntry const *se[2] = {elf.GetRPath(), elf.GetRunPath()};
+  const char *se_name[2] = {"RPATH", "RUNPATH"};
+  if (!elf) {
+    if (emsg) {
+      *emsg = elf.GetErrorMessage();
+    }
+    plan.Error = RPathPlan::ErrorMalformed;
+    return false;
+  }
+
+  bool remove_rpath = se[1] == nullptr;
+  int &rp_count = plan.Count;
+  RPathPlan::Entry *rp = plan.Entries;
+  for (int i = 0; i < 2; ++i) {
+    if (se[i] == nullptr) {
+      continue;
+    }
+    // If both RPATH and RUNPATH refer to the same string literal it
+    // needs to be changed only once.
+    if (i == 1 && se[0] && se[0]->Position == se[1]->Position) {
+      continue;
+    }
+
+    // Split the current value into its entries.
+    std::vector<std::string> entries;
+    std::string::size_type pos = 0;
+    for (;;) {
+      std::string::size_type colon = se[i]->Value.find(':', pos);
+      entries.push_back(se[i]->Value.substr(pos, colon - pos));
+      if (colon == std::string::npos) {
+        break;
+      }
+      pos = colon + 1;
+    }
+
+    // Join the selected ones.
+    std::string value;
+    bool first = true;
+    for (unsigned index : Select[i]) {
+      if (index >= entries.size()) {
+        if (emsg) {
+          *emsg = "The ";
+          *emsg += se_name[i];
+          *emsg += " has no entry ";
+          *emsg += std::to_string(index);
+          *emsg += ".";
+        }
+        plan.Error = RPathPlan::ErrorMismatch;
+        return false;
+      }
+      if (!first) {
+        value += ':';
+      }
+      value += entries[index];
+      first = false;
+    }
+    if (!value.empty()) {
+      remove_rpath = false;
+    }
+    if (value == se[i]->Value) {
+      continue;
+    }
+
+    // An entry listed twice may make it longer.
+    if (se[i]->Size < value.length() + 1) {
+      if (emsg) {
+        *emsg = "The new ";
+        *emsg += se_name[i];
+        *emsg += " is too long for the entry.";
+      }
+      plan.Error = RPathPlan::ErrorTooLong;
+      return false;
+    }
+    rp[rp_count].Position = se[i]->Position;
+    rp[rp_count].Size = se[i]->Size;
+    rp[rp_count].Name = se_name[i];
+    rp[rp_count].Value = value;
+    ++rp_count;
+  }
+
+  // If the resulting rpath is empty, just remove the entire entry instead.
+  if (rp_count != 0 && remove_rpath) {
+    return PlanRemoveRPath(elf, plan, emsg);
+  }
+  return true;
+}
+
+bool ChangeRPath(std::string const &file, std::string const &oldRPath,
+                 std::string const &newRPath, std::string *emsg,
+                 bool *changed) {
+  if (changed) {
+    *changed = false;
+  }
+  RPathPlan plan;
+  {
+    // Parse the ELF binary.
+    cmELF elf(file.c_str());
+    if (!PlanChangeRPath(elf, oldRPath, newRPath, plan, emsg)) {
+      return false;
+    }
+  }
+  return ApplyRPathPlan(file, plan, emsg, changed);
+}
+
+// check rpath exists.
+bool CheckRPath(std::string const &file, std::string const &newRPath) {
+  // Parse the ELF binary.
+  cmELF elf(file.c_str());
+
+  // Get the RPATH or RUNPATH entry from it.
+  cmELF::StringEntry const *se = elf.GetRPath();
+  if (!se) {
+    se = elf.GetRunPath();
+  }
+  // Make sure the current rpath contains the new rpath.
+  if (newRPath.empty()) {
+    if (!se) {
+      return true;
+    }
+  } else {
+    if (se &&
+        cmSystemToolsFindRPath(se->Value, newRPath) != std::string::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string LookupRPath(const std::string &file) {
+
+  cmELF elf(file.c_str());
+
+  // Get the RPATH or RUNPATH entry from it.
+  cmELF::StringEntry const *se = elf.GetRPath();
+  if (se == nullptr) {
+    se = elf.GetRunPath();
+  }
+  if (se == nullptr) {
+    return "";
+  }
+  return std::string(se->Value);
+}
+
+bool SummarizeELF(cmELF &elf, mz::elf_summary &summary) {
+  summary = mz::elf_summary();
+  cmELF::HeaderInfo info;
+  if (!elf.GetHeaderInfo(info)) {
+    return false;
+  }
+  summary.elfclass = info.Class == 64 ? 2 : 1;
+  summary.endian = info.MSB ? 2 : 1;
+  summary.version = static_cast<uint8_t>(info.Version);
+  summary.osabi = static_cast<uint8_t>(info.OSABI);
+  summary.abiversion = static_cast<uint8_t>(info.ABIVersion);
+  summary.type = static_cast<uint16_t>(info.Type);
+  summary.machine = static_cast<uint16_t>(info.Machine);
+  struct {
+    cmELF::StringEntry const *Entry;
+    mz::elf_string *Out;
+  } const strings[] = {{elf.GetSOName(), &summary.soname},
+                       {elf.GetRPath(), &summary.rpath},
+                       {elf.GetRunPath(), &summary.runpath}};
+  for (auto const &s : strings) {
+    if (s.Entry != nullptr) {
+      s.Out->value = s.Entry->Value;
+      s.Out->position = s.Entry->Position;
+      s.Out->size = s.Entry->Size;
+      s.Out->present = true;
+    }
+  }
+  summary.needed = elf.GetNeeded();
+  // Reading the strings may have found the file to be malformed.
+  summary.valid = static_cast<bool>(elf);
+  return summary.valid;
+}
+} // namespace cmake
@@ -0,0 +1,111 @@
+/* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+   file Copyright.txt or https://cmake.org/licensing for details.  */
+#ifndef cmRPath_h
+#define cmRPath_h
+
+#include <string>
+#include <vector>
+
+class cmELF;
+
+namespace mz {
+struct elf_summary;
+}
+
+namespace cmake {
+
+/** \brief A planned in-place edit of the RPATH/RUNPATH of one ELF file.
+ *
+ * Planning only reads the file; ApplyRPathPlan performs the writes.  This
+ * lets callers parse, plan and write in different places.
+ */
+struct RPathPlan {
+  struct Entry {
+    // The position and size of the string table slot.
+    unsigned long Position = 0;
+    unsigned long Size = 0;
+    // "RPATH" or "RUNPATH".
+    std::string Name;
+    // The new value; padded with null terminators up to Size.
+    std::string Value;
+  };
+  Entry Entries[2];
+  int Count = 0;
+
+  // When set, the DYNAMIC table is rewritten from DynamicBytes: without
+  // the RPATH and RUNPATH entries, whose strings are zeroed, or without
+  // some DT_NEEDED entries.
+  bool Remove = false;
+  unsigned long DynamicBegin = 0;
+  std::vector<char> DynamicBytes;
+
+  /** Why planning failed, for callers that skip the message.  */
+  enum ErrorCode {
+    ErrorNone,
+    ErrorNoEntry,   // a replacement needs an RPATH or RUNPATH to edit
+    ErrorMismatch,  // the current path does not contain the old one
+    ErrorTooLong,   // the new path does not fit in place
+    ErrorMalformed, // the file is not a valid ELF file
+  };
+  ErrorCode Error = ErrorNone;
+
+  /** True if applying the plan writes nothing.  */
+  bool Empty() const { return this->Count == 0 && !this->Remove; }
+};
+
+/** Plan the removal of the RPATH and RUNPATH entries.  */
+bool PlanRemoveRPath(cmELF &elf, RPathPlan &plan, std::string *emsg);
+
+/** Plan the removal of the DT_NEEDED entries naming one of names.  */
+bool PlanRemoveNeeded(cmELF &elf, std::vector<std::string> const &names,
+                      RPathPlan &plan, std::string *emsg);
+
+/** Plan replacing oldRPath with newRPath in the RPATH and RUNPATH.  */
+bool PlanChangeRPath(cmELF &elf, std::string const &oldRPath,
+                     std::string const &newRPath, RPathPlan &plan,
+                     std::string *emsg);
+
+/** Plan rewriting the RPATH and RUNPATH in place with some of their
+    ':'-separated entries, in a new order.  Select[0] lists the indices of
+    the RPATH entries to keep and Select[1] those of the RUNPATH.  The
+    result is never longer, so it always fits.  When both name the same
+    string Select[0] is used for it.  Removes both entries if nothing is
+    kept and there is no RUNPATH, whose presence alone changes the search
+    of the file's dependencies.  */
+bool PlanSelectRPath(cmELF &elf, std::vector<unsigned> const Select[2],
+                     RPathPlan &plan, std::string *emsg);
+
+/** Write a plan to the file it was made for.  */
+bool ApplyRPathPlan(std::string const &file, RPathPlan const &plan,
+                    std::string *emsg, bool *changed);
+
+/** Write a plan through a descriptor open for writing.  */
+bool ApplyRPathPlan(int fd, RPathPlan const &plan, std::string *emsg,
+                    bool *changed);
+
+/** Apply a plan to a copy of the file in memory.  Fails without writing
+    if the plan reaches past size.  */
+bool ApplyRPathPlan(char *data, unsigned long size, RPathPlan const &plan,
+                    bool *changed);
+
+bool RemoveRPath(std::string const &file, std::string *emsg, bool *removed);
+
+bool ChangeRPath(std::string const &file, std::string const &oldRPath,
+                 std::string const &newRPath, std::string *emsg,
+                 bool *changed);
+
+/** Find want as a whole ':'-separated entry of have.  */
+std::string::size_type cmSystemToolsFindRPath(std::string const &have,
+                                              std::string const &want);
+
+// check rpath exists.
+bool CheckRPath(std::string const &file, std::string const &newRPath);
+
+std::string LookupRPath(const std::string &file);
+
+/** Fill a summary from a parsed file for caching.  Returns its validity.  */
+bool SummarizeELF(cmELF &elf, mz::elf_summary &summary);
+
+} // namespace cmake
+
+#endif
@@ -0,0 +1,275 @@
+///
+#ifndef cmRPathAsync_h
+#define cmRPathAsync_h
+
+#include "cmELF.h"
+#include "cmRPath.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cmake {
+
+/** \brief Where the blocking halves of asynchronous rpath edits run.
+ *
+ * An edit is a read (parse the file and plan the change) followed by a
+ * write (apply the plan).  Each is handed to Submit as one piece of work
+ * that may block on disk I/O; when it is done, the rest of the edit is
+ * handed to Resume.  An event loop implements Submit with its own I/O
+ * workers and Resume by posting to itself, so its thread never blocks and
+ * the number of edits in flight is not bounded by threads.
+ */
+class RPathExecutor {
+public:
+  virtual ~RPathExecutor() = default;
+  virtual void Submit(std::function<void()> work) = 0;
+  /** By default the edit continues on the thread that did the work.  */
+  virtual void Resume(std::function<void()> next) { next(); }
+};
+
+/** \brief A fixed set of threads draining one queue of I/O work.  */
+class RPathThreadPool : public RPathExecutor {
+public:
+  explicit RPathThreadPool(unsigned threads) {
+    if (threads == 0) {
+      threads = 1;
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+      this->Threads.emplace_back([this] { this->Work(); });
+    }
+  }
+  RPathThreadPool(RPathThreadPool const &) = delete;
+  RPathThreadPool &operator=(RPathThreadPool const &) = delete;
+  /** Runs what was submitted, then joins.  */
+  ~RPathThreadPool() override {
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      this->Stopping = true;
+    }
+    this->Ready.notify_all();
+    for (std::thread &t : this->Threads) {
+      t.join();
+    }
+  }
+
+  void Submit(std::function<void()> work) override {
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      this->Queue.push_back(std::move(work));
+    }
+    this->Ready.notify_one();
+  }
+
+private:
+  void Work() {
+    std::unique_lock<std::mutex> lock(this->Mutex);
+    for (;;) {
+      this->Ready.wait(lock, [this] {
+        return this->Stopping || !this->Queue.empty();
+      });
+      if (this->Queue.empty()) {
+        return;
+      }
+      std::function<void()> work = std::move(this->Queue.front());
+      this->Queue.pop_front();
+      lock.unlock();
+      work();
+      lock.lock();
+    }
+  }
+
+  std::mutex Mutex;
+  std::condition_variable Ready;
+  std::deque<std::function<void()>> Queue;
+  bool Stopping = false;
+  std::vector<std::thread> Threads;
+};
+
+/** The outcome of an asynchronous edit.  */
+struct RPathResult {
+  bool Ok = false;
+  bool Changed = false;
+  std::string Error;
+};
+
+/** The outcome of the read half: the plan to write, or why there is none.  */
+struct RPathPlanResult {
+  bool Ok = false;
+  RPathPlan Plan;
+  std::string Error;
+};
+
+} // namespace cmake
+
+// The coroutine interface needs C++20; the rest of the tool builds as
+// C++17 and sees only the executor types above.
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+#include <exception>
+#include <optional>
+
+namespace cmake {
+
+/** \brief A lazily started coroutine producing T.
+ *
+ * co_await it from another coroutine, or Start it from plain code with a
+ * callback that receives the result; a started task owns itself and frees
+ * its frame once the callback returns.
+ */
+template <typename T> class RPathTask {
+public:
+  struct promise_type;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  struct promise_type {
+    std::optional<T> Value;
+    std::coroutine_handle<> Continuation;
+    std::function<void(T)> Done;
+
+    RPathTask get_return_object() {
+      return RPathTask(Handle::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    struct FinalAwaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(Handle h) noexcept {
+        promise_type &p = h.promise();
+        if (p.Continuation) {
+          return p.Continuation;
+        }
+        std::function<void(T)> done = std::move(p.Done);
+        T value = std::move(*p.Value);
+        h.destroy();
+        if (done) {
+          done(std::move(value));
+        }
+        return std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    template <typename U> void return_value(U &&value) {
+      this->Value.emplace(std::forward<U>(value));
+    }
+    // Edits report failures in their result; anything thrown is a bug.
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+
+  RPathTask(RPathTask &&other) noexcept
+      : Coroutine(std::exchange(other.Coroutine, nullptr)) {}
+  RPathTask &operator=(RPathTask &&) = delete;
+  ~RPathTask() {
+    if (this->Coroutine) {
+      this->Coroutine.destroy();
+    }
+  }
+
+  /** Run the task, passing its result to done when it finishes.  */
+  void Start(std::function<void(T)> done) && {
+    Handle h = std::exchange(this->Coroutine, nullptr);
+    h.promise().Done = std::move(done);
+    h.resume();
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) {
+    this->Coroutine.promise().Continuation = caller;
+    return this->Coroutine;
+  }
+  T await_resume() { return std::move(*this->Coroutine.promise().Value); }
+
+private:
+  explicit RPathTask(Handle h) : Coroutine(h) {}
+  Handle Coroutine;
+};
+
+/** \brief Awaitable that runs Fn on an executor and resumes with its result.
+ */
+template <typename T> class RPathOperation {
+public:
+  RPathOperation(RPathExecutor &executor, std::function<T()> fn)
+      : Executor(executor), Fn(std::move(fn)) {}
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> h) {
+    this->Executor.Submit([this, h] {
+      this->Value.emplace(this->Fn());
+      this->Executor.Resume([h] { h.resume(); });
+    });
+  }
+  T await_resume() { return std::move(*this->Value); }
+
+private:
+  RPathExecutor &Executor;
+  std::function<T()> Fn;
+  std::optional<T> Value;
+};
+
+/** The read half of an edit: parse file and call plan on it.  */
+inline RPathOperation<RPathPlanResult>
+ReadRPathPlan(RPathExecutor &executor, std::string file,
+              std::function<bool(cmELF &, RPathPlan &, std::string *)> plan) {
+  return RPathOperation<RPathPlanResult>(
+      executor, [file = std::move(file), plan = std::move(plan)] {
+        RPathPlanResult r;
+        cmELF elf(file.c_str());
+        r.Ok = plan(elf, r.Plan, &r.Error);
+        return r;
+      });
+}
+
+/** The write half of an edit: apply a plan to file.  */
+inline RPathOperation<RPathResult> WriteRPathPlan(RPathExecutor &executor,
+                                                  std::string file,
+                                                  RPathPlan plan) {
+  return RPathOperation<RPathResult>(
+      executor, [file = std::move(file), plan = std::move(plan)] {
+        RPathResult r;
+        r.Ok = ApplyRPathPlan(file, plan, &r.Error, &r.Changed);
+        return r;
+      });
+}
+
+// The edits below name the operations they await: GCC 12 destroys a
+// lambda temporary created inside a co_await expression twice.
+
+/** Asynchronous ChangeRPath: the executor does the reads and writes.  */
+inline RPathTask<RPathResult> ChangeRPathAsync(RPathExecutor &executor,
+                                               std::string file,
+                                               std::string oldRPath,
+                                               std::string newRPath) {
+  auto read = ReadRPathPlan(
+      executor, file,
+      [oldRPath, newRPath](cmELF &elf, RPathPlan &plan, std::string *emsg) {
+        return PlanChangeRPath(elf, oldRPath, newRPath, plan, emsg);
+      });
+  RPathPlanResult planned = co_await read;
+  if (!planned.Ok) {
+    co_return RPathResult{false, false, std::move(planned.Error)};
+  }
+  auto write = WriteRPathPlan(executor, file, std::move(planned.Plan));
+  co_return co_await write;
+}
+
+/** Asynchronous RemoveRPath.  */
+inline RPathTask<RPathResult> RemoveRPathAsync(RPathExecutor &executor,
+                                               std::string file) {
+  auto read = ReadRPathPlan(executor, file, &PlanRemoveRPath);
+  RPathPlanResult planned = co_await read;
+  if (!planned.Ok) {
+    co_return RPathResult{false, false, std::move(planned.Error)};
+  }
+  auto write = WriteRPathPlan(executor, file, std::move(planned.Plan));
+  co_return co_await write;
+}
+
+} // namespace cmake
+
+#endif
+
+#endif
@@ -0,0 +1,441 @@
+///
+#include "daemon.hpp"
+#include "cmELF.h"
+#include "cmRPath.h"
+#include "elfview.hpp"
+#include "fields.hpp"
+#include "sink.hpp"
+#include "summary.hpp"
+#include "walker.hpp"
+#include "workers.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+// Buffered reader of LF-terminated lines from a socket.
+class LineReader {
+public:
+  explicit LineReader(int fd) : Fd(fd) {}
+  bool Next(std::string &line) {
+    for (;;) {
+      auto pos = this->Buffer.find('\n', this->Begin);
+      if (pos != std::string::npos) {
+        line.assign(this->Buffer, this->Begin, pos - this->Begin);
+        this->Begin = pos + 1;
+        return true;
+      }
+      this->Buffer.erase(0, this->Begin);
+      this->Begin = 0;
+      char buf[16 * 1024];
+      auto n = read(this->Fd, buf, sizeof(buf));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      this->Buffer.append(buf, static_cast<size_t>(n));
+    }
+  }
+
+  // True if another complete line is already buffered.
+  bool Buffered() const {
+    return this->Buffer.find('\n', this->Begin) != std::string::npos;
+  }
+
+private:
+  int Fd;
+  std::string Buffer;
+  size_t Begin = 0;
+};
+
+// The client's cwd is not the daemon's: send paths it can resolve.
+std::string AbsolutePath(std::string const &file, std::string const &cwd) {
+  if (!file.empty() && file[0] == '/') {
+    return file;
+  }
+  return cwd + "/" + file;
+}
+
+bool MakeAddress(const char *socketPath, sockaddr_un &addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  strcpy(addr.sun_path, socketPath);
+  return true;
+}
+
+class Daemon {
+public:
+  void Serve(int fd);
+
+private:
+  void Handle(std::string_view line, std::string &out);
+  bool Summary(const std::string &file, mz::elf_summary &s);
+  std::mutex &FileLock(const std::string &file) {
+    return this->FileLocks[mz::fnv1a64(file) % (sizeof(this->FileLocks) /
+                                                 sizeof(this->FileLocks[0]))];
+  }
+
+  mz::summary_cache Cache;
+  // Edits of the same file are serialized; lookups are not.
+  std::mutex FileLocks[64];
+};
+
+// Look up a summary, parsing the file only if the cached one is stale.
+bool Daemon::Summary(const std::string &file, mz::elf_summary &s) {
+  mz::file_identity id;
+  if (!mz::stat_identity(file.c_str(), id)) {
+    s = mz::elf_summary();
+    return false;
+  }
+  if (this->Cache.find(file, id, s)) {
+    return s.valid;
+  }
+  // Lookups need only the dynamic strings: map the file and touch the
+  // few pages that hold them.
+  mz::read_elf_summary(file.c_str(), s);
+  this->Cache.store(file, id, s);
+  return s.valid;
+}
+
+void Daemon::Handle(std::string_view line, std::string &out) {
+  auto fields = mz::split_fields(line);
+  auto const &op = fields[0];
+  auto arg = [&](size_t i) { return mz::unescape(fields[i]); };
+  auto ok = [&](std::string_view value) {
+    out.append("OK\t");
+    mz::append_escaped(out, value);
+  };
+  auto error = [&](std::string_view msg) {
+    out.append("ERR\t");
+    mz::append_escaped(out, msg);
+  };
+  // Paths are resolved against the cwd of the daemon, not of the client,
+  // so only absolute ones mean the same to both.
+  if (op != "PING" && fields.size() > 1 && fields[1].substr(0, 1) != "/") {
+    error("not an absolute path: " + arg(1));
+  } else if (op == "PING") {
+    ok("cmchrpath");
+  } else if (op == "LOOKUP" && fields.size() == 2) {
+    mz::elf_summary s;
+    auto file = arg(1);
+    if (this->Summary(file, s)) {
+      ok(s.search_path());
+    } else {
+      error(file + ": not a readable ELF file");
+    }
+  } else if (op == "CHECK" && fields.size() == 3) {
+    // Same answer as cmake::CheckRPath, from the cache.
+    mz::elf_summary s;
+    this->Summary(arg(1), s);
+    auto want = arg(2);
+    const mz::elf_string *se = s.rpath.present     ? &s.rpath
+                               : s.runpath.present ? &s.runpath
+                                                   : nullptr;
+    bool present = want.empty() ? se == nullptr
+                                : se != nullptr &&
+                                      cmake::cmSystemToolsFindRPath(
+                                          se->value, want) != std::string::npos;
+    ok(present ? "1" : "0");
+  } else if ((op == "CHANGE" && (fields.size() == 3 || fields.size() == 4)) ||
+             (op == "REMOVE" && fields.size() == 2)) {
+    auto file = arg(1);
+    std::lock_guard<std::mutex> lock(this->FileLock(file));
+    mz::elf_summary s;
+    this->Summary(file, s);
+    std::string old = s.search_path();
+    bool remove = op == "REMOVE";
+    std::string newrpath = remove ? std::string() : arg(2);
+    if (!remove && fields.size() == 4) {
+      old = arg(3);
+    }
+    // Nothing to write when every entry already holds the new value and
+    // not the old one; answer from the cache without opening the file.
+    bool done = !remove && (s.rpath.present || s.runpath.present);
+    for (auto const *se : {&s.rpath, &s.runpath}) {
+      if (se->present &&
+          (cmake::cmSystemToolsFindRPath(se->value, old) !=
+               std::string::npos ||
+           cmake::cmSystemToolsFindRPath(se->value, newrpath) ==
+               std::string::npos)) {
+        done = false;
+      }
+    }
+    if (done) {
+      ok(old);
+      out.append("\t0");
+      out.push_back('\n');
+      return;
+    }
+    std::string emsg;
+    cmake::RPathPlan plan;
+    bool planned;
+    {
+      cmELF elf(file.c_str());
+      planned = remove ? cmake::PlanRemoveRPath(elf, plan, &emsg)
+                       : cmake::PlanChangeRPath(elf, old, newrpath, plan,
+                                                &emsg);
+    }
+    bool changed = false;
+    if (planned && cmake::ApplyRPathPlan(file, plan, &emsg, &changed)) {
+      ok(old);
+      out.append(changed ? "\t1" : "\t0");
+    } else {
+      error(emsg);
+    }
+    this->Cache.erase(file);
+  } else {
+    error("malformed request");
+  }
+  out.push_back('\n');
+}
+
+void Daemon::Serve(int fd) {
+  LineReader reader(fd);
+  std::string line;
+  std::string out;
+  while (reader.Next(line)) {
+    this->Handle(line, out);
+    // Answer a pipelined burst with one write.
+    if (out.size() >= 16 * 1024 || !reader.Buffered()) {
+      if (!mz::write_full(fd, out.data(), out.size())) {
+        break;
+      }
+      out.clear();
+    }
+  }
+  close(fd);
+}
+
+// Hands accepted connections to the workers. A daemon spends most of its
+// life waiting for clients, so idle workers sleep on a condition variable
+// rather than poll as the pipeline's queues do.
+class ConnectionQueue {
+public:
+  explicit ConnectionQueue(size_t capacity) : Capacity(capacity) {}
+
+  // Blocks while the workers are this many connections behind.
+  void Push(int fd) {
+    std::unique_lock<std::mutex> lock(this->Mutex);
+    this->NotFull.wait(lock,
+                       [this] { return this->Fds.size() < this->Capacity; });
+    this->Fds.push_back(fd);
+    this->NotEmpty.notify_one();
+  }
+
+  // False once the queue is closed and drained.
+  bool Pop(int &fd) {
+    std::unique_lock<std::mutex> lock(this->Mutex);
+    this->NotEmpty.wait(lock,
+                        [this] { return this->Closed || !this->Fds.empty(); });
+    if (this->Fds.empty()) {
+      return false;
+    }
+    fd = this->Fds.front();
+    this->Fds.pop_front();
+    this->NotFull.notify_one();
+    return true;
+  }
+
+  void Close() {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->Closed = true;
+    this->NotEmpty.notify_all();
+  }
+
+private:
+  std::mutex Mutex;
+  std::condition_variable NotEmpty;
+  std::condition_variable NotFull;
+  std::deque<int> Fds;
+  size_t Capacity;
+  bool Closed = false;
+};
+
+char ServingPath[sizeof(sockaddr_un::sun_path)];
+
+void StopServing(int) {
+  unlink(ServingPath);
+  _exit(0);
+}
+
+} // namespace
+
+int ServeDaemon(const char *socketPath, unsigned jobs) {
+  sockaddr_un addr;
+  if (!MakeAddress(socketPath, addr)) {
+    fprintf(stderr, "Invalid socket path %s: %s\n", socketPath,
+            strerror(errno));
+    return 1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    fprintf(stderr, "socket: %s\n", strerror(errno));
+    return 1;
+  }
+  // Replace a stale socket left by a daemon that did not shut down, but
+  // never one that still answers.
+  struct stat st;
+  if (lstat(socketPath, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool alive = connect(probe, reinterpret_cast<sockaddr *>(&addr),
+                         sizeof(addr)) == 0;
+    close(probe);
+    if (alive) {
+      fprintf(stderr, "A daemon is already serving %s\n", socketPath);
+      return 1;
+    }
+    unlink(socketPath);
+  }
+  // Only the owner may connect: the daemon edits files with its rights.
+  mode_t mask = umask(077);
+  bool bound =
+      bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0;
+  umask(mask);
+  if (!bound || listen(fd, SOMAXCONN) != 0) {
+    fprintf(stderr, "Error listening on %s: %s\n", socketPath,
+            strerror(errno));
+    close(fd);
+    return 1;
+  }
+  strcpy(ServingPath, socketPath);
+  signal(SIGINT, StopServing);
+  signal(SIGTERM, StopServing);
+  signal(SIGPIPE, SIG_IGN);
+
+  // The accept loop hands connections to a fixed pool of workers.
+  Daemon daemon;
+  jobs = mz::resolve_jobs(jobs);
+  ConnectionQueue connections(jobs * 4);
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < jobs; i++) {
+    workers.emplace_back([&] {
+      int client;
+      while (connections.Pop(client)) {
+        daemon.Serve(client);
+      }
+    });
+  }
+  for (;;) {
+    int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      fprintf(stderr, "accept: %s\n", strerror(errno));
+      break;
+    }
+    // Refuse other users even if the socket was made reachable, and drop
+    // clients that hold a worker without sending anything.
+    ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0 ||
+        cred.uid != geteuid()) {
+      close(client);
+      continue;
+    }
+    timeval timeout{30, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    connections.Push(client);
+  }
+  connections.Close();
+  for (auto &t : workers) {
+    t.join();
+  }
+  close(fd);
+  unlink(socketPath);
+  return 1;
+}
+
+int ForwardToDaemon(const char *socketPath, const char *newrpath,
+                    bool remove, std::vector<std::string> const &files,
+                    int outfd) {
+  sockaddr_un addr;
+  if (!MakeAddress(socketPath, addr)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  char buf[PATH_MAX];
+  if (getcwd(buf, sizeof(buf)) == nullptr) {
+    close(fd);
+    return -1;
+  }
+  std::string cwd = buf;
+  signal(SIGPIPE, SIG_IGN);
+  // Requests go out in windows so neither side blocks writing while the
+  // other is not reading.
+  constexpr size_t window = 64;
+  LineReader reader(fd);
+  std::string request;
+  std::string response;
+  std::string out;
+  int result = 0;
+  for (size_t first = 0; first < files.size(); first += window) {
+    size_t last = std::min(files.size(), first + window);
+    request.clear();
+    for (size_t i = first; i < last; i++) {
+      request.append(remove ? "REMOVE\t" : newrpath ? "CHANGE\t" : "LOOKUP\t");
+      mz::append_escaped(request, AbsolutePath(files[i], cwd));
+      if (!remove && newrpath) {
+        request.push_back('\t');
+        mz::append_escaped(request, newrpath);
+      }
+      request.push_back('\n');
+    }
+    if (!mz::write_full(fd, request.data(), request.size())) {
+      close(fd);
+      return first == 0 ? -1 : 1;
+    }
+    for (size_t i = first; i < last; i++) {
+      if (!reader.Next(response)) {
+        close(fd);
+        return first == 0 ? -1 : 1;
+      }
+      auto fields = mz::split_fields(response);
+      auto const &file = files[i];
+      if (fields[0] != "OK") {
+        out.append(fields.size() > 1 ? mz::unescape(fields[1]) : response);
+        out.append("\n");
+        result = 1;
+        continue;
+      }
+      auto value = fields.size() > 1 ? mz::unescape(fields[1]) : "";
+      out.append(file).append(": RUNPATH=").append(value).append("\n");
+      if (remove) {
+        out.append(file).append(": RUNPATH removed\n");
+      } else if (newrpath) {
+        out.append(file).append(": new RUNPATH: ").append(newrpath);
+        out.append("\n");
+      }
+    }
+    mz::write_full(outfd, out.data(), out.size());
+    out.clear();
+  }
+  close(fd);
+  return result;
+}
@@ -0,0 +1,31 @@
+///
+#ifndef CMCHRPATH_DAEMON_HPP
+#define CMCHRPATH_DAEMON_HPP
+#include <string>
+#include <vector>
+
+/// `cmchrpath --serve <socket>` answers requests over a Unix stream socket,
+/// one request per line, fields separated by TAB and escaped as in
+/// fields.hpp. Every request gets exactly one response line, OK or ERR
+/// followed by its fields:
+///
+///   PING                          OK  cmchrpath
+///   LOOKUP <file>                 OK  <rpath or runpath>
+///   CHECK  <file> <rpath>         OK  1|0
+///   CHANGE <file> <new> [<old>]   OK  <old> 1|0        (changed)
+///   REMOVE <file>                 OK  <old> 1|0        (removed)
+///   any failure                   ERR <message>
+///
+/// CHANGE without <old> replaces the whole current value, like -r. Parsed
+/// summaries are cached by path and reused while the file's identity
+/// (device, inode, size, mtime, ctime) is unchanged.
+int ServeDaemon(const char *socketPath, unsigned jobs);
+
+/// Forward a plain -l/-r/-d invocation to a running daemon, printing the
+/// same output as a local run. Returns -1 without output if no daemon
+/// answers at socketPath, so the caller can run locally.
+int ForwardToDaemon(const char *socketPath, const char *newrpath,
+                    bool remove, std::vector<std::string> const &files,
+                    int outfd);
+
+#endif
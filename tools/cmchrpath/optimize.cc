@@ -0,0 +1,160 @@
+///
+#include "optimize.hpp"
+#include "cmELF.h"
+#include "cmRPath.h"
+#include "needed.hpp"
+
+DynamicOptimizer::DynamicOptimizer(OptimizeOptions const &opts)
+    : Opts(opts) {
+  // A missing cache is no error: the loader goes without too.
+  this->Cache.open("/etc/ld.so.cache", nullptr);
+}
+
+std::unique_ptr<mz::dependency_resolver> DynamicOptimizer::Take() {
+  {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    if (!this->Idle.empty()) {
+      auto resolver = std::move(this->Idle.back());
+      this->Idle.pop_back();
+      return resolver;
+    }
+  }
+  mz::resolver_options opts;
+  if (this->Cache.is_open()) {
+    opts.cache = [this](std::string_view soname, uint8_t elfclass,
+                        uint16_t machine, std::string &path) {
+      std::string_view found;
+      if (!this->Cache.find(soname, elfclass, machine, found)) {
+        return false;
+      }
+      path.assign(found.data(), found.size());
+      return true;
+    };
+  }
+  return std::unique_ptr<mz::dependency_resolver>(
+      new mz::dependency_resolver(std::move(opts)));
+}
+
+void DynamicOptimizer::Give(std::unique_ptr<mz::dependency_resolver> resolver) {
+  std::lock_guard<std::mutex> lock(this->Mutex);
+  this->Idle.push_back(std::move(resolver));
+}
+
+// The entries of the root's list to keep, in their new order.
+std::vector<unsigned>
+DynamicOptimizer::Select(mz::dependency_resolver &resolver,
+                       std::vector<mz::closure_object> const &objects,
+                       mz::search_source source) const {
+  auto hits = mz::search_path_hits(objects, source);
+  unsigned count = static_cast<unsigned>(hits.size());
+  std::vector<unsigned> order;
+  if (!this->Opts.Reorder) {
+    for (unsigned e = 0; e < count; ++e) {
+      if (hits[e] != 0 || !this->Opts.Shrink) {
+        order.push_back(e);
+      }
+    }
+    return order;
+  }
+
+  // An entry that provides a library must stay ahead of the later ones
+  // holding a file of the same name, or that one would be loaded instead.
+  auto dirs = resolver.elements(objects, 0, source);
+  std::vector<std::vector<unsigned>> after(count);
+  for (auto const &o : objects) {
+    if (o.owner != 0 || o.source != source || o.element >= count) {
+      continue;
+    }
+    for (unsigned e = o.element + 1; e < count && e < dirs.size(); ++e) {
+      if (resolver.provides(dirs[e].dir, o.name)) {
+        after[e].push_back(o.element);
+      }
+    }
+  }
+
+  // Minimizing the failed probes, each lookup paying for the entries ahead
+  // of the one that provides it, is a weighted ordering under precedence
+  // constraints. Taking the entry with the most hits among those whose
+  // predecessors are placed is exact without constraints, and the
+  // constraints are rare: the original order always satisfies them.
+  std::vector<bool> placed(count, false);
+  for (unsigned n = 0; n < count; ++n) {
+    unsigned best = count;
+    for (unsigned e = 0; e < count; ++e) {
+      if (placed[e] || (this->Opts.Shrink && hits[e] == 0)) {
+        continue;
+      }
+      bool ready = true;
+      for (unsigned before : after[e]) {
+        ready = ready && placed[before];
+      }
+      if (ready && (best == count || hits[e] > hits[best])) {
+        best = e;
+      }
+    }
+    if (best == count) {
+      break;
+    }
+    placed[best] = true;
+    order.push_back(best);
+  }
+  return order;
+}
+
+bool DynamicOptimizer::Plan(cmELF &elf, std::string const &path,
+                            cmake::RPathPlan &plan,
+                            std::vector<std::string> &unused,
+                            std::string *emsg) {
+  plan = cmake::RPathPlan();
+  unused.clear();
+  bool needed = this->Opts.Unused || this->Opts.Prune;
+  if (!needed && elf.GetRPath() == nullptr && elf.GetRunPath() == nullptr) {
+    return static_cast<bool>(elf);
+  }
+  std::vector<mz::closure_object> objects;
+  std::vector<unsigned> select[2];
+  auto resolver = this->Take();
+  bool ok = resolver->resolve(path, objects, emsg);
+  if (ok && !needed) {
+    select[0] = this->Select(*resolver, objects, mz::source_rpath);
+    select[1] = this->Select(*resolver, objects, mz::source_runpath);
+  }
+  this->Give(std::move(resolver));
+  if (!ok) {
+    plan.Error = cmake::RPathPlan::ErrorMalformed;
+    return false;
+  }
+  if (needed) {
+    std::vector<mz::needed_use> uses;
+    if (!mz::analyze_needed(objects, uses, emsg)) {
+      plan.Error = cmake::RPathPlan::ErrorMalformed;
+      return false;
+    }
+    for (auto const &u : uses) {
+      if (!u.used()) {
+        unused.push_back(u.name);
+      }
+    }
+    return !this->Opts.Prune || unused.empty() ||
+           cmake::PlanRemoveNeeded(elf, unused, plan, emsg);
+  }
+  if (this->Opts.Shrink) {
+    for (auto const &o : objects) {
+      if (o.path.empty()) {
+        if (emsg) {
+          *emsg = path + ": not shrinking, " + o.name + " is not found.";
+        }
+        plan.Error = cmake::RPathPlan::ErrorNoEntry;
+        return false;
+      }
+    }
+  }
+  // One string serving as both is the RUNPATH: the loader ignores the
+  // RPATH of a file that has one.
+  auto const *rpath = elf.GetRPath();
+  auto const *runpath = elf.GetRunPath();
+  if (rpath && runpath && rpath->Position == runpath->Position) {
+    select[0] = select[1];
+  }
+  return cmake::PlanSelectRPath(elf, select, plan, emsg);
+}
@@ -0,0 +1,67 @@
+///
+#ifndef CMCHRPATH_OPTIMIZE_HPP
+#define CMCHRPATH_OPTIMIZE_HPP
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ldcache.hpp"
+#include "resolver.hpp"
+
+class cmELF;
+
+namespace cmake {
+struct RPathPlan;
+}
+
+/// What DynamicOptimizer does to each file.
+struct OptimizeOptions {
+  // --shrink-rpath: keep only the RPATH/RUNPATH entries that provide an
+  // object of the closure, so the loader stops probing leftover build
+  // directories. A file with a dependency that is not found anywhere is
+  // left alone: the missing library may be meant to come from one of the
+  // entries.
+  bool Shrink = false;
+  // --reorder-rpath: put the entries that provide the most objects first,
+  // so fewer lookups probe directories that do not have the library. An
+  // entry stays ahead of every later one that also holds a library it
+  // provides.
+  bool Reorder = false;
+  // --unused-needed: find the DT_NEEDED entries the file makes no use of
+  // (see mz::analyze_needed); --prune-needed also removes them.
+  bool Unused = false;
+  bool Prune = false;
+};
+
+/// DynamicOptimizer resolves the dependency closure of a file as the loader
+/// would, with the host's library cache and no LD_LIBRARY_PATH, and plans
+/// in-place edits of its dynamic table from it. Every library resolves to
+/// the same file afterwards.
+class DynamicOptimizer {
+public:
+  explicit DynamicOptimizer(OptimizeOptions const &opts);
+  DynamicOptimizer(const DynamicOptimizer &) = delete;
+  DynamicOptimizer &operator=(const DynamicOptimizer &) = delete;
+
+  /** Plan the edit of the file at path, parsed as elf, and list its unused
+      DT_NEEDED entries in unused if asked to.  Safe to call from several
+      threads.  */
+  bool Plan(cmELF &elf, std::string const &path, cmake::RPathPlan &plan,
+            std::vector<std::string> &unused, std::string *emsg);
+
+private:
+  std::unique_ptr<mz::dependency_resolver> Take();
+  void Give(std::unique_ptr<mz::dependency_resolver> resolver);
+  std::vector<unsigned> Select(mz::dependency_resolver &resolver,
+                               std::vector<mz::closure_object> const &objects,
+                               mz::search_source source) const;
+
+  OptimizeOptions Opts;
+  mz::ld_so_cache Cache;
+  std::mutex Mutex;
+  // A resolver answers one file at a time; idle ones keep their memoized
+  // lookups and directory listings for the next file.
+  std::vector<std::unique_ptr<mz::dependency_resolver>> Idle;
+};
+
+#endif
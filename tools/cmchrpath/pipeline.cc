@@ -0,0 +1,542 @@
+///
+#include "pipeline.hpp"
+#include "cmELF.h"
+#include "cmRPath.h"
+#include "queue.hpp"
+#include "optimize.hpp"
+#include "sink.hpp"
+#include "workers.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+const char *const StageNames[StageCount] = {"sniff", "parse", "plan",
+                                            "write", "report"};
+
+// One file travelling through the pipeline.
+struct PipelineItem {
+  size_t Seq = 0;
+  std::string Path;
+  // Per-file replacement from a manifest line, overrides -r.
+  std::string NewRPath;
+  bool HasNewRPath = false;
+  // Found by the tree walker; non-ELF files are skipped silently.
+  bool Walked = false;
+  // Skipped by sniff: not ELF, or journaled as done.
+  bool Skip = false;
+  bool Resumed = false;
+  // Answered from a summary cache; parse, plan and write have nothing to do.
+  bool Cached = false;
+  // Identity taken by sniff for the summary caches.
+  mz::file_identity Id;
+  bool HasId = false;
+  // Parsed by parse when HasId, and kept current by write.
+  mz::elf_summary Summary;
+  // Owned from parse until plan, which releases the file.
+  std::unique_ptr<cmELF> Elf;
+  std::string Current;
+  cmake::RPathPlan Plan;
+  // DT_NEEDED entries found unused by --unused-needed or --prune-needed.
+  std::vector<std::string> Unused;
+  cmELF::ReadRangeList Ranges;
+  bool Changed = false;
+  int Result = 0;
+  std::string Out;
+
+  const char *Replacement(const char *fallback) const {
+    return this->HasNewRPath ? this->NewRPath.c_str() : fallback;
+  }
+  // Whether the summary alone answers the item: a listing, a removal with
+  // nothing to remove, or a replacement every entry already holds.
+  bool AnsweredBy(PipelineOptions const &opts,
+                  mz::elf_summary const &s) const {
+    const char *newrpath = this->Replacement(opts.NewRPath);
+    OptimizeOptions const &o = opts.Optimize;
+    bool needed = o.Unused || o.Prune;
+    bool optimize = o.Shrink || o.Reorder || needed;
+    if (!opts.Remove && !optimize && newrpath == nullptr) {
+      return true;
+    }
+    if (!s.valid) {
+      return false;
+    }
+    if (needed) {
+      return s.needed.empty();
+    }
+    if (opts.Remove || optimize) {
+      return !s.rpath.present && !s.runpath.present;
+    }
+    bool any = false;
+    for (auto const *se : {&s.rpath, &s.runpath}) {
+      if (se->present) {
+        if (se->value != newrpath) {
+          return false;
+        }
+        any = true;
+      }
+    }
+    return any;
+  }
+};
+
+using ItemQueue = mz::bounded_queue<PipelineItem *>;
+
+class Pipeline {
+public:
+  explicit Pipeline(PipelineOptions const &opts) : Opts(opts) {
+    for (int i = 0; i < StageCount; i++) {
+      this->Queues[i].reset(new ItemQueue(opts.QueueDepth));
+    }
+    OptimizeOptions const &o = opts.Optimize;
+    if (o.Shrink || o.Reorder || o.Unused || o.Prune) {
+      this->Optimizer.reset(new DynamicOptimizer(o));
+    }
+  }
+  int Run();
+
+private:
+  void Enumerate();
+  bool EnumerateManifest();
+  void Emit(std::string path, std::string_view relative, bool walked,
+            std::string_view newrpath, bool hasnew);
+  bool FindSummary(mz::file_identity const &id, mz::elf_summary &s);
+  void StoreSummary(mz::file_identity const &id, mz::elf_summary const &s);
+  void Sniff(PipelineItem &item);
+  void Parse(PipelineItem &item);
+  void PlanEdit(PipelineItem &item);
+  void Write(PipelineItem &item);
+  void Report(PipelineItem &item);
+  void PrintStats(double seconds) const;
+
+  PipelineOptions const &Opts;
+  // Queues[s] feeds stage s.
+  std::unique_ptr<ItemQueue> Queues[StageCount];
+  std::unique_ptr<DynamicOptimizer> Optimizer;
+  mz::ordered_sink *Sink = nullptr;
+  size_t Next = 0;
+  std::atomic_int Result{0};
+  std::atomic_size_t Skipped{0};
+  std::atomic_size_t Items[StageCount] = {};
+};
+
+void Pipeline::Emit(std::string path, std::string_view relative, bool walked,
+                    std::string_view newrpath, bool hasnew) {
+  if (!this->Opts.Shard.selects(relative)) {
+    return;
+  }
+  auto item = new PipelineItem;
+  item->Seq = this->Next++;
+  item->Path = std::move(path);
+  item->Walked = walked;
+  item->HasNewRPath = hasnew;
+  item->NewRPath.assign(newrpath);
+  // Items past the sink's window would wait in the report stage for a
+  // stalled one; hold them back here instead, where the wait blocks no
+  // worker.
+  this->Sink->admit(item->Seq);
+  this->Queues[StageSniff]->push(item);
+}
+
+// Read a manifest: one file per line, optionally followed by a TAB and the
+// new rpath for that file. Empty lines and lines starting with '#' are
+// ignored. The file is read in chunks so its size does not matter.
+bool Pipeline::EnumerateManifest() {
+  const char *manifest = this->Opts.Manifest;
+  bool stdin_ = strcmp(manifest, "-") == 0;
+  int fd = stdin_ ? STDIN_FILENO : open(manifest, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    fprintf(stderr, "Error reading manifest %s: %s\n", manifest,
+            strerror(errno));
+    return false;
+  }
+  std::string carry;
+  char buf[64 * 1024];
+  auto line = [&](std::string_view sv) {
+    if (!sv.empty() && sv.back() == '\r') {
+      sv.remove_suffix(1);
+    }
+    if (sv.empty() || sv[0] == '#') {
+      return;
+    }
+    std::string_view newrpath;
+    auto tab = sv.find('\t');
+    if (tab != std::string_view::npos) {
+      newrpath = sv.substr(tab + 1);
+      sv = sv.substr(0, tab);
+    }
+    this->Emit(std::string(sv), sv, false, newrpath,
+               tab != std::string_view::npos);
+  };
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) != 0) {
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    carry.append(buf, static_cast<size_t>(n));
+    std::string_view sv(carry);
+    size_t pos;
+    while ((pos = sv.find('\n')) != std::string_view::npos) {
+      line(sv.substr(0, pos));
+      sv.remove_prefix(pos + 1);
+    }
+    carry.erase(0, carry.size() - sv.size());
+  }
+  line(carry);
+  if (!stdin_) {
+    close(fd);
+  }
+  return n == 0;
+}
+
+// Expand the inputs: directories are walked recursively, files are taken
+// as given.
+void Pipeline::Enumerate() {
+  if (this->Opts.Manifest != nullptr && !this->EnumerateManifest()) {
+    this->Result |= 1;
+  }
+  for (auto const &input : this->Opts.Inputs) {
+    if (!mz::is_directory(input.c_str())) {
+      this->Emit(input, input, false, {}, false);
+      continue;
+    }
+    mz::walk_tree(input, [&](const std::string &path,
+                             std::string_view relative) {
+      this->Emit(path, relative, true, {}, false);
+    });
+  }
+}
+
+bool Pipeline::FindSummary(mz::file_identity const &id, mz::elf_summary &s) {
+  if (this->Opts.Cache != nullptr && this->Opts.Cache->find(id, s)) {
+    return true;
+  }
+  return this->Opts.Shared != nullptr && this->Opts.Shared->find(id, s);
+}
+
+void Pipeline::StoreSummary(mz::file_identity const &id,
+                            mz::elf_summary const &s) {
+  if (this->Opts.Cache != nullptr) {
+    this->Opts.Cache->store(id, s);
+  }
+  if (this->Opts.Shared != nullptr) {
+    this->Opts.Shared->store(id, s);
+  }
+}
+
+void Pipeline::Sniff(PipelineItem &item) {
+  // Files that completed successfully and have not been touched since need
+  // neither a parse nor an entry in the output.
+  if (this->Opts.Done != nullptr) {
+    auto it = this->Opts.Done->find(item.Path);
+    mz::file_identity id;
+    if (it != this->Opts.Done->end() && it->second.result == 0 &&
+        mz::stat_identity(item.Path.c_str(), id) && it->second.matches(id)) {
+      item.Skip = true;
+      item.Resumed = true;
+      return;
+    }
+  }
+  // The caches have the summary if the file is unchanged since it was last
+  // parsed, here or by another process.
+  if ((this->Opts.Cache != nullptr || this->Opts.Shared != nullptr) &&
+      mz::stat_identity(item.Path.c_str(), item.Id)) {
+    item.HasId = true;
+    mz::elf_summary summary;
+    if (this->FindSummary(item.Id, summary)) {
+      if (item.Walked && !summary.valid) {
+        item.Skip = true;
+        return;
+      }
+      if (item.AnsweredBy(this->Opts, summary)) {
+        item.Cached = true;
+        item.Current = summary.search_path();
+        return;
+      }
+    }
+  }
+  // Walked files must be ELF; the prefetch is worth it either way since
+  // parse is about to read the section headers.
+  if (!mz::sniff_elf(item.Path.c_str(), true) && item.Walked) {
+    item.Skip = true;
+    // Remember non-ELF files too, or every warm walk would read them again.
+    if (item.HasId) {
+      this->StoreSummary(item.Id, mz::elf_summary());
+    }
+  }
+}
+
+void Pipeline::Parse(PipelineItem &item) {
+  if (item.Cached) {
+    return;
+  }
+  item.Elf.reset(new cmELF(item.Path.c_str()));
+  if (item.HasId) {
+    cmake::SummarizeELF(*item.Elf, item.Summary);
+    this->StoreSummary(item.Id, item.Summary);
+    item.Current = item.Summary.search_path();
+    return;
+  }
+  cmELF::StringEntry const *se = item.Elf->GetRPath();
+  if (se == nullptr) {
+    se = item.Elf->GetRunPath();
+  }
+  if (se != nullptr) {
+    item.Current = se->Value;
+  }
+}
+
+void Pipeline::PlanEdit(PipelineItem &item) {
+  if (item.Cached) {
+    return;
+  }
+  const char *newrpath = item.Replacement(this->Opts.NewRPath);
+  if (this->Opts.Remove) {
+    if (!cmake::PlanRemoveRPath(*item.Elf, item.Plan, &item.Out)) {
+      item.Result = 1;
+    }
+  } else if (this->Optimizer) {
+    if (!this->Optimizer->Plan(*item.Elf, item.Path, item.Plan, item.Unused,
+                               &item.Out)) {
+      item.Result = 1;
+    }
+  } else if (newrpath != nullptr &&
+             !cmake::PlanChangeRPath(*item.Elf, item.Current, newrpath,
+                                     item.Plan, &item.Out)) {
+    item.Result = 1;
+  }
+  item.Ranges = item.Elf->GetReadRanges();
+  item.Elf.reset();
+}
+
+void Pipeline::Write(PipelineItem &item) {
+  if (item.Result != 0) {
+    return;
+  }
+  if (!cmake::ApplyRPathPlan(item.Path, item.Plan, &item.Out, &item.Changed)) {
+    item.Result = 1;
+    return;
+  }
+  if (!item.HasId || item.Plan.Empty()) {
+    return;
+  }
+  // Record what the file holds now so the next run over it, which is often
+  // the same edit again, is answered from the caches.
+  mz::elf_summary &s = item.Summary;
+  if (item.Plan.Remove && item.Plan.Count != 0) {
+    s.rpath = mz::elf_string();
+    s.runpath = mz::elf_string();
+  } else if (item.Plan.Remove) {
+    for (auto const &name : item.Unused) {
+      s.needed.erase(std::remove(s.needed.begin(), s.needed.end(), name),
+                     s.needed.end());
+    }
+  }
+  for (int i = 0; i < item.Plan.Count && !item.Plan.Remove; i++) {
+    for (auto *se : {&s.rpath, &s.runpath}) {
+      if (se->present && se->position == item.Plan.Entries[i].Position) {
+        se->value = item.Plan.Entries[i].Value;
+      }
+    }
+  }
+  if (mz::stat_identity(item.Path.c_str(), item.Id)) {
+    this->StoreSummary(item.Id, s);
+  }
+}
+
+void Pipeline::Report(PipelineItem &item) {
+  std::string &out = item.Out;
+  if (item.Skip) {
+    out.clear();
+  } else if (item.Result != 0) {
+    out.append("\n");
+  } else if (this->Opts.Optimize.Unused || this->Opts.Optimize.Prune) {
+    for (auto const &name : item.Unused) {
+      out.append(item.Path).append(": unused NEEDED ").append(name);
+      out.append(item.Plan.Remove ? " removed\n" : "\n");
+    }
+  } else {
+    const char *newrpath = item.Replacement(this->Opts.NewRPath);
+    out.append(item.Path).append(": RUNPATH=").append(item.Current);
+    out.append("\n");
+    if (this->Opts.Remove) {
+      out.append(item.Path).append(": RUNPATH removed\n");
+    } else if (this->Optimizer) {
+      out.append(item.Path);
+      if (item.Plan.Remove) {
+        out.append(": RUNPATH removed\n");
+      } else if (item.Plan.Count != 0) {
+        out.append(": new RUNPATH: ").append(item.Plan.Entries[0].Value);
+        out.append("\n");
+      } else {
+        out.append(": RUNPATH unchanged\n");
+      }
+    } else if (newrpath != nullptr) {
+      out.append(item.Path).append(": new RUNPATH: ").append(newrpath);
+      out.append("\n");
+    }
+  }
+  this->Result |= item.Result;
+  if (item.Resumed) {
+    this->Skipped++;
+  }
+  if (item.Skip) {
+    return;
+  }
+  if (this->Opts.DropCache) {
+    mz::drop_cached_ranges(item.Path.c_str(), item.Ranges);
+  }
+  if (this->Opts.Throttle != nullptr && this->Opts.Throttle->enabled()) {
+    uint64_t bytes = 0;
+    for (auto const &range : item.Ranges) {
+      bytes += range.second;
+    }
+    this->Opts.Throttle->charge(bytes, item.Ranges.size() + item.Plan.Count +
+                                           (item.Plan.Remove ? 1 : 0));
+  }
+  if (this->Opts.Journal != nullptr) {
+    // Record the identity after the rewrite so a resumed run sees the file
+    // as unchanged.
+    mz::journal_record r;
+    r.path = item.Path;
+    r.result = item.Result;
+    mz::stat_identity(item.Path.c_str(), r.id);
+    this->Opts.Journal->append(r);
+  }
+}
+
+int Pipeline::Run() {
+  auto begin = std::chrono::steady_clock::now();
+  mz::ordered_sink sink(this->Opts.OutFd);
+  this->Sink = &sink;
+  std::vector<std::thread> threads;
+  std::atomic_uint active[StageCount] = {};
+  // Start `jobs` threads for a stage before report. Each takes items from
+  // the stage's queue, runs them through fn and hands them on; the last
+  // thread of a stage to finish closes the next queue.
+  auto start = [&](int stage, auto fn) {
+    unsigned jobs = mz::resolve_jobs(this->Opts.Jobs[stage]);
+    active[stage] = jobs;
+    for (unsigned i = 0; i < jobs; i++) {
+      threads.emplace_back([&, stage, fn] {
+        PipelineItem *item;
+        while (this->Queues[stage]->pop(item)) {
+          if (!item->Skip) {
+            fn(*item);
+          }
+          this->Items[stage]++;
+          this->Queues[stage + 1]->push(item);
+        }
+        if (--active[stage] == 0) {
+          this->Queues[stage + 1]->close();
+        }
+      });
+    }
+  };
+  start(StageSniff, [this](PipelineItem &item) { this->Sniff(item); });
+  start(StageParse, [this](PipelineItem &item) { this->Parse(item); });
+  start(StagePlan, [this](PipelineItem &item) { this->PlanEdit(item); });
+  start(StageWrite, [this](PipelineItem &item) { this->Write(item); });
+  // Report runs for skipped items too, to keep the output sequence intact.
+  unsigned reporters = mz::resolve_jobs(this->Opts.Jobs[StageReport]);
+  for (unsigned i = 0; i < reporters; i++) {
+    threads.emplace_back([&] {
+      PipelineItem *item;
+      while (this->Queues[StageReport]->pop(item)) {
+        this->Report(*item);
+        this->Items[StageReport]++;
+        sink.commit(item->Seq, item->Out);
+        delete item;
+      }
+    });
+  }
+  this->Enumerate();
+  this->Queues[StageSniff]->close();
+  for (auto &t : threads) {
+    t.join();
+  }
+  sink.flush();
+  if (this->Skipped != 0) {
+    fprintf(stderr, "resume: skipped %zu journaled files\n",
+            this->Skipped.load());
+  }
+  if (this->Opts.Stats) {
+    this->PrintStats(std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - begin)
+                         .count());
+  }
+  return this->Result;
+}
+
+// For every stage: how deep its input queue ran and how long the stage
+// before it was blocked on it (backpressure, the stage is the bottleneck)
+// versus how long the stage itself waited for input (starved).
+void Pipeline::PrintStats(double seconds) const {
+  fprintf(stderr, "%-8s %5s %10s %9s %9s %9s %12s %12s\n", "stage", "jobs",
+          "items", "capacity", "avg-depth", "max-depth", "blocked(ms)",
+          "starved(ms)");
+  for (int i = 0; i < StageCount; i++) {
+    auto s = this->Queues[i]->stats();
+    fprintf(stderr, "%-8s %5u %10zu %9zu %9.1f %9zu %12.1f %12.1f\n",
+            StageNames[i], mz::resolve_jobs(this->Opts.Jobs[i]),
+            this->Items[i].load(), s.capacity,
+            s.pushes == 0 ? 0.0
+                          : static_cast<double>(s.depth_sum) /
+                                static_cast<double>(s.pushes),
+            s.max_depth, static_cast<double>(s.full_wait_ns) / 1e6,
+            static_cast<double>(s.empty_wait_ns) / 1e6);
+  }
+  if (this->Opts.Cache != nullptr) {
+    fprintf(stderr, "cache: %zu hits, %zu misses\n", this->Opts.Cache->hits(),
+            this->Opts.Cache->misses());
+  }
+  if (this->Opts.Shared != nullptr) {
+    fprintf(stderr, "shared cache: %zu hits, %zu misses\n",
+            this->Opts.Shared->hits(), this->Opts.Shared->misses());
+  }
+  fprintf(stderr, "elapsed: %.3fs\n", seconds);
+}
+
+} // namespace
+
+bool ParseStageJobs(std::string_view sv, PipelineOptions &opts) {
+  while (!sv.empty()) {
+    auto comma = sv.find(',');
+    auto part = sv.substr(0, comma);
+    sv.remove_prefix(comma == std::string_view::npos ? sv.size()
+                                                     : comma + 1);
+    auto eq = part.find('=');
+    if (eq == std::string_view::npos || eq + 1 == part.size()) {
+      return false;
+    }
+    auto name = part.substr(0, eq);
+    unsigned jobs = 0;
+    if (!mz::parse_count(part.substr(eq + 1), jobs)) {
+      return false;
+    }
+    int stage = 0;
+    while (stage < StageCount && name != StageNames[stage]) {
+      stage++;
+    }
+    if (stage == StageCount) {
+      return false;
+    }
+    opts.Jobs[stage] = jobs;
+  }
+  return true;
+}
+
+int RunPipeline(PipelineOptions const &opts) {
+  Pipeline pipeline(opts);
+  return pipeline.Run();
+}
@@ -0,0 +1,70 @@
+///
+#ifndef CMCHRPATH_PIPELINE_HPP
+#define CMCHRPATH_PIPELINE_HPP
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "diskcache.hpp"
+#include "journal.hpp"
+#include "optimize.hpp"
+#include "shmcache.hpp"
+#include "throttle.hpp"
+#include "walker.hpp"
+
+/// The stages of a batch run, in order. Each stage runs on its own threads
+/// and is fed by a bounded queue, so at most (stages x queue depth) files are
+/// in flight whatever the size of the run.
+///
+///   enumerate  expand arguments, walk directories, read the manifest
+///   sniff      resume check, summary cache, ELF magic, prefetch of the
+///              section headers
+///   parse      cmELF: read the current RPATH/RUNPATH
+///   plan       compute the in-place edit
+///   write      apply the edit
+///   report     ordered output, journal, page-cache and throttle accounting
+enum PipelineStage : int {
+  StageSniff,
+  StageParse,
+  StagePlan,
+  StageWrite,
+  StageReport,
+  StageCount
+};
+
+struct PipelineOptions {
+  // Replacement for every file; nullptr lists the current value.
+  const char *NewRPath = nullptr;
+  // Remove the RPATH and RUNPATH instead (-d).
+  bool Remove = false;
+  // --shrink-rpath, --reorder-rpath, --unused-needed and --prune-needed.
+  OptimizeOptions Optimize;
+  // Manifest of files, "-" for stdin; read incrementally.
+  const char *Manifest = nullptr;
+  // Files and directories from the command line.
+  std::vector<std::string> Inputs;
+  mz::shard_spec Shard;
+  // Threads per stage, indexed by PipelineStage.
+  unsigned Jobs[StageCount] = {1, 1, 1, 1, 1};
+  // Capacity of each inter-stage queue.
+  size_t QueueDepth = 256;
+  int OutFd = 2;
+  mz::journal *Journal = nullptr;
+  // Journal records of a previous run for --resume.
+  const mz::journal_map *Done = nullptr;
+  mz::io_throttle *Throttle = nullptr;
+  bool DropCache = false;
+  // Print per-stage queue statistics to stderr at the end.
+  bool Stats = false;
+  // Summaries of unchanged files; the disk cache is committed by the caller.
+  mz::disk_cache *Cache = nullptr;
+  mz::shm_cache *Shared = nullptr;
+};
+
+/// Parse "sniff=2,parse=8,write=2" into opts.Jobs.
+bool ParseStageJobs(std::string_view sv, PipelineOptions &opts);
+
+/// Run a batch and return its exit status.
+int RunPipeline(PipelineOptions const &opts);
+
+#endif
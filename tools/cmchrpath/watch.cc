@@ -0,0 +1,356 @@
+///
+#include "watch.hpp"
+#include "cmELF.h"
+#include "cmRPath.h"
+#include "identity.hpp"
+#include "sink.hpp"
+#include "walker.hpp"
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+bool LoadWatchRules(const char *file, std::vector<WatchRule> &rules,
+                    std::string *emsg) {
+  std::string text;
+  if (!mz::read_file(file, text)) {
+    if (emsg) {
+      *emsg = std::string("Error reading rules ") + file + ": " +
+              strerror(errno);
+    }
+    return false;
+  }
+  std::string_view sv(text);
+  size_t lineno = 0;
+  while (!sv.empty()) {
+    auto pos = sv.find('\n');
+    auto line = sv.substr(0, pos);
+    sv.remove_prefix(pos == std::string_view::npos ? sv.size() : pos + 1);
+    lineno++;
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    auto tab = line.find('\t');
+    if (tab == std::string_view::npos || tab == 0) {
+      if (emsg) {
+        *emsg = std::string(file) + ":" + std::to_string(lineno) +
+                ": expected <glob> TAB <rpath>";
+      }
+      return false;
+    }
+    WatchRule rule;
+    rule.Pattern.assign(line.substr(0, tab));
+    rule.NewRPath.assign(line.substr(tab + 1));
+    rule.Remove = rule.NewRPath == "-";
+    rules.push_back(std::move(rule));
+  }
+  return true;
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t DirectoryEvents = IN_CLOSE_WRITE | IN_MOVED_TO |
+                                     IN_CREATE | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+volatile sig_atomic_t Stopping = 0;
+
+void StopWatching(int) { Stopping = 1; }
+
+class Watcher {
+public:
+  Watcher(std::string root, WatchOptions const &opts)
+      : Root(std::move(root)), Opts(opts) {}
+  ~Watcher() {
+    if (this->Fd != -1) {
+      close(this->Fd);
+    }
+  }
+  int Run();
+
+private:
+  bool AddTree(std::string const &dir, bool queueFiles);
+  void Queue(std::string path);
+  void Handle(inotify_event const &ev);
+  void Drain(bool all);
+  void Fix(std::string const &path);
+  WatchRule const *Match(std::string const &path) const;
+
+  std::string Root;
+  WatchOptions const &Opts;
+  int Fd = -1;
+  std::unordered_map<int, std::string> Dirs;
+  // Debouncing: the latest deadline of every pending file, and the events
+  // in arrival order. The debounce interval is fixed, so deadlines in
+  // Order are sorted; an entry whose deadline was moved by a later event
+  // is stale and dropped when it comes up.
+  std::unordered_map<std::string, Clock::time_point> Deadlines;
+  std::deque<std::pair<std::string, Clock::time_point>> Order;
+  int Result = 0;
+};
+
+// Watch dir and the directories below it. Files already in a directory
+// that appeared after the watch started were possibly written before we
+// could see them, so they are queued too.
+bool Watcher::AddTree(std::string const &dir, bool queueFiles) {
+  std::vector<std::string> stack{dir};
+  bool ok = true;
+  while (!stack.empty()) {
+    std::string current = std::move(stack.back());
+    stack.pop_back();
+    int wd = inotify_add_watch(this->Fd, current.c_str(), DirectoryEvents);
+    if (wd == -1) {
+      fprintf(stderr, "watch %s: %s\n", current.c_str(), strerror(errno));
+      ok = false;
+      continue;
+    }
+    this->Dirs[wd] = current;
+    DIR *d = opendir(current.c_str());
+    if (d == nullptr) {
+      continue;
+    }
+    while (dirent *e = readdir(d)) {
+      if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) {
+        continue;
+      }
+      std::string path = current + "/" + e->d_name;
+      unsigned char type = e->d_type;
+      if (type == DT_UNKNOWN) {
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0) {
+          continue;
+        }
+        type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : 0;
+      }
+      if (type == DT_DIR) {
+        stack.push_back(std::move(path));
+      } else if (type == DT_REG && queueFiles) {
+        this->Queue(std::move(path));
+      }
+    }
+    closedir(d);
+  }
+  return ok;
+}
+
+void Watcher::Queue(std::string path) {
+  auto deadline =
+      Clock::now() + std::chrono::milliseconds(this->Opts.DebounceMs);
+  this->Deadlines[path] = deadline;
+  this->Order.emplace_back(std::move(path), deadline);
+}
+
+void Watcher::Handle(inotify_event const &ev) {
+  if ((ev.mask & IN_Q_OVERFLOW) != 0) {
+    // Events were lost; look at everything again. Unchanged files cost a
+    // parse but no write.
+    fprintf(stderr, "watch: event queue overflowed, rescanning %s\n",
+            this->Root.c_str());
+    this->AddTree(this->Root, true);
+    return;
+  }
+  if ((ev.mask & IN_IGNORED) != 0) {
+    this->Dirs.erase(ev.wd);
+    return;
+  }
+  auto it = this->Dirs.find(ev.wd);
+  if (it == this->Dirs.end() || ev.len == 0) {
+    return;
+  }
+  std::string path = it->second + "/" + ev.name;
+  if ((ev.mask & IN_ISDIR) != 0) {
+    if ((ev.mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+      this->AddTree(path, true);
+    }
+    return;
+  }
+  if ((ev.mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0) {
+    this->Queue(std::move(path));
+  }
+}
+
+void Watcher::Drain(bool all) {
+  auto now = Clock::now();
+  while (!this->Order.empty() &&
+         (all || this->Order.front().second <= now)) {
+    auto entry = std::move(this->Order.front());
+    this->Order.pop_front();
+    auto it = this->Deadlines.find(entry.first);
+    if (it == this->Deadlines.end() || it->second != entry.second) {
+      continue;
+    }
+    this->Deadlines.erase(it);
+    this->Fix(entry.first);
+  }
+}
+
+bool Satisfied(WatchRule const &rule, mz::elf_summary const &s) {
+  if (!s.valid) {
+    return false;
+  }
+  bool any = false;
+  for (auto const *se : {&s.rpath, &s.runpath}) {
+    if (se->present) {
+      if (rule.Remove || se->value != rule.NewRPath) {
+        return false;
+      }
+      any = true;
+    }
+  }
+  return any || rule.Remove;
+}
+
+WatchRule const *Watcher::Match(std::string const &path) const {
+  std::string_view relative(path);
+  relative.remove_prefix(std::min(relative.size(), this->Root.size() + 1));
+  std::string rel(mz::normalize_relative(relative));
+  for (auto const &rule : this->Opts.Rules) {
+    if (fnmatch(rule.Pattern.c_str(), rel.c_str(), 0) == 0) {
+      return &rule;
+    }
+  }
+  return nullptr;
+}
+
+void Watcher::Fix(std::string const &path) {
+  WatchRule const *rule = this->Match(path);
+  struct stat st;
+  if (rule == nullptr || lstat(path.c_str(), &st) != 0 ||
+      !S_ISREG(st.st_mode) || !mz::is_elf_file(path.c_str())) {
+    return;
+  }
+  // Our own write closes the file too; a file that already holds what the
+  // rule wants is done, and one seen by another process needs no parse.
+  mz::file_identity id;
+  bool hasId = mz::stat_identity(path.c_str(), id);
+  mz::elf_summary s;
+  if (this->Opts.Shared != nullptr && hasId &&
+      this->Opts.Shared->find(id, s) && Satisfied(*rule, s)) {
+    return;
+  }
+  std::string out;
+  auto fail = [&] {
+    out.insert(0, path + ": ");
+    out.append("\n");
+    mz::write_full(this->Opts.OutFd, out.data(), out.size());
+    this->Result = 1;
+  };
+  cmake::RPathPlan plan;
+  {
+    cmELF elf(path.c_str());
+    cmake::SummarizeELF(elf, s);
+    if (Satisfied(*rule, s)) {
+      if (hasId && this->Opts.Shared != nullptr) {
+        this->Opts.Shared->store(id, s);
+      }
+      return;
+    }
+    bool planned =
+        rule->Remove
+            ? cmake::PlanRemoveRPath(elf, plan, &out)
+            : cmake::PlanChangeRPath(elf, s.search_path(), rule->NewRPath,
+                                     plan, &out);
+    if (!planned) {
+      fail();
+      return;
+    }
+  }
+  if (!cmake::ApplyRPathPlan(path, plan, &out, nullptr)) {
+    fail();
+    return;
+  }
+  out.append(path).append(": RUNPATH=").append(s.search_path()).append("\n");
+  if (rule->Remove) {
+    out.append(path).append(": RUNPATH removed\n");
+  } else {
+    out.append(path).append(": new RUNPATH: ").append(rule->NewRPath);
+    out.append("\n");
+  }
+  mz::write_full(this->Opts.OutFd, out.data(), out.size());
+}
+
+int Watcher::Run() {
+  this->Fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (this->Fd == -1) {
+    fprintf(stderr, "inotify_init1: %s\n", strerror(errno));
+    return 1;
+  }
+  if (!this->AddTree(this->Root, false) && this->Dirs.empty()) {
+    return 1;
+  }
+  // SIGINT and SIGTERM are delivered only while waiting in ppoll, so a
+  // stop request can never slip in between the check and the wait.
+  sigset_t blocked, original;
+  sigemptyset(&blocked);
+  sigaddset(&blocked, SIGINT);
+  sigaddset(&blocked, SIGTERM);
+  sigprocmask(SIG_BLOCK, &blocked, &original);
+  sigset_t waiting = original;
+  sigdelset(&waiting, SIGINT);
+  sigdelset(&waiting, SIGTERM);
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = StopWatching;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+
+  alignas(inotify_event) char buf[64 * 1024];
+  while (!Stopping && !this->Dirs.empty()) {
+    timespec timeout;
+    timespec *ptimeout = nullptr;
+    if (!this->Order.empty()) {
+      auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          this->Order.front().second - Clock::now());
+      auto ns = std::max<int64_t>(wait.count(), 0);
+      timeout.tv_sec = static_cast<time_t>(ns / 1000000000);
+      timeout.tv_nsec = static_cast<long>(ns % 1000000000);
+      ptimeout = &timeout;
+    }
+    pollfd pfd{this->Fd, POLLIN, 0};
+    int n = ppoll(&pfd, 1, ptimeout, &waiting);
+    if (n < 0 && errno != EINTR) {
+      fprintf(stderr, "ppoll: %s\n", strerror(errno));
+      this->Result = 1;
+      break;
+    }
+    if (n > 0) {
+      ssize_t len;
+      while ((len = read(this->Fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len;) {
+          auto ev = reinterpret_cast<inotify_event *>(p);
+          this->Handle(*ev);
+          p += sizeof(inotify_event) + ev->len;
+        }
+      }
+    }
+    this->Drain(false);
+  }
+  // Whatever was produced before the stop still gets its fix.
+  this->Drain(true);
+  sigprocmask(SIG_SETMASK, &original, nullptr);
+  return this->Result;
+}
+
+} // namespace
+
+int WatchTree(std::string const &root, WatchOptions const &opts) {
+  std::string dir(root);
+  while (dir.size() > 1 && dir.back() == '/') {
+    dir.pop_back();
+  }
+  Watcher watcher(std::move(dir), opts);
+  return watcher.Run();
+}
@@ -0,0 +1,38 @@
+///
+#ifndef CMCHRPATH_WATCH_HPP
+#define CMCHRPATH_WATCH_HPP
+#include <string>
+#include <vector>
+#include "shmcache.hpp"
+
+/// What to do with a file whose path, relative to the watched directory,
+/// matches Pattern, an fnmatch(3) glob in which `*` also matches `/`.
+struct WatchRule {
+  std::string Pattern;
+  std::string NewRPath;
+  bool Remove = false;
+};
+
+/// Read rules, one per line: a glob, a TAB, and the new rpath, or `-` to
+/// remove the RPATH and RUNPATH. Empty lines and lines starting with '#'
+/// are ignored. The first matching rule applies.
+bool LoadWatchRules(const char *file, std::vector<WatchRule> &rules,
+                    std::string *emsg);
+
+struct WatchOptions {
+  std::vector<WatchRule> Rules;
+  // Quiet period after the last event for a file before it is edited, so a
+  // file written in several passes or replaced twice is edited once.
+  unsigned DebounceMs = 250;
+  int OutFd = 2;
+  mz::shm_cache *Shared = nullptr;
+};
+
+/// `cmchrpath --watch <dir>`: watch dir and every directory created under
+/// it with inotify, and apply the first matching rule to each ELF file that
+/// is closed after writing or moved into the tree. Files already holding
+/// the wanted value are left alone, so our own writes do not loop. Runs
+/// until SIGINT or SIGTERM, then handles what is pending and returns.
+int WatchTree(std::string const &root, WatchOptions const &opts);
+
+#endif
@@ -0,0 +1,388 @@
+///
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+#include "diskcache.hpp"
+#include "sink.hpp"
+
+namespace mz {
+
+constexpr char cache_magic[8] = {'M', 'Z', 'S', 'U', 'M', 'M', 'R', 'Y'};
+constexpr uint32_t cache_version = 1;
+constexpr uint32_t cache_byte_order = 0x01020304;
+
+enum record_flags : uint8_t {
+  flag_valid = 1,
+  flag_soname = 2,
+  flag_rpath = 4,
+  flag_runpath = 8,
+};
+
+struct string_ref {
+  uint32_t offset;
+  uint32_t length;
+};
+
+struct disk_cache::header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order; /// the file is only read on hosts of the same order
+  uint32_t record_size;
+  uint32_t reserved;
+  uint64_t generation;
+  uint64_t count;
+  uint64_t bucket_count; /// a power of two
+  uint64_t buckets_offset;
+  uint64_t records_offset;
+  uint64_t needed_offset;
+  uint64_t needed_count;
+  uint64_t strings_offset;
+  uint64_t strings_size;
+};
+
+struct disk_cache::record {
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtime_ns;
+  int64_t ctime_ns;
+  uint64_t generation; /// last rewrite in which the record was hit or added
+  struct {
+    string_ref text;
+    uint64_t position;
+    uint64_t size;
+  } strings[3]; /// soname, rpath, runpath
+  uint32_t needed_first;
+  uint32_t needed_count;
+  uint16_t type;
+  uint16_t machine;
+  uint8_t flags;
+  uint8_t elfclass;
+  uint8_t endian;
+  uint8_t version;
+  uint8_t osabi;
+  uint8_t abiversion;
+  uint8_t reserved[6];
+};
+
+static_assert(std::is_trivially_copyable<string_ref>::value, "");
+static_assert(sizeof(string_ref) == 8, "");
+
+static bool same_identity(const file_identity &id, uint64_t dev, uint64_t ino,
+                          uint64_t size, int64_t mtime_ns, int64_t ctime_ns) {
+  return id.ino == ino && id.dev == dev && id.size == size &&
+         id.mtime_ns == mtime_ns && id.ctime_ns == ctime_ns;
+}
+
+// Is [offset, offset + count * unit) inside a file of `size` bytes?
+static bool in_file(uint64_t offset, uint64_t count, uint64_t unit,
+                    size_t size) {
+  if (offset > size || offset % 8 != 0) {
+    return false;
+  }
+  return count <= (size - offset) / unit;
+}
+
+disk_cache::~disk_cache() {
+  if (base_ != nullptr) {
+    ::munmap(const_cast<char *>(base_), size_);
+  }
+}
+
+bool disk_cache::open(const std::string &file, std::string *emsg) {
+  file_ = file;
+  int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    if (errno == ENOENT) {
+      return true;
+    }
+    if (emsg) {
+      *emsg = "Error opening cache " + file + ": " + strerror(errno);
+    }
+    return false;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(header)) {
+    ::close(fd);
+    return true;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void *p = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    return true;
+  }
+  auto h = static_cast<const header *>(p);
+  bool ok = memcmp(h->magic, cache_magic, sizeof(cache_magic)) == 0 &&
+            h->version == cache_version &&
+            h->byte_order == cache_byte_order &&
+            h->record_size == sizeof(record) && h->bucket_count != 0 &&
+            (h->bucket_count & (h->bucket_count - 1)) == 0 &&
+            h->count <= h->bucket_count && h->count < UINT32_MAX &&
+            in_file(h->buckets_offset, h->bucket_count, sizeof(uint32_t),
+                    size) &&
+            in_file(h->records_offset, h->count, sizeof(record), size) &&
+            in_file(h->needed_offset, h->needed_count, sizeof(string_ref),
+                    size) &&
+            in_file(h->strings_offset, h->strings_size, 1, size);
+  if (!ok) {
+    // Not ours, or from another version: start over.
+    ::munmap(p, size);
+    return true;
+  }
+  // Lookups touch a handful of pages at random; don't read ahead.
+  ::madvise(p, size, MADV_RANDOM);
+  base_ = static_cast<const char *>(p);
+  size_ = size;
+  header_ = h;
+  touched_.reset(new std::atomic_bool[h->count]());
+  return true;
+}
+
+const disk_cache::record *disk_cache::lookup(const file_identity &id) const {
+  if (header_ == nullptr || header_->count == 0) {
+    return nullptr;
+  }
+  auto buckets =
+      reinterpret_cast<const uint32_t *>(base_ + header_->buckets_offset);
+  auto records =
+      reinterpret_cast<const record *>(base_ + header_->records_offset);
+  uint64_t mask = header_->bucket_count - 1;
+  uint64_t b = identity_hash()(id) & mask;
+  for (uint64_t probe = 0; probe <= mask; probe++, b = (b + 1) & mask) {
+    uint32_t index = buckets[b];
+    if (index == 0 || index > header_->count) {
+      return nullptr;
+    }
+    const record &r = records[index - 1];
+    if (same_identity(id, r.dev, r.ino, r.size, r.mtime_ns, r.ctime_ns)) {
+      return &r;
+    }
+  }
+  return nullptr;
+}
+
+bool disk_cache::decode(const record &r, elf_summary &s) const {
+  const char *strings = base_ + header_->strings_offset;
+  auto text = [&](string_ref ref, std::string &out) {
+    if (ref.offset > header_->strings_size ||
+        ref.length > header_->strings_size - ref.offset) {
+      return false;
+    }
+    out.assign(strings + ref.offset, ref.length);
+    return true;
+  };
+  s = elf_summary();
+  s.valid = (r.flags & flag_valid) != 0;
+  s.elfclass = r.elfclass;
+  s.endian = r.endian;
+  s.version = r.version;
+  s.osabi = r.osabi;
+  s.abiversion = r.abiversion;
+  s.type = r.type;
+  s.machine = r.machine;
+  elf_string *out[3] = {&s.soname, &s.rpath, &s.runpath};
+  const uint8_t present[3] = {flag_soname, flag_rpath, flag_runpath};
+  for (int i = 0; i < 3; i++) {
+    if ((r.flags & present[i]) == 0) {
+      continue;
+    }
+    if (!text(r.strings[i].text, out[i]->value)) {
+      return false;
+    }
+    out[i]->position = r.strings[i].position;
+    out[i]->size = r.strings[i].size;
+    out[i]->present = true;
+  }
+  if (r.needed_first > header_->needed_count ||
+      r.needed_count > header_->needed_count - r.needed_first) {
+    return false;
+  }
+  auto needed = reinterpret_cast<const string_ref *>(
+                    base_ + header_->needed_offset) +
+                r.needed_first;
+  s.needed.resize(r.needed_count);
+  for (uint32_t i = 0; i < r.needed_count; i++) {
+    if (!text(needed[i], s.needed[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool disk_cache::find(const file_identity &id, elf_summary &s) {
+  if (const record *r = lookup(id)) {
+    if (decode(*r, s)) {
+      auto records =
+          reinterpret_cast<const record *>(base_ + header_->records_offset);
+      touched_[r - records].store(true, std::memory_order_relaxed);
+      hits_++;
+      return true;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = added_.find(id);
+    if (it != added_.end()) {
+      s = it->second;
+      hits_++;
+      return true;
+    }
+  }
+  misses_++;
+  return false;
+}
+
+void disk_cache::store(const file_identity &id, const elf_summary &s) {
+  std::lock_guard<std::mutex> lock(mu_);
+  added_.emplace(id, s);
+}
+
+bool disk_cache::commit(std::string *emsg) {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (added_.empty()) {
+    return true;
+  }
+  uint64_t generation = header_ != nullptr ? header_->generation + 1 : 1;
+  std::vector<record> records;
+  std::vector<string_ref> needed;
+  std::string strings;
+  std::unordered_map<std::string, string_ref> interned;
+  auto intern = [&](const std::string &value) {
+    auto it = interned.find(value);
+    if (it != interned.end()) {
+      return it->second;
+    }
+    string_ref ref{static_cast<uint32_t>(strings.size()),
+                   static_cast<uint32_t>(value.size())};
+    strings.append(value);
+    interned.emplace(value, ref);
+    return ref;
+  };
+  auto add = [&](const file_identity &id, const elf_summary &s,
+                 uint64_t seen) {
+    record r;
+    memset(&r, 0, sizeof(r));
+    r.dev = id.dev;
+    r.ino = id.ino;
+    r.size = id.size;
+    r.mtime_ns = id.mtime_ns;
+    r.ctime_ns = id.ctime_ns;
+    r.generation = seen;
+    r.flags = s.valid ? flag_valid : 0;
+    r.elfclass = s.elfclass;
+    r.endian = s.endian;
+    r.version = s.version;
+    r.osabi = s.osabi;
+    r.abiversion = s.abiversion;
+    r.type = s.type;
+    r.machine = s.machine;
+    const elf_string *in[3] = {&s.soname, &s.rpath, &s.runpath};
+    const uint8_t present[3] = {flag_soname, flag_rpath, flag_runpath};
+    for (int i = 0; i < 3; i++) {
+      if (in[i]->present) {
+        r.flags |= present[i];
+        r.strings[i].text = intern(in[i]->value);
+        r.strings[i].position = in[i]->position;
+        r.strings[i].size = in[i]->size;
+      }
+    }
+    r.needed_first = static_cast<uint32_t>(needed.size());
+    r.needed_count = static_cast<uint32_t>(s.needed.size());
+    for (auto const &n : s.needed) {
+      needed.push_back(intern(n));
+    }
+    records.push_back(r);
+  };
+  if (header_ != nullptr) {
+    auto old =
+        reinterpret_cast<const record *>(base_ + header_->records_offset);
+    for (uint64_t i = 0; i < header_->count; i++) {
+      const record &r = old[i];
+      bool touched = touched_[i].load(std::memory_order_relaxed);
+      if (!touched && r.generation + max_age < generation) {
+        continue;
+      }
+      file_identity id{r.dev, r.ino, r.size, r.mtime_ns, r.ctime_ns};
+      elf_summary s;
+      if (added_.count(id) != 0 || !decode(r, s)) {
+        continue;
+      }
+      add(id, s, touched ? generation : r.generation);
+    }
+  }
+  for (auto const &a : added_) {
+    add(a.first, a.second, generation);
+  }
+  if (strings.size() >= UINT32_MAX || needed.size() >= UINT32_MAX) {
+    if (emsg) {
+      *emsg = "Error writing cache " + file_ + ": too large";
+    }
+    return false;
+  }
+
+  uint64_t bucket_count = 16;
+  while (bucket_count < records.size() * 2) {
+    bucket_count <<= 1;
+  }
+  std::vector<uint32_t> buckets(bucket_count, 0);
+  for (size_t i = 0; i < records.size(); i++) {
+    auto const &r = records[i];
+    file_identity id{r.dev, r.ino, r.size, r.mtime_ns, r.ctime_ns};
+    uint64_t b = identity_hash()(id) & (bucket_count - 1);
+    while (buckets[b] != 0) {
+      b = (b + 1) & (bucket_count - 1);
+    }
+    buckets[b] = static_cast<uint32_t>(i + 1);
+  }
+
+  auto align = [](uint64_t v) { return (v + 7) & ~uint64_t(7); };
+  header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, cache_magic, sizeof(cache_magic));
+  h.version = cache_version;
+  h.byte_order = cache_byte_order;
+  h.record_size = sizeof(record);
+  h.generation = generation;
+  h.count = records.size();
+  h.bucket_count = bucket_count;
+  h.buckets_offset = align(sizeof(header));
+  h.records_offset = align(h.buckets_offset + bucket_count * sizeof(uint32_t));
+  h.needed_offset = align(h.records_offset + records.size() * sizeof(record));
+  h.needed_count = needed.size();
+  h.strings_offset =
+      align(h.needed_offset + needed.size() * sizeof(string_ref));
+  h.strings_size = strings.size();
+
+  std::string data(h.strings_offset + strings.size(), '\0');
+  memcpy(&data[0], &h, sizeof(h));
+  memcpy(&data[h.buckets_offset], buckets.data(),
+         buckets.size() * sizeof(uint32_t));
+  if (!records.empty()) {
+    memcpy(&data[h.records_offset], records.data(),
+           records.size() * sizeof(record));
+  }
+  if (!needed.empty()) {
+    memcpy(&data[h.needed_offset], needed.data(),
+           needed.size() * sizeof(string_ref));
+  }
+  if (!strings.empty()) {
+    memcpy(&data[h.strings_offset], strings.data(), strings.size());
+  }
+  if (!replace_file(file_, data.data(), data.size())) {
+    if (emsg) {
+      *emsg = "Error writing cache " + file_ + ": " + strerror(errno);
+    }
+    return false;
+  }
+  added_.clear();
+  return true;
+}
+
+} // namespace mz
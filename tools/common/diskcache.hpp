@@ -0,0 +1,71 @@
+///
+#ifndef MZ_DISKCACHE_HPP
+#define MZ_DISKCACHE_HPP
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "identity.hpp"
+#include "summary.hpp"
+
+namespace mz {
+
+/// disk_cache is a persistent store of ELF summaries keyed by file identity,
+/// so a file that has not changed since it was last parsed costs one stat.
+///
+/// The cache file is mapped read-only and looked up in place; nothing is
+/// decoded until a record is hit. Summaries of files parsed during the run
+/// are kept in memory and commit() writes a new cache file next to the old
+/// one and renames it over, so readers never see a partial file and a run
+/// that finds everything cached writes nothing.
+///
+///   header    magic, version, counts and section offsets
+///   buckets   uint32_t[bucket_count], record index + 1, 0 is empty
+///   records   fixed-size, identity and header fields, string references
+///   needed    {offset, length} of each DT_NEEDED string
+///   strings   the string pool
+///
+/// Every rewrite bumps the cache generation. Records that were not hit in
+/// the last `max_age` generations are dropped by the next rewrite.
+class disk_cache {
+public:
+  static constexpr uint32_t max_age = 16;
+  disk_cache() = default;
+  disk_cache(const disk_cache &) = delete;
+  disk_cache &operator=(const disk_cache &) = delete;
+  ~disk_cache();
+  /// Map the cache file. A missing, foreign or damaged file is treated as an
+  /// empty cache and replaced by commit().
+  bool open(const std::string &file, std::string *emsg);
+  /// Thread-safe.
+  bool find(const file_identity &id, elf_summary &s);
+  /// Thread-safe. The summary must be for the file as it was when id was
+  /// taken; stat before parsing, not after.
+  void store(const file_identity &id, const elf_summary &s);
+  /// Write the cache back if anything was stored.
+  bool commit(std::string *emsg);
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+private:
+  struct header;
+  struct record;
+  const record *lookup(const file_identity &id) const;
+  bool decode(const record &r, elf_summary &s) const;
+  std::string file_;
+  const char *base_{nullptr};
+  size_t size_{0};
+  const header *header_{nullptr};
+  std::unique_ptr<std::atomic_bool[]> touched_;
+  std::unordered_map<file_identity, elf_summary, identity_hash> added_;
+  std::mutex mu_;
+  std::atomic_size_t hits_{0};
+  std::atomic_size_t misses_{0};
+};
+
+} // namespace mz
+
+#endif
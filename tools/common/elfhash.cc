@@ -0,0 +1,227 @@
+///
+#include <algorithm>
+#include "elfhash.hpp"
+#include "elftypes.hpp"
+
+namespace mz {
+
+namespace {
+
+/// hash_reader measures the hash tables of one image whose class and byte
+/// order are known at compile time.
+template <typename E, bool Swap> class hash_reader : elf_bytes<Swap> {
+public:
+  explicit hash_reader(const elf_view &v)
+      : elf_bytes<Swap>(v.image, v.image_size), v_(v) {}
+
+  bool read(hash_tables &t) {
+    uint64_t addr = 0, off = 0;
+    if (v_.find(DT_GNU_HASH, addr) &&
+        (!v_.offset_of(addr, off) || !read_gnu(off, t.gnu))) {
+      return false;
+    }
+    if (v_.find(DT_HASH, addr) &&
+        (!v_.offset_of(addr, off) || !read_sysv(off, t.sysv))) {
+      return false;
+    }
+    return true;
+  }
+
+  bool lookup(std::string_view name, std::vector<uint32_t> &indices) {
+    using word = typename E::word;
+    constexpr uint32_t bits = sizeof(word) * 8;
+    uint64_t addr = 0, off = 0;
+    if (!v_.find(DT_GNU_HASH, addr) || !v_.offset_of(addr, off) ||
+        off > size_ || size_ - off < 16) {
+      return false;
+    }
+    uint32_t nbuckets = read<uint32_t>(off);
+    uint32_t symoffset = read<uint32_t>(off + 4);
+    uint32_t words = read<uint32_t>(off + 8);
+    uint32_t shift = read<uint32_t>(off + 12);
+    uint64_t bloom = off + 16;
+    uint64_t buckets = bloom + uint64_t(words) * sizeof(word);
+    uint64_t chains = buckets + uint64_t(nbuckets) * 4;
+    if (chains > size_ || nbuckets == 0 || words == 0) {
+      return false;
+    }
+    uint32_t h = gnu_hash(name);
+    // The word count is a power of two: the loader masks with it.
+    word w = read<word>(bloom + uint64_t(h / bits & (words - 1)) *
+                                    sizeof(word));
+    word mask = word(1) << (h % bits) | word(1) << ((h >> shift) % bits);
+    if ((w & mask) != mask) {
+      return true;
+    }
+    uint32_t first = read<uint32_t>(buckets + uint64_t(h % nbuckets) * 4);
+    if (first < symoffset) {
+      return true;
+    }
+    for (uint64_t i = first;; i++) {
+      uint64_t at = chains + (i - symoffset) * 4;
+      if (at + 4 > size_) {
+        return false;
+      }
+      uint32_t hash = read<uint32_t>(at);
+      if ((hash | 1) == (h | 1)) {
+        indices.push_back(static_cast<uint32_t>(i));
+      }
+      if ((hash & 1) != 0) {
+        break;
+      }
+    }
+    return true;
+  }
+
+private:
+  using elf_bytes<Swap>::size_;
+  template <typename T> T read(uint64_t off) const {
+    return elf_bytes<Swap>::template read<T>(off);
+  }
+
+  void add_chain(hash_table_stats &s, uint32_t length) {
+    s.chains[std::min<size_t>(length, s.chains.size() - 1)]++;
+    s.symbols += length;
+    s.longest = std::max(s.longest, length);
+    found_ += double(length) * (double(length) + 1) / 2;
+  }
+
+  // A name the table holds is found halfway down its chain on average; a
+  // name it does not hold walks the whole chain of its bucket.
+  void estimate(hash_table_stats &s) {
+    if (s.symbols != 0) {
+      s.probes_hit = found_ / s.symbols;
+      s.probes_miss = s.bloom_pass * double(s.symbols) / s.buckets;
+    }
+    found_ = 0;
+  }
+
+  // nbuckets, symoffset, bloom_size, bloom_shift, the bloom words, the
+  // buckets, then a hash per symbol from symoffset on, the low bit set on
+  // the last of each chain.
+  bool read_gnu(uint64_t off, hash_table_stats &s) {
+    using word = typename E::word;
+    constexpr uint32_t bits = sizeof(word) * 8;
+    if (off > size_ || size_ - off < 16) {
+      return false;
+    }
+    s.present = true;
+    s.buckets = read<uint32_t>(off);
+    uint32_t symoffset = read<uint32_t>(off + 4);
+    s.bloom_words = read<uint32_t>(off + 8);
+    s.bloom_shift = read<uint32_t>(off + 12);
+    s.bloom_word_bits = bits;
+    uint64_t bloom = off + 16;
+    uint64_t buckets = bloom + uint64_t(s.bloom_words) * sizeof(word);
+    uint64_t chains = buckets + uint64_t(s.buckets) * 4;
+    if (chains > size_) {
+      return false;
+    }
+    // The loader picks a word and two bits of it from the hash, so a name
+    // passes a word with k of its bits set with a chance of (k/bits)^2.
+    double pass = 0;
+    for (uint32_t i = 0; i < s.bloom_words; i++) {
+      auto set = __builtin_popcountll(
+          read<word>(bloom + uint64_t(i) * sizeof(word)));
+      s.bloom_set += uint64_t(set);
+      pass += double(set) * set / (double(bits) * bits);
+    }
+    s.bloom_pass = s.bloom_words != 0 ? pass / s.bloom_words : 1;
+    for (uint32_t b = 0; b < s.buckets; b++) {
+      uint32_t first = read<uint32_t>(buckets + uint64_t(b) * 4);
+      if (first == 0) {
+        add_chain(s, 0);
+        continue;
+      }
+      if (first < symoffset) {
+        return false;
+      }
+      uint32_t length = 0;
+      for (uint64_t at = chains + uint64_t(first - symoffset) * 4;;
+           at += 4) {
+        if (at + 4 > size_) {
+          return false;
+        }
+        length++;
+        if ((read<uint32_t>(at) & 1) != 0) {
+          break;
+        }
+      }
+      add_chain(s, length);
+    }
+    estimate(s);
+    return true;
+  }
+
+  // nbucket, nchain, the buckets, then a chain link per symbol; 0 ends a
+  // chain.
+  bool read_sysv(uint64_t off, hash_table_stats &s) {
+    if (off > size_ || size_ - off < 8) {
+      return false;
+    }
+    s.present = true;
+    s.buckets = read<uint32_t>(off);
+    uint32_t nchain = read<uint32_t>(off + 4);
+    uint64_t buckets = off + 8;
+    uint64_t chains = buckets + uint64_t(s.buckets) * 4;
+    if (chains + uint64_t(nchain) * 4 > size_) {
+      return false;
+    }
+    for (uint32_t b = 0; b < s.buckets; b++) {
+      uint32_t length = 0;
+      // A chain longer than the symbol table loops.
+      for (uint32_t y = read<uint32_t>(buckets + uint64_t(b) * 4); y != 0;
+           y = read<uint32_t>(chains + uint64_t(y) * 4)) {
+        if (y >= nchain || length == nchain) {
+          return false;
+        }
+        length++;
+      }
+      add_chain(s, length);
+    }
+    estimate(s);
+    return true;
+  }
+
+  const elf_view &v_;
+  double found_{0}; /// the sum of the hit probes of the chains so far
+};
+
+template <typename F> auto dispatch(const elf_view &v, F &&fn) {
+  bool swap = (v.endian == ELFDATA2MSB) != host_msb;
+  if (v.elfclass == ELFCLASS64) {
+    return swap ? fn(hash_reader<elf64_types, true>(v))
+                : fn(hash_reader<elf64_types, false>(v));
+  }
+  return swap ? fn(hash_reader<elf32_types, true>(v))
+              : fn(hash_reader<elf32_types, false>(v));
+}
+
+} // namespace
+
+bool read_hash_tables(const elf_view &v, hash_tables &t) {
+  t = hash_tables();
+  if (v.image == nullptr) {
+    return false;
+  }
+  return dispatch(v, [&](auto &&r) { return r.read(t); });
+}
+
+uint32_t gnu_hash(std::string_view name) {
+  uint32_t h = 5381;
+  for (unsigned char c : name) {
+    h = h * 33 + c;
+  }
+  return h;
+}
+
+bool gnu_hash_lookup(const elf_view &v, std::string_view name,
+                     std::vector<uint32_t> &indices) {
+  indices.clear();
+  if (v.image == nullptr) {
+    return false;
+  }
+  return dispatch(v, [&](auto &&r) { return r.lookup(name, indices); });
+}
+
+} // namespace mz
@@ -0,0 +1,68 @@
+///
+#ifndef MZ_ELFHASH_HPP
+#define MZ_ELFHASH_HPP
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "elfview.hpp"
+
+namespace mz {
+
+/// The shape of one symbol hash table, DT_GNU_HASH or DT_HASH, and what it
+/// costs the loader to look a name up in it.
+struct hash_table_stats {
+  bool present{false};
+  uint32_t buckets{0};
+  uint32_t symbols{0}; /// symbols on its chains
+  uint32_t longest{0}; /// the longest chain
+  /// chains[n] is the number of buckets whose chain holds n symbols; the
+  /// last counts the longer ones too.
+  std::array<uint32_t, 9> chains{};
+  /// DT_GNU_HASH only: the bloom filter words, their size and how many of
+  /// their bits are set.
+  uint32_t bloom_words{0};
+  uint32_t bloom_word_bits{0};
+  uint32_t bloom_shift{0};
+  uint64_t bloom_set{0};
+  /// The chance that a name the table does not hold gets past the bloom
+  /// filter to the chains; 1 without one.
+  double bloom_pass{1};
+  /// Chain entries compared, on average, to find a name the table holds
+  /// and to learn that it holds some other name. The GNU table compares
+  /// hashes and the string only when they match; DT_HASH compares the
+  /// string of every entry.
+  double probes_hit{0};
+  double probes_miss{0};
+  double bloom_fill() const {
+    uint64_t bits = uint64_t(bloom_words) * bloom_word_bits;
+    return bits == 0 ? 0 : double(bloom_set) / double(bits);
+  }
+};
+
+/// The symbol hash tables of an image. The loader uses the GNU one when
+/// there is one.
+struct hash_tables {
+  hash_table_stats gnu;
+  hash_table_stats sysv;
+  const hash_table_stats &used() const { return gnu.present ? gnu : sysv; }
+};
+
+/// Read the DT_GNU_HASH and DT_HASH tables of an image read by
+/// read_elf_view. False if one of them runs out of the file.
+bool read_hash_tables(const elf_view &v, hash_tables &t);
+
+/// The hash DT_GNU_HASH keys names by.
+uint32_t gnu_hash(std::string_view name);
+
+/// Look name up in the DT_GNU_HASH table of an image as the loader does:
+/// its bloom filter first, then the chain of its bucket, setting indices
+/// to the symbols whose hash matches (empty when the filter rejects the
+/// name). Their names are left to compare. False if the image has no
+/// GNU hash table or it runs out of the file.
+bool gnu_hash_lookup(const elf_view &v, std::string_view name,
+                     std::vector<uint32_t> &indices);
+
+} // namespace mz
+
+#endif
@@ -0,0 +1,760 @@
+///
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <numeric>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include "elfindex.hpp"
+#include "elfsym.hpp"
+#include "sink.hpp"
+#include "walker.hpp"
+
+namespace mz {
+
+constexpr char index_magic[8] = {'M', 'Z', 'E', 'L', 'F', 'I', 'D', 'X'};
+constexpr uint32_t index_version = 4;
+constexpr uint32_t index_byte_order = 0x01020304;
+constexpr uint32_t max_tables = 8;
+
+struct table_desc {
+  uint64_t bucket_count; /// a power of two, or 0 for an empty table
+  uint64_t buckets_offset;
+  uint64_t entry_count;
+  uint64_t entries_offset;
+};
+
+struct elf_index::header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t record_size;
+  uint32_t table_count;
+  uint64_t record_count;
+  uint64_t records_offset;
+  uint64_t needed_count;
+  uint64_t needed_offset;
+  uint64_t string_count;
+  uint64_t strings_offset;
+  uint64_t pool_offset;
+  uint64_t pool_size;
+  uint64_t posting_count;
+  uint64_t postings_offset;
+  uint64_t symbol_count;
+  uint64_t symbols_offset;
+  uint64_t symbol_groups;  /// displacements; 0 if no file exports a symbol
+  uint64_t groups_offset;
+  uint64_t symbol_slots;   /// table entries, some of them empty
+  uint64_t slots_offset;
+  uint64_t symbol_seed;    /// the fnv1a64 seed the symbol names hash with
+  table_desc tables[max_tables];
+};
+
+struct elf_index::record {
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtime_ns;
+  int64_t ctime_ns;
+  uint64_t positions[3]; /// soname, rpath, runpath string table slots
+  uint64_t sizes[3];
+  uint32_t path;
+  uint32_t strings[3]; /// soname, rpath, runpath; none if absent
+  uint32_t needed_first;
+  uint32_t needed_count;
+  uint32_t symbols_first;
+  uint32_t symbols_count;
+  uint16_t type;
+  uint16_t machine;
+  uint8_t valid;
+  uint8_t elfclass;
+  uint8_t endian;
+  uint8_t version;
+  uint8_t osabi;
+  uint8_t abiversion;
+  uint8_t reserved[2];
+};
+
+struct elf_index::table_entry {
+  uint32_t string;
+  uint32_t first;
+  uint32_t count;
+  uint32_t reserved;
+};
+
+struct elf_index::symbol_def {
+  uint32_t name;
+  uint32_t version; /// none if it has none
+  uint32_t record;
+  uint32_t hidden;
+};
+
+namespace {
+
+struct string_ref {
+  uint32_t offset;
+  uint32_t length;
+};
+
+// Is [offset, offset + count * unit) inside a file of `size` bytes?
+bool in_file(uint64_t offset, uint64_t count, uint64_t unit, size_t size) {
+  if (offset > size || offset % 8 != 0) {
+    return false;
+  }
+  return count <= (size - offset) / unit;
+}
+
+uint64_t align8(uint64_t v) { return (v + 7) & ~uint64_t(7); }
+
+// The slot of a name with the given hash in a perfect hash table of slots
+// entries, for the displacement of its group.
+uint64_t perfect_slot(uint64_t hash, uint32_t displacement, uint64_t slots) {
+  uint64_t x = hash + (uint64_t(displacement) + 1) * 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return (x ^ (x >> 31)) % slots;
+}
+
+// Give each group of hashes, the largest first, the first displacement
+// that sends all of its hashes to slots no other hash has taken. placed
+// gets the hash number + 1 of every slot, 0 for an empty one. False if
+// a group finds none, as when two names hash alike under the seed.
+bool place_perfect(const std::vector<uint64_t> &hashes, uint64_t slots,
+                   std::vector<uint32_t> &displacements,
+                   std::vector<uint32_t> &placed) {
+  constexpr uint32_t max_displacement = 1u << 20;
+  uint64_t groups = displacements.size();
+  // The hashes of each group, together, by counting sort.
+  std::vector<uint32_t> first(groups + 1, 0);
+  for (uint64_t h : hashes) {
+    first[h % groups + 1]++;
+  }
+  std::partial_sum(first.begin(), first.end(), first.begin());
+  std::vector<uint32_t> members(hashes.size());
+  std::vector<uint32_t> next(first.begin(), first.end() - 1);
+  for (uint32_t k = 0; k < hashes.size(); k++) {
+    members[next[hashes[k] % groups]++] = k;
+  }
+  std::vector<uint32_t> order(groups);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return first[a + 1] - first[a] > first[b + 1] - first[b];
+  });
+  placed.assign(slots, 0);
+  std::vector<uint64_t> taken;
+  for (uint32_t g : order) {
+    const uint32_t *m = members.data() + first[g];
+    size_t size = first[g + 1] - first[g];
+    if (size == 0) {
+      break;
+    }
+    for (uint32_t d = 0;; d++) {
+      if (d == max_displacement) {
+        return false;
+      }
+      taken.clear();
+      for (size_t i = 0; i < size; i++) {
+        uint64_t slot = perfect_slot(hashes[m[i]], d, slots);
+        if (placed[slot] != 0 ||
+            std::find(taken.begin(), taken.end(), slot) != taken.end()) {
+          break;
+        }
+        taken.push_back(slot);
+      }
+      if (taken.size() == size) {
+        for (size_t i = 0; i < size; i++) {
+          placed[taken[i]] = m[i] + 1;
+        }
+        displacements[g] = d;
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+bool read_index_symbols(const elf_view &v, std::vector<index_symbol> &out) {
+  out.clear();
+  std::vector<elf_symbol> syms;
+  if (!v.dynamic) {
+    return true;
+  }
+  if (!read_dynamic_symbols(v, syms)) {
+    return false;
+  }
+  for (auto const &s : syms) {
+    if (s.exported()) {
+      out.push_back(index_symbol{std::string(s.name), std::string(s.version),
+                                 s.hidden});
+    }
+  }
+  return true;
+}
+
+elf_index::~elf_index() {
+  if (base_ != nullptr) {
+    ::munmap(const_cast<char *>(base_), size_);
+  }
+}
+
+bool elf_index::open(const std::string &file, std::string *emsg) {
+  auto fail = [&](const char *why) {
+    if (emsg) {
+      *emsg = "Error opening index " + file + ": " + why;
+    }
+    return false;
+  };
+  int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return fail(strerror(errno));
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(header)) {
+    ::close(fd);
+    return fail("not an index");
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void *p = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    return fail(strerror(errno));
+  }
+  auto h = static_cast<const header *>(p);
+  bool ok = memcmp(h->magic, index_magic, sizeof(index_magic)) == 0 &&
+            h->version == index_version &&
+            h->byte_order == index_byte_order &&
+            h->record_size == sizeof(record) &&
+            h->table_count <= max_tables && h->record_count < none &&
+            h->string_count < none &&
+            in_file(h->records_offset, h->record_count, sizeof(record), size) &&
+            in_file(h->needed_offset, h->needed_count, sizeof(uint32_t),
+                    size) &&
+            in_file(h->strings_offset, h->string_count, sizeof(string_ref),
+                    size) &&
+            in_file(h->pool_offset, h->pool_size, 1, size) &&
+            in_file(h->postings_offset, h->posting_count, sizeof(uint32_t),
+                    size) &&
+            h->symbol_count < none &&
+            in_file(h->symbols_offset, h->symbol_count, sizeof(symbol_def),
+                    size) &&
+            (h->symbol_groups == 0) == (h->symbol_slots == 0) &&
+            in_file(h->groups_offset, h->symbol_groups, sizeof(uint32_t),
+                    size) &&
+            in_file(h->slots_offset, h->symbol_slots, sizeof(table_entry),
+                    size);
+  for (uint32_t t = 0; ok && t < h->table_count; t++) {
+    auto const &d = h->tables[t];
+    ok = (d.bucket_count & (d.bucket_count - 1)) == 0 &&
+         d.entry_count <= d.bucket_count &&
+         in_file(d.buckets_offset, d.bucket_count, sizeof(uint32_t), size) &&
+         in_file(d.entries_offset, d.entry_count, sizeof(table_entry), size);
+  }
+  if (!ok) {
+    ::munmap(p, size);
+    return fail("not an index of this version");
+  }
+  base_ = static_cast<const char *>(p);
+  size_ = size;
+  header_ = h;
+  return true;
+}
+
+size_t elf_index::size() const {
+  return header_ != nullptr ? static_cast<size_t>(header_->record_count) : 0;
+}
+
+const elf_index::record *elf_index::at(uint32_t index) const {
+  if (header_ == nullptr || index >= header_->record_count) {
+    return nullptr;
+  }
+  return reinterpret_cast<const record *>(base_ + header_->records_offset) +
+         index;
+}
+
+std::string_view elf_index::string(uint32_t id) const {
+  if (header_ == nullptr || id >= header_->string_count) {
+    return {};
+  }
+  auto ref =
+      reinterpret_cast<const string_ref *>(base_ + header_->strings_offset)[id];
+  if (ref.offset > header_->pool_size ||
+      ref.length > header_->pool_size - ref.offset) {
+    return {};
+  }
+  return std::string_view(base_ + header_->pool_offset + ref.offset,
+                          ref.length);
+}
+
+index_postings elf_index::lookup(index_table table,
+                                 std::string_view key) const {
+  index_postings records;
+  if (header_ == nullptr || table >= header_->table_count) {
+    return records;
+  }
+  auto const &d = header_->tables[table];
+  if (d.bucket_count == 0) {
+    return records;
+  }
+  auto buckets = reinterpret_cast<const uint32_t *>(base_ + d.buckets_offset);
+  auto entries =
+      reinterpret_cast<const table_entry *>(base_ + d.entries_offset);
+  uint64_t mask = d.bucket_count - 1;
+  uint64_t b = fnv1a64(key) & mask;
+  for (uint64_t probe = 0; probe <= mask; probe++, b = (b + 1) & mask) {
+    uint32_t index = buckets[b];
+    if (index == 0 || index > d.entry_count) {
+      break;
+    }
+    auto const &e = entries[index - 1];
+    if (string(e.string) != key) {
+      continue;
+    }
+    if (e.first > header_->posting_count ||
+        e.count > header_->posting_count - e.first) {
+      break;
+    }
+    auto postings =
+        reinterpret_cast<const uint32_t *>(base_ + header_->postings_offset);
+    records.first = postings + e.first;
+    records.last = records.first + e.count;
+    break;
+  }
+  return records;
+}
+
+uint32_t elf_index::find_path(std::string_view path) const {
+  auto records = lookup(table_path, path);
+  return records.empty() ? none : *records.first;
+}
+
+std::string_view elf_index::path(uint32_t index) const {
+  const record *r = at(index);
+  return r != nullptr ? string(r->path) : std::string_view();
+}
+
+bool elf_index::identity(uint32_t index, file_identity &id) const {
+  const record *r = at(index);
+  if (r == nullptr) {
+    return false;
+  }
+  id = file_identity{r->dev, r->ino, r->size, r->mtime_ns, r->ctime_ns};
+  return true;
+}
+
+bool elf_index::summary(uint32_t index, elf_summary &s) const {
+  const record *r = at(index);
+  if (r == nullptr) {
+    return false;
+  }
+  s = elf_summary();
+  s.valid = r->valid != 0;
+  s.elfclass = r->elfclass;
+  s.endian = r->endian;
+  s.version = r->version;
+  s.osabi = r->osabi;
+  s.abiversion = r->abiversion;
+  s.type = r->type;
+  s.machine = r->machine;
+  elf_string *out[3] = {&s.soname, &s.rpath, &s.runpath};
+  for (int i = 0; i < 3; i++) {
+    if (r->strings[i] != none) {
+      out[i]->value.assign(string(r->strings[i]));
+      out[i]->position = r->positions[i];
+      out[i]->size = r->sizes[i];
+      out[i]->present = true;
+    }
+  }
+  if (r->needed_first > header_->needed_count ||
+      r->needed_count > header_->needed_count - r->needed_first) {
+    return false;
+  }
+  auto needed =
+      reinterpret_cast<const uint32_t *>(base_ + header_->needed_offset) +
+      r->needed_first;
+  for (uint32_t i = 0; i < r->needed_count; i++) {
+    s.needed.emplace_back(string(needed[i]));
+  }
+  return true;
+}
+
+std::vector<uint32_t> elf_index::dependents(std::string_view soname,
+                                            bool transitive) const {
+  std::vector<uint32_t> found;
+  if (header_ == nullptr) {
+    return found;
+  }
+  // The (class, machine) of a library: consumers of another kind cannot
+  // load it.
+  auto kind = [](const record &r) {
+    return static_cast<uint32_t>(r.elfclass) << 16 | r.machine;
+  };
+  std::vector<char> seen(header_->record_count, 0);
+  struct pending {
+    std::string_view soname;
+    uint32_t kind;
+    bool any; /// the first name: consumers of every kind match
+  };
+  std::vector<pending> queue{{soname, 0, true}};
+  std::unordered_map<std::string_view, std::vector<uint32_t>> visited;
+  for (size_t next = 0; next < queue.size(); next++) {
+    auto p = queue[next];
+    for (uint32_t n : lookup(table_needed, p.soname)) {
+      const record *r = at(n);
+      if (r == nullptr || seen[n] || !r->valid ||
+          (!p.any && kind(*r) != p.kind)) {
+        continue;
+      }
+      seen[n] = 1;
+      found.push_back(n);
+      if (!transitive || r->strings[0] == none) {
+        continue;
+      }
+      // A library: its own consumers depend on soname too.
+      auto name = string(r->strings[0]);
+      auto &kinds = visited[name];
+      if (std::find(kinds.begin(), kinds.end(), kind(*r)) == kinds.end()) {
+        kinds.push_back(kind(*r));
+        queue.push_back(pending{name, kind(*r), false});
+      }
+    }
+  }
+  return found;
+}
+
+bool elf_index::symbols(uint32_t index,
+                        std::vector<index_symbol> &out) const {
+  out.clear();
+  const record *r = at(index);
+  if (r == nullptr || r->symbols_first > header_->symbol_count ||
+      r->symbols_count > header_->symbol_count - r->symbols_first) {
+    return false;
+  }
+  auto defs =
+      reinterpret_cast<const symbol_def *>(base_ + header_->symbols_offset) +
+      r->symbols_first;
+  for (uint32_t i = 0; i < r->symbols_count; i++) {
+    auto const &d = defs[i];
+    out.push_back(index_symbol{std::string(string(d.name)),
+                               d.version != none
+                                   ? std::string(string(d.version))
+                                   : std::string(),
+                               d.hidden != 0});
+  }
+  return true;
+}
+
+std::vector<index_definition>
+elf_index::definitions(std::string_view name) const {
+  std::vector<index_definition> found;
+  if (header_ == nullptr || header_->symbol_slots == 0) {
+    return found;
+  }
+  uint64_t hash = fnv1a64(name, header_->symbol_seed);
+  auto groups =
+      reinterpret_cast<const uint32_t *>(base_ + header_->groups_offset);
+  uint32_t displacement = groups[hash % header_->symbol_groups];
+  auto const &e = reinterpret_cast<const table_entry *>(
+      base_ + header_->slots_offset)[perfect_slot(hash, displacement,
+                                                  header_->symbol_slots)];
+  if (e.string == none || string(e.string) != name ||
+      e.first > header_->posting_count ||
+      e.count > header_->posting_count - e.first) {
+    return found;
+  }
+  auto postings =
+      reinterpret_cast<const uint32_t *>(base_ + header_->postings_offset) +
+      e.first;
+  auto defs =
+      reinterpret_cast<const symbol_def *>(base_ + header_->symbols_offset);
+  for (uint32_t i = 0; i < e.count; i++) {
+    if (postings[i] >= header_->symbol_count) {
+      break;
+    }
+    auto const &d = defs[postings[i]];
+    found.push_back(index_definition{
+        d.record, d.version != none ? string(d.version) : std::string_view(),
+        d.hidden != 0});
+  }
+  return found;
+}
+
+bool write_elf_index(const std::string &file,
+                     const std::vector<index_entry> &entries,
+                     std::string *emsg) {
+  using header = elf_index::header;
+  using record = elf_index::record;
+  using table_entry = elf_index::table_entry;
+  using symbol_def = elf_index::symbol_def;
+  std::vector<string_ref> strings;
+  std::string pool;
+  // Open addressing on the hashes of the strings, which the symbol table
+  // takes too: the id + 1 of a string, 0 for an empty bucket. Symbol
+  // names make it large, so it keeps no nodes.
+  std::vector<uint64_t> hashes;
+  std::vector<uint32_t> interned(1024, 0);
+  auto insert = [&](uint32_t id) {
+    uint64_t mask = interned.size() - 1;
+    uint64_t b = hashes[id] & mask;
+    while (interned[b] != 0) {
+      b = (b + 1) & mask;
+    }
+    interned[b] = id + 1;
+  };
+  auto intern = [&](std::string_view value) {
+    uint64_t hash = fnv1a64(value);
+    uint64_t mask = interned.size() - 1;
+    for (uint64_t b = hash & mask; interned[b] != 0; b = (b + 1) & mask) {
+      uint32_t id = interned[b] - 1;
+      if (hashes[id] == hash &&
+          std::string_view(pool.data() + strings[id].offset,
+                           strings[id].length) == value) {
+        return id;
+      }
+    }
+    auto id = static_cast<uint32_t>(strings.size());
+    strings.push_back(string_ref{static_cast<uint32_t>(pool.size()),
+                                 static_cast<uint32_t>(value.size())});
+    pool.append(value.data(), value.size());
+    hashes.push_back(hash);
+    if (strings.size() * 2 > interned.size()) {
+      interned.assign(interned.size() * 2, 0);
+      for (uint32_t i = 0; i < strings.size(); i++) {
+        insert(i);
+      }
+    } else {
+      insert(id);
+    }
+    return id;
+  };
+  size_t symbol_count = 0;
+  for (auto const &e : entries) {
+    symbol_count += e.symbols.size();
+  }
+  std::vector<record> records;
+  std::vector<uint32_t> needed;
+  std::vector<symbol_def> defs;
+  defs.reserve(symbol_count);
+  // Per table, the records of every string id, in record order.
+  std::map<uint32_t, std::vector<uint32_t>> keyed[table_count];
+  records.reserve(entries.size());
+  for (auto const &e : entries) {
+    auto n = static_cast<uint32_t>(records.size());
+    record r;
+    memset(&r, 0, sizeof(r));
+    r.dev = e.id.dev;
+    r.ino = e.id.ino;
+    r.size = e.id.size;
+    r.mtime_ns = e.id.mtime_ns;
+    r.ctime_ns = e.id.ctime_ns;
+    r.path = intern(e.path);
+    keyed[table_path][r.path].push_back(n);
+    auto const &s = e.summary;
+    r.valid = s.valid ? 1 : 0;
+    r.elfclass = s.elfclass;
+    r.endian = s.endian;
+    r.version = s.version;
+    r.osabi = s.osabi;
+    r.abiversion = s.abiversion;
+    r.type = s.type;
+    r.machine = s.machine;
+    const elf_string *in[3] = {&s.soname, &s.rpath, &s.runpath};
+    const index_table tables[3] = {table_soname, table_rpath, table_runpath};
+    for (int i = 0; i < 3; i++) {
+      r.strings[i] = elf_index::none;
+      if (in[i]->present) {
+        r.strings[i] = intern(in[i]->value);
+        r.positions[i] = in[i]->position;
+        r.sizes[i] = in[i]->size;
+        keyed[tables[i]][r.strings[i]].push_back(n);
+      }
+    }
+    r.needed_first = static_cast<uint32_t>(needed.size());
+    r.needed_count = static_cast<uint32_t>(s.needed.size());
+    for (auto const &dep : s.needed) {
+      needed.push_back(intern(dep));
+      auto &posting = keyed[table_needed][needed.back()];
+      // A file naming the same library twice is one dependent.
+      if (posting.empty() || posting.back() != n) {
+        posting.push_back(n);
+      }
+    }
+    r.symbols_first = static_cast<uint32_t>(defs.size());
+    r.symbols_count = static_cast<uint32_t>(e.symbols.size());
+    for (auto const &sym : e.symbols) {
+      defs.push_back(symbol_def{
+          intern(sym.name),
+          sym.version.empty() ? elf_index::none : intern(sym.version), n,
+          sym.hidden ? 1u : 0u});
+    }
+    records.push_back(r);
+  }
+  if (pool.size() >= UINT32_MAX || strings.size() >= elf_index::none ||
+      defs.size() >= elf_index::none) {
+    if (emsg) {
+      *emsg = "Error writing index " + file + ": too large";
+    }
+    return false;
+  }
+
+  // Hash tables and postings.
+  std::vector<uint32_t> postings;
+  std::vector<uint32_t> buckets[table_count];
+  std::vector<table_entry> tentries[table_count];
+  for (uint32_t t = 0; t < table_count; t++) {
+    uint64_t bucket_count = 8;
+    while (bucket_count < keyed[t].size() * 2) {
+      bucket_count <<= 1;
+    }
+    buckets[t].assign(bucket_count, 0);
+    for (auto const &k : keyed[t]) {
+      table_entry te{k.first, static_cast<uint32_t>(postings.size()),
+                     static_cast<uint32_t>(k.second.size()), 0};
+      postings.insert(postings.end(), k.second.begin(), k.second.end());
+      tentries[t].push_back(te);
+      auto const &ref = strings[k.first];
+      uint64_t b = fnv1a64(std::string_view(pool.data() + ref.offset,
+                                            ref.length)) &
+                   (bucket_count - 1);
+      while (buckets[t][b] != 0) {
+        b = (b + 1) & (bucket_count - 1);
+      }
+      buckets[t][b] = static_cast<uint32_t>(tentries[t].size());
+    }
+  }
+
+  // The symbol table: the definitions of each name, in record order, and
+  // a perfect hash of the names with about four to a group. If the
+  // displacements run out, as they do for two names whose hashes collide,
+  // the names are hashed again with another seed and the slots grown.
+  std::vector<uint32_t> by_name(defs.size());
+  {
+    std::vector<uint32_t> next(strings.size() + 1, 0);
+    for (auto const &d : defs) {
+      next[d.name + 1]++;
+    }
+    std::partial_sum(next.begin(), next.end(), next.begin());
+    for (uint32_t i = 0; i < defs.size(); i++) {
+      by_name[next[defs[i].name]++] = i;
+    }
+  }
+  std::vector<table_entry> names;
+  std::vector<uint64_t> name_hashes;
+  for (size_t i = 0; i < by_name.size(); i++) {
+    uint32_t name = defs[by_name[i]].name;
+    if (names.empty() || names.back().string != name) {
+      names.push_back(table_entry{name, static_cast<uint32_t>(postings.size()),
+                                  0, 0});
+      name_hashes.push_back(hashes[name]);
+    }
+    postings.push_back(by_name[i]);
+    names.back().count++;
+  }
+  std::vector<uint32_t> groups;
+  std::vector<table_entry> slots;
+  uint64_t seed = 0; // the interned hashes are those of seed 0
+  if (!names.empty()) {
+    groups.assign(std::max<size_t>(1, names.size() / 4), 0);
+    uint64_t slot_count = names.size() + names.size() / 4 + 1;
+    std::vector<uint32_t> placed;
+    for (int attempt = 0;; attempt++) {
+      if (place_perfect(name_hashes, slot_count, groups, placed)) {
+        break;
+      }
+      if (attempt == 7) {
+        if (emsg) {
+          *emsg = "Error writing index " + file + ": symbol names hash alike";
+        }
+        return false;
+      }
+      slot_count += slot_count / 8;
+      seed += 0x9e3779b97f4a7c15ull;
+      for (size_t i = 0; i < names.size(); i++) {
+        auto const &ref = strings[names[i].string];
+        name_hashes[i] =
+            fnv1a64(std::string_view(pool.data() + ref.offset, ref.length),
+                    seed);
+      }
+    }
+    slots.assign(slot_count, table_entry{elf_index::none, 0, 0, 0});
+    for (uint64_t i = 0; i < slot_count; i++) {
+      if (placed[i] != 0) {
+        slots[i] = names[placed[i] - 1];
+      }
+    }
+  }
+
+  header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, index_magic, sizeof(index_magic));
+  h.version = index_version;
+  h.byte_order = index_byte_order;
+  h.record_size = sizeof(record);
+  h.table_count = table_count;
+  uint64_t off = align8(sizeof(header));
+  auto place = [&](uint64_t &offset, uint64_t bytes) {
+    offset = off;
+    off = align8(off + bytes);
+  };
+  h.record_count = records.size();
+  place(h.records_offset, records.size() * sizeof(record));
+  h.needed_count = needed.size();
+  place(h.needed_offset, needed.size() * sizeof(uint32_t));
+  h.string_count = strings.size();
+  place(h.strings_offset, strings.size() * sizeof(string_ref));
+  h.pool_size = pool.size();
+  place(h.pool_offset, pool.size());
+  h.posting_count = postings.size();
+  place(h.postings_offset, postings.size() * sizeof(uint32_t));
+  h.symbol_count = defs.size();
+  place(h.symbols_offset, defs.size() * sizeof(symbol_def));
+  h.symbol_groups = groups.size();
+  place(h.groups_offset, groups.size() * sizeof(uint32_t));
+  h.symbol_slots = slots.size();
+  place(h.slots_offset, slots.size() * sizeof(table_entry));
+  h.symbol_seed = seed;
+  for (uint32_t t = 0; t < table_count; t++) {
+    h.tables[t].bucket_count = buckets[t].size();
+    place(h.tables[t].buckets_offset, buckets[t].size() * sizeof(uint32_t));
+    h.tables[t].entry_count = tentries[t].size();
+    place(h.tables[t].entries_offset,
+          tentries[t].size() * sizeof(table_entry));
+  }
+
+  std::string data(off, '\0');
+  auto copy = [&](uint64_t offset, const void *src, size_t bytes) {
+    if (bytes != 0) {
+      memcpy(&data[offset], src, bytes);
+    }
+  };
+  copy(0, &h, sizeof(h));
+  copy(h.records_offset, records.data(), records.size() * sizeof(record));
+  copy(h.needed_offset, needed.data(), needed.size() * sizeof(uint32_t));
+  copy(h.strings_offset, strings.data(), strings.size() * sizeof(string_ref));
+  copy(h.pool_offset, pool.data(), pool.size());
+  copy(h.postings_offset, postings.data(), postings.size() * sizeof(uint32_t));
+  copy(h.symbols_offset, defs.data(), defs.size() * sizeof(symbol_def));
+  copy(h.groups_offset, groups.data(), groups.size() * sizeof(uint32_t));
+  copy(h.slots_offset, slots.data(), slots.size() * sizeof(table_entry));
+  for (uint32_t t = 0; t < table_count; t++) {
+    copy(h.tables[t].buckets_offset, buckets[t].data(),
+         buckets[t].size() * sizeof(uint32_t));
+    copy(h.tables[t].entries_offset, tentries[t].data(),
+         tentries[t].size() * sizeof(table_entry));
+  }
+  if (!replace_file(file, data.data(), data.size())) {
+    if (emsg) {
+      *emsg = "Error writing index " + file + ": " + strerror(errno);
+    }
+    return false;
+  }
+  return true;
+}
+
+} // namespace mz
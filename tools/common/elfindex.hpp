@@ -0,0 +1,138 @@
+///
+#ifndef MZ_ELFINDEX_HPP
+#define MZ_ELFINDEX_HPP
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "elfview.hpp"
+#include "identity.hpp"
+#include "summary.hpp"
+
+namespace mz {
+
+/// The lookup tables of an index. Each maps a string to the records that
+/// carry it; the path table maps every path to its one record.
+enum index_table : uint32_t {
+  table_path,
+  table_soname,
+  table_rpath,
+  table_runpath,
+  table_needed, /// a DT_NEEDED name to the files that need it
+  table_count
+};
+
+/// A dynamic symbol a file exports, with its version.
+struct index_symbol {
+  std::string name;
+  std::string version; /// empty if it has none
+  bool hidden{false};  /// not the default version of name
+};
+
+/// One file of an index as the builder sees it.
+struct index_entry {
+  std::string path;
+  file_identity id;
+  elf_summary summary; /// not valid for files that are not ELF
+  std::vector<index_symbol> symbols;
+};
+
+/// The exported dynamic symbols of an image, as an index records them.
+bool read_index_symbols(const elf_view &v, std::vector<index_symbol> &out);
+
+/// A definition of a symbol in an index, pointing into its mapping.
+struct index_definition {
+  uint32_t record{UINT32_MAX};
+  std::string_view version;
+  bool hidden{false};
+};
+
+/// Record numbers in an index, pointing into its mapping.
+struct index_postings {
+  const uint32_t *first{nullptr};
+  const uint32_t *last{nullptr};
+  const uint32_t *begin() const { return first; }
+  const uint32_t *end() const { return last; }
+  size_t size() const { return static_cast<size_t>(last - first); }
+  bool empty() const { return first == last; }
+};
+
+/// elf_index is a read-only view of an index file, queried in place through
+/// the mapping. An index describes a set of files (typically a sysroot):
+///
+///   header    magic, version, section offsets and table descriptors
+///   records   fixed-size, identity, header fields, string ids
+///   needed    string ids of every record's DT_NEEDED entries
+///   strings   {offset, length} of every interned string, then the pool
+///   tables    per index_table: open-addressed buckets of entries
+///             {string id, first posting, posting count}
+///   postings  record numbers, grouped by table entry; definition numbers
+///             for the symbol table
+///   symbols   every record's exported symbols {name, version, record}
+///   symbol table
+///             a perfect hash of the symbol names, hashed with the seed
+///             in the header: a displacement per group of names, and
+///             slots of entries like those above
+///
+/// All strings are interned, so a library named by a thousand DT_NEEDED
+/// entries is stored once, as is a symbol name defined by many. A name
+/// hashes to its group, and the group's displacement to the one slot it
+/// can be in, so a symbol lookup is one probe and one string compare.
+/// Readers check the bounds of everything they touch; a damaged index
+/// answers nothing rather than crash.
+class elf_index {
+public:
+  static constexpr uint32_t none = UINT32_MAX;
+  elf_index() = default;
+  elf_index(const elf_index &) = delete;
+  elf_index &operator=(const elf_index &) = delete;
+  ~elf_index();
+  bool open(const std::string &file, std::string *emsg);
+  bool is_open() const { return header_ != nullptr; }
+  size_t size() const;
+  /// Record number of path, or none.
+  uint32_t find_path(std::string_view path) const;
+  /// Records whose table string equals key, in record order.
+  index_postings lookup(index_table table, std::string_view key) const;
+  std::string_view path(uint32_t record) const;
+  bool identity(uint32_t record, file_identity &id) const;
+  bool summary(uint32_t record, elf_summary &s) const;
+  /// The ELF files that need soname, in breadth-first order. When
+  /// transitive, also the files that need those files' SONAMEs, and so on.
+  /// A DT_NEEDED name resolves only to libraries of the consumer's class
+  /// and machine, so a 32-bit consumer does not pull in the dependents of
+  /// a 64-bit library of the same name. Search paths are not followed:
+  /// every library with the SONAME and the consumer's class and machine
+  /// counts, so the result is a superset of what the loader would bind
+  /// when a sysroot holds several copies of a library.
+  std::vector<uint32_t> dependents(std::string_view soname,
+                                   bool transitive) const;
+  /// The exported symbols of a record.
+  bool symbols(uint32_t record, std::vector<index_symbol> &out) const;
+  /// The definitions of a symbol name, in record order.
+  std::vector<index_definition> definitions(std::string_view name) const;
+
+private:
+  friend bool write_elf_index(const std::string &file,
+                              const std::vector<index_entry> &entries,
+                              std::string *emsg);
+  struct header;
+  struct record;
+  struct table_entry;
+  struct symbol_def;
+  const record *at(uint32_t index) const;
+  std::string_view string(uint32_t id) const;
+  const char *base_{nullptr};
+  size_t size_{0};
+  const header *header_{nullptr};
+};
+
+/// Write entries as an index file, replacing it atomically.
+bool write_elf_index(const std::string &file,
+                     const std::vector<index_entry> &entries,
+                     std::string *emsg);
+
+} // namespace mz
+
+#endif
@@ -0,0 +1,274 @@
+///
+#include <algorithm>
+#include <unordered_set>
+#include <vector>
+#include "elfreloc.hpp"
+#include "elftypes.hpp"
+
+#ifndef DT_RELR
+#define DT_RELRSZ 35
+#define DT_RELR 36
+#endif
+
+namespace mz {
+
+namespace {
+
+/// The relocation types of a machine the report tells apart.
+struct reloc_types {
+  uint32_t relative;
+  uint32_t copy;
+  uint32_t irelative;
+};
+
+// 0 for a type the machine does not have. Relocations of machines not
+// listed are told apart by whether they name a symbol only.
+reloc_types machine_types(uint16_t machine) {
+  switch (machine) {
+  case EM_X86_64:
+    return {R_X86_64_RELATIVE, R_X86_64_COPY, R_X86_64_IRELATIVE};
+  case EM_386:
+    return {R_386_RELATIVE, R_386_COPY, R_386_IRELATIVE};
+  case EM_AARCH64:
+    return {R_AARCH64_RELATIVE, R_AARCH64_COPY, R_AARCH64_IRELATIVE};
+  case EM_ARM:
+    return {R_ARM_RELATIVE, R_ARM_COPY, R_ARM_IRELATIVE};
+  case EM_PPC:
+    return {R_PPC_RELATIVE, R_PPC_COPY, R_PPC_IRELATIVE};
+  case EM_PPC64:
+    return {R_PPC64_RELATIVE, R_PPC64_COPY, R_PPC64_IRELATIVE};
+  case EM_S390:
+    return {R_390_RELATIVE, R_390_COPY, R_390_IRELATIVE};
+  case EM_SPARC:
+  case EM_SPARCV9:
+    return {R_SPARC_RELATIVE, R_SPARC_COPY, R_SPARC_IRELATIVE};
+  case EM_RISCV:
+    return {R_RISCV_RELATIVE, R_RISCV_COPY, 58}; // R_RISCV_IRELATIVE
+  case 258: // EM_LOONGARCH: R_LARCH_RELATIVE, _COPY, _IRELATIVE
+    return {3, 4, 12};
+  case EM_MIPS:
+    // R_MIPS_REL32 against symbol 0 is its relative relocation.
+    return {R_MIPS_REL32, R_MIPS_COPY, 0};
+  default:
+    break;
+  }
+  return {0, 0, 0};
+}
+
+/// reloc_reader walks the relocation tables of one image whose class and
+/// byte order are known at compile time.
+template <typename E, bool Swap> class reloc_reader : elf_bytes<Swap> {
+public:
+  using word = typename E::word;
+  static constexpr uint64_t word_size = sizeof(word);
+  static constexpr uint64_t word_bits = word_size * 8;
+
+  reloc_reader(const elf_view &v, uint64_t page_size,
+               std::vector<uint32_t> *copied = nullptr)
+      : elf_bytes<Swap>(v.image, v.image_size), v_(v),
+        types_(machine_types(v.machine)), page_size_(page_size),
+        copied_(copied) {}
+
+  bool read(reloc_stats &s) {
+    uint64_t flags = 0, flags1 = 0;
+    v_.find(DT_FLAGS, flags);
+    v_.find(DT_FLAGS_1, flags1);
+    s.bind_now = (flags & DF_BIND_NOW) != 0 || (flags1 & DF_1_NOW) != 0;
+    uint64_t jmprel = 0, pltrel = DT_RELA;
+    v_.find(DT_PLTRELSZ, s.plt_size);
+    v_.find(DT_PLTREL, pltrel);
+    bool has_plt = v_.find(DT_JMPREL, jmprel) && s.plt_size != 0;
+    uint64_t addr = 0;
+    s.rela = v_.find(DT_RELA, addr);
+    s.entsize = s.rela ? sizeof(typename E::rela) : sizeof(typename E::rel);
+    if (s.rela) {
+      v_.find(DT_RELACOUNT, s.count);
+    } else {
+      v_.find(DT_RELCOUNT, s.count);
+    }
+    for (bool rela : {true, false}) {
+      uint64_t size = 0;
+      if (!v_.find(rela ? DT_RELA : DT_REL, addr) ||
+          !v_.find(rela ? DT_RELASZ : DT_RELSZ, size)) {
+        continue;
+      }
+      // Some linkers count the PLT relocations in the table they end.
+      if (has_plt && jmprel > addr && jmprel + s.plt_size == addr + size) {
+        size -= s.plt_size;
+      }
+      s.size += size;
+      if (!table(addr, size, rela, false, s)) {
+        return false;
+      }
+    }
+    if (has_plt) {
+      if (!table(jmprel, s.plt_size, pltrel == DT_RELA, true, s)) {
+        return false;
+      }
+      s.plt = s.plt_size / (pltrel == DT_RELA ? sizeof(typename E::rela)
+                                              : sizeof(typename E::rel));
+    }
+    v_.find(DT_RELRSZ, s.relr_size);
+    if (s.relr_size != 0 &&
+        (!v_.find(DT_RELR, addr) || !relr(addr, s.relr_size, s))) {
+      return false;
+    }
+    s.symbols = symbols_.size();
+    std::sort(pages_.begin(), pages_.end());
+    s.pages = static_cast<uint64_t>(
+        std::unique(pages_.begin(), pages_.end()) - pages_.begin());
+    std::sort(packable_.begin(), packable_.end());
+    s.packable = packable_.size();
+    s.packed_size = packed_words() * word_size;
+    return true;
+  }
+
+private:
+  using elf_bytes<Swap>::get;
+  using elf_bytes<Swap>::load;
+  using elf_bytes<Swap>::size_;
+  template <typename T> T read(uint64_t off) const {
+    return elf_bytes<Swap>::template read<T>(off);
+  }
+
+  bool table(uint64_t addr, uint64_t size, bool rela, bool plt,
+             reloc_stats &s) {
+    uint64_t off = 0;
+    if (!v_.offset_of(addr, off) || off > size_ || size > size_ - off) {
+      return false;
+    }
+    return rela ? entries<typename E::rela>(off, size, plt, s)
+                : entries<typename E::rel>(off, size, plt, s);
+  }
+
+  template <typename R>
+  bool entries(uint64_t off, uint64_t size, bool plt, reloc_stats &s) {
+    for (uint64_t at = off; at + sizeof(R) <= off + size; at += sizeof(R)) {
+      R r;
+      load(at, r);
+      uint64_t where = get(r.r_offset);
+      uint64_t info = get(r.r_info);
+      uint64_t sym = word_size == 8 ? info >> 32 : info >> 8;
+      uint32_t type = static_cast<uint32_t>(word_size == 8 ? info & 0xffffffff
+                                                           : info & 0xff);
+      pages_.push_back(where / page_size_);
+      if (plt) {
+        continue;
+      }
+      if (sym == 0 && types_.irelative != 0 && type == types_.irelative) {
+        s.ifuncs++;
+      } else if (sym == 0 &&
+                 (types_.relative == 0 || type == types_.relative)) {
+        s.relative++;
+        if (where % word_size == 0) {
+          packable_.push_back(where);
+        }
+      } else if (sym != 0) {
+        s.symbolic++;
+        if (types_.copy != 0 && type == types_.copy) {
+          s.copies++;
+          if (copied_ != nullptr) {
+            copied_->push_back(static_cast<uint32_t>(sym));
+          }
+        }
+        symbols_.insert(sym);
+      } else {
+        s.other++;
+      }
+    }
+    return true;
+  }
+
+  // An even entry is the address of a relocation; an odd one a bitmap of
+  // those in the word_bits - 1 words after the last address or bitmap.
+  bool relr(uint64_t addr, uint64_t size, reloc_stats &s) {
+    uint64_t off = 0;
+    if (!v_.offset_of(addr, off) || off > size_ || size > size_ - off) {
+      return false;
+    }
+    uint64_t base = 0;
+    for (uint64_t at = off; at + word_size <= off + size; at += word_size) {
+      uint64_t entry = read<word>(at);
+      if ((entry & 1) == 0) {
+        pages_.push_back(entry / page_size_);
+        s.relr_relative++;
+        base = entry + word_size;
+        continue;
+      }
+      for (uint64_t bit = 1; bit < word_bits; bit++) {
+        if ((entry >> bit & 1) != 0) {
+          pages_.push_back((base + (bit - 1) * word_size) / page_size_);
+          s.relr_relative++;
+        }
+      }
+      base += (word_bits - 1) * word_size;
+    }
+    return true;
+  }
+
+  // The words DT_RELR takes for packable_, encoded as linkers do: an
+  // address, then as many bitmaps as the following relocations fill.
+  uint64_t packed_words() const {
+    uint64_t words = 0;
+    size_t i = 0, n = packable_.size();
+    while (i < n) {
+      uint64_t base = packable_[i++] + word_size;
+      words++;
+      for (;;) {
+        bool any = false;
+        uint64_t span = (word_bits - 1) * word_size;
+        for (; i < n && packable_[i] - base < span; i++) {
+          any = true;
+        }
+        if (!any) {
+          break;
+        }
+        words++;
+        base += span;
+      }
+    }
+    return words;
+  }
+
+  const elf_view &v_;
+  reloc_types types_;
+  uint64_t page_size_;
+  std::vector<uint32_t> *copied_;
+  std::vector<uint64_t> pages_;
+  std::vector<uint64_t> packable_;
+  std::unordered_set<uint64_t> symbols_;
+};
+
+} // namespace
+
+bool read_relocations(const elf_view &v, reloc_stats &s,
+                      uint64_t page_size) {
+  s = reloc_stats();
+  if (v.image == nullptr || page_size == 0) {
+    return false;
+  }
+  bool swap = (v.endian == ELFDATA2MSB) != host_msb;
+  if (v.elfclass == ELFCLASS64) {
+    return swap ? reloc_reader<elf64_types, true>(v, page_size).read(s)
+                : reloc_reader<elf64_types, false>(v, page_size).read(s);
+  }
+  return swap ? reloc_reader<elf32_types, true>(v, page_size).read(s)
+              : reloc_reader<elf32_types, false>(v, page_size).read(s);
+}
+
+bool read_copy_relocations(const elf_view &v, std::vector<uint32_t> &symbols) {
+  symbols.clear();
+  if (v.image == nullptr) {
+    return false;
+  }
+  reloc_stats s;
+  bool swap = (v.endian == ELFDATA2MSB) != host_msb;
+  if (v.elfclass == ELFCLASS64) {
+    return swap ? reloc_reader<elf64_types, true>(v, 4096, &symbols).read(s)
+                : reloc_reader<elf64_types, false>(v, 4096, &symbols).read(s);
+  }
+  return swap ? reloc_reader<elf32_types, true>(v, 4096, &symbols).read(s)
+              : reloc_reader<elf32_types, false>(v, 4096, &symbols).read(s);
+}
+
+} // namespace mz
@@ -0,0 +1,57 @@
+///
+#ifndef MZ_ELFRELOC_HPP
+#define MZ_ELFRELOC_HPP
+#include <cstdint>
+#include <vector>
+#include "elfview.hpp"
+
+namespace mz {
+
+/// What the dynamic relocations of an image cost the loader at startup.
+/// Relative relocations only add the load address; symbolic ones look a
+/// symbol up first. PLT relocations are resolved at startup under
+/// BIND_NOW and on first call otherwise.
+struct reloc_stats {
+  bool rela{false};     /// DT_RELA entries rather than DT_REL ones
+  uint64_t entsize{0};  /// the size of one
+  uint64_t size{0};     /// DT_RELASZ or DT_RELSZ, less the PLT relocations
+  uint64_t count{0};    /// DT_RELACOUNT or DT_RELCOUNT
+  uint64_t relative{0}; /// relative relocations of the table
+  uint64_t symbolic{0}; /// relocations of the table that name a symbol
+  uint64_t copies{0};   /// copy relocations, among the symbolic ones
+  uint64_t ifuncs{0};   /// IRELATIVE relocations, which call a resolver
+  uint64_t other{0};    /// the rest, such as TLS offsets of the object
+  uint64_t symbols{0};  /// the distinct symbols the symbolic ones name
+  uint64_t plt{0};      /// DT_JMPREL relocations
+  uint64_t plt_size{0}; /// DT_PLTRELSZ
+  bool bind_now{false}; /// DF_BIND_NOW or DF_1_NOW
+  uint64_t relr_size{0};     /// DT_RELRSZ; 0 without DT_RELR
+  uint64_t relr_relative{0}; /// the relative relocations it encodes
+  uint64_t pages{0}; /// the pages all of them write to, the PLT included
+  /// The relative relocations of the table DT_RELR could take, and the
+  /// size their DT_RELR encoding would have.
+  uint64_t packable{0};
+  uint64_t packed_size{0};
+  bool has_relr() const { return relr_size != 0; }
+  /// The relocations of the table.
+  uint64_t total() const { return relative + symbolic + ifuncs + other; }
+  /// What -z pack-relative-relocs would save of the file.
+  uint64_t saving() const {
+    uint64_t now = packable * entsize;
+    return now > packed_size ? now - packed_size : 0;
+  }
+};
+
+/// Read the dynamic relocation tables of an image read by read_elf_view.
+/// Pages are of page_size bytes. False if a table runs out of the file.
+bool read_relocations(const elf_view &v, reloc_stats &s,
+                      uint64_t page_size = 4096);
+
+/// Set symbols to the dynamic symbol indices the copy relocations of an
+/// image name: the library data an executable holds its own copy of.
+/// False if a relocation table runs out of the file.
+bool read_copy_relocations(const elf_view &v, std::vector<uint32_t> &symbols);
+
+} // namespace mz
+
+#endif
@@ -0,0 +1,260 @@
+///
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include "elfsym.hpp"
+#include "elftypes.hpp"
+
+namespace mz {
+
+namespace {
+
+constexpr uint16_t versym_hidden = 0x8000;
+
+/// symbol_reader reads the symbol and version tables of one image whose
+/// class and byte order are known at compile time.
+template <typename E, bool Swap> class symbol_reader : elf_bytes<Swap> {
+public:
+  explicit symbol_reader(const elf_view &v)
+      : elf_bytes<Swap>(v.image, v.image_size), v_(v) {}
+
+  uint64_t count() const {
+    uint64_t addr = 0, off = 0;
+    if (v_.find(DT_HASH, addr) && v_.offset_of(addr, off)) {
+      // nbucket, nchain: there is a chain entry per symbol.
+      return read<uint32_t>(off + 4);
+    }
+    // The GNU hash table leaves out the undefined symbols after the last
+    // it hashes, so the section header, if any, is exact.
+    uint64_t sections = section_count();
+    if (sections != 0) {
+      return sections;
+    }
+    if (v_.find(DT_GNU_HASH, addr) && v_.offset_of(addr, off)) {
+      return gnu_count(off);
+    }
+    uint64_t symtab = 0, strtab = 0;
+    if (v_.find(DT_SYMTAB, symtab) && v_.find(DT_STRTAB, strtab) &&
+        strtab > symtab) {
+      return (strtab - symtab) / sizeof(typename E::sym);
+    }
+    return 0;
+  }
+
+  bool read(std::vector<elf_symbol> &syms) {
+    syms.clear();
+    uint64_t addr = 0, symoff = 0, strsz = 0;
+    if (!v_.find(DT_SYMTAB, addr)) {
+      return true;
+    }
+    if (!v_.offset_of(addr, symoff)) {
+      return false;
+    }
+    if (!v_.find(DT_STRTAB, addr) || !v_.offset_of(addr, stroff_)) {
+      return false;
+    }
+    v_.find(DT_STRSZ, strsz);
+    strsz_ = std::min<uint64_t>(strsz, stroff_ <= size_ ? size_ - stroff_ : 0);
+    uint64_t n = count();
+    if (n > (size_ - std::min<uint64_t>(symoff, size_)) /
+                sizeof(typename E::sym)) {
+      return false;
+    }
+    read_verdefs();
+    read_verneeds();
+    uint64_t versym = 0;
+    bool has_versym =
+        v_.find(DT_VERSYM, addr) && v_.offset_of(addr, versym);
+    syms.resize(n);
+    for (uint64_t i = 0; i < n; i++) {
+      typename E::sym s;
+      load(symoff + i * sizeof(s), s);
+      auto &out = syms[i];
+      out.name = string(get(s.st_name));
+      out.value = get(s.st_value);
+      out.size = get(s.st_size);
+      out.shndx = get(s.st_shndx);
+      out.bind = static_cast<uint8_t>(s.st_info >> 4);
+      out.type = static_cast<uint8_t>(s.st_info & 0xf);
+      out.visibility = static_cast<uint8_t>(s.st_other & 0x3);
+      if (!has_versym) {
+        continue;
+      }
+      uint16_t ver = read<uint16_t>(versym + i * 2);
+      out.hidden = (ver & versym_hidden) != 0;
+      ver &= static_cast<uint16_t>(~versym_hidden);
+      if (ver < 2) {
+        continue;
+      }
+      // A definition may carry a needed version too: that of a copy
+      // relocation in an executable.
+      auto def = out.defined() ? defs_.find(ver) : defs_.end();
+      if (def != defs_.end()) {
+        out.version = def->second;
+        continue;
+      }
+      auto need = needs_.find(ver);
+      if (need != needs_.end()) {
+        out.version = need->second.first;
+        out.version_file = need->second.second;
+      }
+    }
+    return true;
+  }
+
+private:
+  using elf_bytes<Swap>::get;
+  using elf_bytes<Swap>::load;
+  using elf_bytes<Swap>::size_;
+  template <typename T> T read(uint64_t off) const {
+    return elf_bytes<Swap>::template read<T>(off);
+  }
+
+  std::string_view string(uint64_t off) const {
+    if (off >= strsz_) {
+      return std::string_view();
+    }
+    const char *first = this->data_ + stroff_ + off;
+    size_t max = static_cast<size_t>(strsz_ - off);
+    return std::string_view(first, strnlen(first, max));
+  }
+
+  // The size of the SHT_DYNSYM section over its entry size.
+  uint64_t section_count() const {
+    typename E::ehdr h;
+    if (!load(0, h)) {
+      return 0;
+    }
+    uint64_t shoff = get(h.e_shoff);
+    uint16_t shnum = get(h.e_shnum);
+    uint16_t shentsize = get(h.e_shentsize);
+    if (shentsize < sizeof(typename E::shdr)) {
+      return 0;
+    }
+    for (uint16_t i = 0; i < shnum; i++) {
+      typename E::shdr sh;
+      if (!load(shoff + uint64_t(i) * shentsize, sh)) {
+        return 0;
+      }
+      if (get(sh.sh_type) == SHT_DYNSYM) {
+        return get(sh.sh_size) / sizeof(typename E::sym);
+      }
+    }
+    return 0;
+  }
+
+  // The last symbol in a chain has the low bit of its hash set; the table
+  // covers the symbols from symoffset to the end of the longest-numbered
+  // chain.
+  uint64_t gnu_count(uint64_t off) const {
+    uint32_t nbuckets = read<uint32_t>(off);
+    uint32_t symoffset = read<uint32_t>(off + 4);
+    uint32_t bloom_size = read<uint32_t>(off + 8);
+    uint64_t buckets =
+        off + 16 + uint64_t(bloom_size) * sizeof(typename E::word);
+    uint64_t chains = buckets + uint64_t(nbuckets) * 4;
+    if (chains > size_) {
+      return 0;
+    }
+    uint32_t last = 0;
+    for (uint32_t b = 0; b < nbuckets; b++) {
+      last = std::max(last, read<uint32_t>(buckets + uint64_t(b) * 4));
+    }
+    if (last < symoffset) {
+      return symoffset;
+    }
+    for (uint64_t at = chains + uint64_t(last - symoffset) * 4; at + 4 <= size_;
+         at += 4, last++) {
+      if ((read<uint32_t>(at) & 1) != 0) {
+        break;
+      }
+    }
+    return uint64_t(last) + 1;
+  }
+
+  // Verdef: version, flags, ndx, cnt (16 bits each), hash, aux, next; the
+  // first Verdaux names the version.
+  void read_verdefs() {
+    uint64_t addr = 0, off = 0, num = 0;
+    if (!v_.find(DT_VERDEF, addr) || !v_.offset_of(addr, off)) {
+      return;
+    }
+    v_.find(DT_VERDEFNUM, num);
+    for (uint64_t i = 0; i < num && off + 20 <= size_; i++) {
+      uint16_t ndx = read<uint16_t>(off + 4);
+      uint32_t aux = read<uint32_t>(off + 12);
+      uint32_t next = read<uint32_t>(off + 16);
+      defs_.emplace(ndx, string(read<uint32_t>(off + aux)));
+      if (next == 0) {
+        break;
+      }
+      off += next;
+    }
+  }
+
+  // Verneed: version, cnt (16 bits), file, aux, next; Vernaux: hash,
+  // flags, other (16 bits), name, next.
+  void read_verneeds() {
+    uint64_t addr = 0, off = 0, num = 0;
+    if (!v_.find(DT_VERNEED, addr) || !v_.offset_of(addr, off)) {
+      return;
+    }
+    v_.find(DT_VERNEEDNUM, num);
+    for (uint64_t i = 0; i < num && off + 16 <= size_; i++) {
+      uint16_t cnt = read<uint16_t>(off + 2);
+      auto file = string(read<uint32_t>(off + 4));
+      uint64_t aux = off + read<uint32_t>(off + 8);
+      for (uint16_t j = 0; j < cnt && aux + 16 <= size_; j++) {
+        uint16_t other = read<uint16_t>(aux + 6);
+        needs_.emplace(other, std::make_pair(string(read<uint32_t>(aux + 8)),
+                                             file));
+        uint32_t next = read<uint32_t>(aux + 12);
+        if (next == 0) {
+          break;
+        }
+        aux += next;
+      }
+      uint32_t next = read<uint32_t>(off + 12);
+      if (next == 0) {
+        break;
+      }
+      off += next;
+    }
+  }
+
+  const elf_view &v_;
+  uint64_t stroff_{0};
+  uint64_t strsz_{0};
+  std::unordered_map<uint16_t, std::string_view> defs_;
+  std::unordered_map<uint16_t, std::pair<std::string_view, std::string_view>>
+      needs_;
+};
+
+template <typename F> auto dispatch(const elf_view &v, F &&fn) {
+  bool swap = (v.endian == ELFDATA2MSB) != host_msb;
+  if (v.elfclass == ELFCLASS64) {
+    return swap ? fn(symbol_reader<elf64_types, true>(v))
+                : fn(symbol_reader<elf64_types, false>(v));
+  }
+  return swap ? fn(symbol_reader<elf32_types, true>(v))
+              : fn(symbol_reader<elf32_types, false>(v));
+}
+
+} // namespace
+
+uint64_t dynamic_symbol_count(const elf_view &v) {
+  if (v.image == nullptr) {
+    return 0;
+  }
+  return dispatch(v, [](auto &&r) { return r.count(); });
+}
+
+bool read_dynamic_symbols(const elf_view &v, std::vector<elf_symbol> &syms) {
+  syms.clear();
+  if (v.image == nullptr) {
+    return false;
+  }
+  return dispatch(v, [&](auto &&r) { return r.read(syms); });
+}
+
+} // namespace mz
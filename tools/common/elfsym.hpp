@@ -0,0 +1,57 @@
+///
+#ifndef MZ_ELFSYM_HPP
+#define MZ_ELFSYM_HPP
+#include <cstdint>
+#include <elf.h>
+#include <string_view>
+#include <vector>
+#include "elfview.hpp"
+
+namespace mz {
+
+/// A symbol of the dynamic symbol table, with its version, viewed in place.
+struct elf_symbol {
+  std::string_view name;
+  /// The version it is defined with, or the version it needs if undefined;
+  /// empty if it has none or the file's base version.
+  std::string_view version;
+  /// For a needed version, the DT_NEEDED name of the file it comes from.
+  /// An executable's copies of library data are defined with one.
+  std::string_view version_file;
+  uint64_t value{0};
+  uint64_t size{0};
+  uint16_t shndx{0};
+  uint8_t bind{0};       /// STB_*
+  uint8_t type{0};       /// STT_*
+  uint8_t visibility{0}; /// STV_*
+  /// A definition of a version other than the default one, which only
+  /// references asking for that version bind to.
+  bool hidden{false};
+  bool defined() const { return shndx != 0; }
+  /// A definition other objects can bind to: global, weak or unique, not
+  /// hidden by its visibility, neither an executable's copy of library
+  /// data nor the absolute symbol naming a version definition.
+  bool exported() const {
+    return defined() && !name.empty() &&
+           (bind == STB_GLOBAL || bind == STB_WEAK ||
+            bind == STB_GNU_UNIQUE) &&
+           (visibility == STV_DEFAULT || visibility == STV_PROTECTED) &&
+           version_file.empty() && !(shndx == SHN_ABS && name == version);
+  }
+};
+
+/// The number of dynamic symbols: from DT_HASH, else the SHT_DYNSYM
+/// section, else DT_GNU_HASH, which covers the symbols up to the last one
+/// it hashes, else the symbols up to the string table when it follows
+/// them, as linkers lay them out. 0 if it cannot be told.
+uint64_t dynamic_symbol_count(const elf_view &v);
+
+/// Read the dynamic symbol table of an image read by read_elf_view, in
+/// index order (the null symbol included), with the versions of
+/// DT_VERSYM, DT_VERDEF and DT_VERNEED. False if the tables the dynamic
+/// table points to are out of the file.
+bool read_dynamic_symbols(const elf_view &v, std::vector<elf_symbol> &syms);
+
+} // namespace mz
+
+#endif
@@ -0,0 +1,77 @@
+///
+#ifndef MZ_ELFTYPES_HPP
+#define MZ_ELFTYPES_HPP
+#include <cstdint>
+#include <cstring>
+#include <elf.h>
+#include <type_traits>
+
+namespace mz {
+
+/// The structures of one ELF class, for readers templated on it.
+struct elf32_types {
+  using ehdr = Elf32_Ehdr;
+  using phdr = Elf32_Phdr;
+  using shdr = Elf32_Shdr;
+  using dyn = Elf32_Dyn;
+  using sym = Elf32_Sym;
+  using rel = Elf32_Rel;
+  using rela = Elf32_Rela;
+  using word = uint32_t; /// an address, and a RELR entry
+};
+
+struct elf64_types {
+  using ehdr = Elf64_Ehdr;
+  using phdr = Elf64_Phdr;
+  using shdr = Elf64_Shdr;
+  using dyn = Elf64_Dyn;
+  using sym = Elf64_Sym;
+  using rel = Elf64_Rel;
+  using rela = Elf64_Rela;
+  using word = uint64_t;
+};
+
+constexpr bool host_msb = __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__;
+
+inline uint16_t byteswap(uint16_t v) { return __builtin_bswap16(v); }
+inline uint32_t byteswap(uint32_t v) { return __builtin_bswap32(v); }
+inline uint64_t byteswap(uint64_t v) { return __builtin_bswap64(v); }
+
+/// elf_bytes reads the fields of an image whose byte order is known at
+/// compile time, so every read is a plain load, swapped or not.
+template <bool Swap> class elf_bytes {
+public:
+  elf_bytes(const char *data, uint64_t size) : data_(data), size_(size) {}
+
+  template <typename T> T get(T v) const {
+    if constexpr (Swap && sizeof(T) > 1) {
+      using U = std::make_unsigned_t<T>;
+      return static_cast<T>(byteswap(static_cast<U>(v)));
+    } else {
+      return v;
+    }
+  }
+
+  // The mapping need not be aligned for T, so fields are copied out.
+  template <typename T> bool load(uint64_t off, T &out) const {
+    if (off > size_ || sizeof(T) > size_ - off) {
+      return false;
+    }
+    memcpy(&out, data_ + off, sizeof(T));
+    return true;
+  }
+
+  /// A field of type T at off, 0 if it is past the end.
+  template <typename T> T read(uint64_t off) const {
+    T v{};
+    return load(off, v) ? get(v) : T{};
+  }
+
+protected:
+  const char *data_;
+  uint64_t size_;
+};
+
+} // namespace mz
+
+#endif
@@ -0,0 +1,347 @@
+///
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "elftypes.hpp"
+#include "elfview.hpp"
+
+namespace mz {
+
+namespace {
+
+/// elf_reader walks one image whose class and byte order are known at
+/// compile time, so every field read is a plain load, swapped or not.
+template <typename E, bool Swap> class elf_reader : elf_bytes<Swap> {
+public:
+  elf_reader(const char *data, size_t size) : elf_bytes<Swap>(data, size) {}
+
+  bool read(elf_view &v) {
+    typename E::ehdr h;
+    if (!load(0, h)) {
+      return false;
+    }
+    v.type = get(h.e_type);
+    v.machine = get(h.e_machine);
+    v.image = data_;
+    v.image_size = size_;
+    if (!read_loads(h, v)) {
+      return false;
+    }
+    uint64_t dynoff = 0, dynsize = 0;
+    if (!find_dynamic(h, dynoff, dynsize)) {
+      return false;
+    }
+    if (dynsize == 0) {
+      return true;
+    }
+    uint64_t count = dynsize / sizeof(typename E::dyn);
+    // The string table comes first: the dynamic table may name strings
+    // before DT_STRTAB.
+    uint64_t strtab = 0, strsz = 0;
+    bool has_strtab = false;
+    for (uint64_t i = 0; i < count; i++) {
+      typename E::dyn d;
+      if (!load(dynoff + i * sizeof(d), d)) {
+        return false;
+      }
+      auto tag = get(d.d_tag);
+      if (tag == DT_NULL) {
+        count = i;
+        break;
+      }
+      v.dyns.push_back(elf_dyn{static_cast<int64_t>(tag),
+                               static_cast<uint64_t>(get(d.d_un.d_val))});
+      if (tag == DT_STRTAB) {
+        has_strtab = true;
+        strtab = get(d.d_un.d_ptr);
+      } else if (tag == DT_STRSZ) {
+        strsz = get(d.d_un.d_val);
+      }
+    }
+    if (strtab_offset_ == none) {
+      if (!has_strtab || !v.offset_of(strtab, strtab_offset_)) {
+        return false;
+      }
+      strtab_size_ = strsz;
+    }
+    if (strtab_offset_ > size_) {
+      return false;
+    }
+    // Strings running past the end of the file end with it.
+    strtab_size_ = std::min<uint64_t>(strtab_size_, size_ - strtab_offset_);
+    v.dynamic = true;
+    for (uint64_t i = 0; i < count; i++) {
+      typename E::dyn d;
+      load(dynoff + i * sizeof(d), d);
+      auto off = get(d.d_un.d_val);
+      switch (get(d.d_tag)) {
+      case DT_NEEDED: {
+        elf_string_view s;
+        if (!string(off, s)) {
+          return false;
+        }
+        v.needed.push_back(s.value);
+      } break;
+      case DT_SONAME:
+        if (!first_string(off, v.soname)) {
+          return false;
+        }
+        break;
+      case DT_RPATH:
+        if (!first_string(off, v.rpath)) {
+          return false;
+        }
+        break;
+      case DT_RUNPATH:
+        if (!first_string(off, v.runpath)) {
+          return false;
+        }
+        break;
+      default:
+        break;
+      }
+    }
+    return true;
+  }
+
+private:
+  static constexpr uint64_t none = UINT64_MAX;
+  using elf_bytes<Swap>::get;
+  using elf_bytes<Swap>::load;
+  using elf_bytes<Swap>::data_;
+  using elf_bytes<Swap>::size_;
+
+  // The file range of the dynamic table: PT_DYNAMIC, or SHT_DYNAMIC for
+  // files whose program headers do not say. Its size is 0 if there is none.
+  // The section header fallback also fixes the string table through
+  // sh_link, as it may have no PT_LOAD to translate DT_STRTAB with.
+  bool find_dynamic(const typename E::ehdr &h, uint64_t &off,
+                    uint64_t &size) {
+    uint64_t phoff = get(h.e_phoff);
+    uint16_t phnum = get(h.e_phnum);
+    uint16_t phentsize = get(h.e_phentsize);
+    if (phnum != 0 && phentsize < sizeof(typename E::phdr)) {
+      return false;
+    }
+    for (uint16_t i = 0; i < phnum; i++) {
+      typename E::phdr p;
+      if (!load(phoff + uint64_t(i) * phentsize, p)) {
+        return false;
+      }
+      if (get(p.p_type) == PT_DYNAMIC) {
+        off = get(p.p_offset);
+        size = get(p.p_filesz);
+        return true;
+      }
+    }
+    uint64_t shoff = get(h.e_shoff);
+    uint16_t shnum = get(h.e_shnum);
+    uint16_t shentsize = get(h.e_shentsize);
+    if (shnum != 0 && shentsize < sizeof(typename E::shdr)) {
+      return false;
+    }
+    for (uint16_t i = 0; i < shnum; i++) {
+      typename E::shdr s;
+      if (!load(shoff + uint64_t(i) * shentsize, s)) {
+        return false;
+      }
+      if (get(s.sh_type) != SHT_DYNAMIC) {
+        continue;
+      }
+      typename E::shdr str;
+      auto link = get(s.sh_link);
+      if (link >= shnum || !load(shoff + uint64_t(link) * shentsize, str)) {
+        return false;
+      }
+      off = get(s.sh_offset);
+      size = get(s.sh_size);
+      strtab_offset_ = get(str.sh_offset);
+      strtab_size_ = get(str.sh_size);
+      return true;
+    }
+    size = 0;
+    return true;
+  }
+
+  // The PT_LOAD segments, which translate addresses to file offsets.
+  bool read_loads(const typename E::ehdr &h, elf_view &v) const {
+    uint64_t phoff = get(h.e_phoff);
+    uint16_t phnum = get(h.e_phnum);
+    uint16_t phentsize = get(h.e_phentsize);
+    if (phnum != 0 && phentsize < sizeof(typename E::phdr)) {
+      return false;
+    }
+    for (uint16_t i = 0; i < phnum; i++) {
+      typename E::phdr p;
+      if (!load(phoff + uint64_t(i) * phentsize, p)) {
+        return false;
+      }
+      if (get(p.p_type) == PT_LOAD) {
+        v.loads.push_back(
+            elf_segment{get(p.p_vaddr), get(p.p_offset), get(p.p_filesz)});
+      }
+    }
+    return true;
+  }
+
+  // The string at off in the string table, and its slot: the string and
+  // the NUL padding after it, as cmELF counts it.
+  bool string(uint64_t off, elf_string_view &s) const {
+    if (off >= strtab_size_) {
+      return false;
+    }
+    const char *first = data_ + strtab_offset_ + off;
+    const char *end = data_ + strtab_offset_ + strtab_size_;
+    auto nul = static_cast<const char *>(memchr(first, 0, end - first));
+    const char *last = nul != nullptr ? nul : end;
+    s.value = std::string_view(first, last - first);
+    while (last < end && *last == 0) {
+      last++;
+    }
+    s.position = strtab_offset_ + off;
+    s.size = static_cast<uint64_t>(last - first);
+    s.present = true;
+    return true;
+  }
+
+  // Like cmELF, the first of repeated tags is the one that counts.
+  bool first_string(uint64_t off, elf_string_view &s) const {
+    return s.present || string(off, s);
+  }
+
+  uint64_t strtab_offset_{none};
+  uint64_t strtab_size_{0};
+};
+
+template <typename E> bool read_class(const char *data, size_t size,
+                                      bool swap, elf_view &v) {
+  if (swap) {
+    return elf_reader<E, true>(data, size).read(v);
+  }
+  return elf_reader<E, false>(data, size).read(v);
+}
+
+void copy_string(const elf_string_view &in, elf_string &out) {
+  out.value.assign(in.value.data(), in.value.size());
+  out.position = in.position;
+  out.size = in.size;
+  out.present = in.present;
+}
+
+} // namespace
+
+bool elf_view::offset_of(uint64_t addr, uint64_t &off) const {
+  for (auto const &l : loads) {
+    if (addr >= l.vaddr && addr - l.vaddr < l.filesz) {
+      off = l.offset + (addr - l.vaddr);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool elf_view::find(int64_t tag, uint64_t &value) const {
+  for (auto const &d : dyns) {
+    if (d.tag == tag) {
+      value = d.value;
+      return true;
+    }
+  }
+  return false;
+}
+
+void elf_view::summarize(elf_summary &s) const {
+  s = elf_summary();
+  s.valid = true;
+  s.elfclass = elfclass;
+  s.endian = endian;
+  s.version = version;
+  s.osabi = osabi;
+  s.abiversion = abiversion;
+  s.type = type;
+  s.machine = machine;
+  copy_string(soname, s.soname);
+  copy_string(rpath, s.rpath);
+  copy_string(runpath, s.runpath);
+  s.needed.assign(needed.begin(), needed.end());
+}
+
+bool read_elf_view(const char *data, size_t size, elf_view &v) {
+  v = elf_view();
+  if (size < EI_NIDENT || memcmp(data, ELFMAG, SELFMAG) != 0) {
+    return false;
+  }
+  v.elfclass = static_cast<uint8_t>(data[EI_CLASS]);
+  v.endian = static_cast<uint8_t>(data[EI_DATA]);
+  v.version = static_cast<uint8_t>(data[EI_VERSION]);
+  v.osabi = static_cast<uint8_t>(data[EI_OSABI]);
+  v.abiversion = static_cast<uint8_t>(data[EI_ABIVERSION]);
+  if (v.endian != ELFDATA2LSB && v.endian != ELFDATA2MSB) {
+    return false;
+  }
+  bool swap = (v.endian == ELFDATA2MSB) != host_msb;
+  switch (v.elfclass) {
+  case ELFCLASS32:
+    return read_class<elf32_types>(data, size, swap, v);
+  case ELFCLASS64:
+    return read_class<elf64_types>(data, size, swap, v);
+  default:
+    break;
+  }
+  return false;
+}
+
+mapped_elf::~mapped_elf() {
+  if (data_ != nullptr) {
+    ::munmap(const_cast<char *>(data_), size_);
+  }
+}
+
+bool mapped_elf::open(const char *path) {
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    int saved = errno;
+    ::close(fd);
+    errno = saved;
+    return false;
+  }
+  if (static_cast<size_t>(st.st_size) < EI_NIDENT) {
+    ::close(fd);
+    errno = ENOEXEC;
+    return false;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void *p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  int saved = errno;
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    errno = saved;
+    return false;
+  }
+  ::madvise(p, size, MADV_RANDOM);
+  data_ = static_cast<const char *>(p);
+  size_ = size;
+  return true;
+}
+
+bool read_elf_summary(const char *path, elf_summary &s) {
+  s = elf_summary();
+  mapped_elf m;
+  elf_view v;
+  if (!m.open(path) || !read_elf_view(m.data(), m.size(), v)) {
+    return false;
+  }
+  v.summarize(s);
+  return true;
+}
+
+} // namespace mz
@@ -0,0 +1,96 @@
+///
+#ifndef MZ_ELFVIEW_HPP
+#define MZ_ELFVIEW_HPP
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "summary.hpp"
+
+namespace mz {
+
+/// A string of the dynamic string table, viewed in place. position and size
+/// are those of elf_string.
+struct elf_string_view {
+  std::string_view value;
+  uint64_t position{0};
+  uint64_t size{0};
+  bool present{false};
+};
+
+/// An entry of the dynamic table.
+struct elf_dyn {
+  int64_t tag{0};
+  uint64_t value{0};
+};
+
+/// A PT_LOAD segment, as far as the file holds it.
+struct elf_segment {
+  uint64_t vaddr{0};
+  uint64_t offset{0};
+  uint64_t filesz{0};
+};
+
+/// The header fields and dynamic strings of an ELF image. The views point
+/// into the image and live as long as it does.
+struct elf_view {
+  uint8_t elfclass{0}; /// ELFCLASS32 or ELFCLASS64
+  uint8_t endian{0};   /// ELFDATA2LSB or ELFDATA2MSB
+  uint8_t version{0};
+  uint8_t osabi{0};
+  uint8_t abiversion{0};
+  uint16_t type{0};
+  uint16_t machine{0};
+  bool dynamic{false}; /// false for files without a dynamic table
+  elf_string_view soname;
+  elf_string_view rpath;
+  elf_string_view runpath;
+  std::vector<std::string_view> needed;
+  /// The image, for readers of the tables the dynamic table points to.
+  const char *image{nullptr};
+  size_t image_size{0};
+  std::vector<elf_segment> loads;
+  /// The dynamic table up to DT_NULL, in order.
+  std::vector<elf_dyn> dyns;
+  /// The file offset of an address, through the PT_LOAD segments.
+  bool offset_of(uint64_t addr, uint64_t &off) const;
+  /// The value of the first entry with tag.
+  bool find(int64_t tag, uint64_t &value) const;
+  /// Copy into a summary that outlives the image.
+  void summarize(elf_summary &s) const;
+};
+
+/// Read the ELF image of size bytes at data. Only the ELF header, the
+/// program headers, the dynamic table and the strings it names are
+/// touched: the string table is found through DT_STRTAB and the PT_LOAD
+/// segments, and the section headers (usually at the end of the file) are
+/// read only when there is no PT_DYNAMIC. Returns false for images that
+/// are not ELF or are malformed.
+bool read_elf_view(const char *data, size_t size, elf_view &v);
+
+/// mapped_elf maps a file read-only for read_elf_view. The kernel is told
+/// the access is random, so each page touched costs one fault and no read
+/// ahead of the pages around it.
+class mapped_elf {
+public:
+  mapped_elf() = default;
+  mapped_elf(const mapped_elf &) = delete;
+  mapped_elf &operator=(const mapped_elf &) = delete;
+  ~mapped_elf();
+  /// Sets errno on failure.
+  bool open(const char *path);
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  const char *data_{nullptr};
+  size_t size_{0};
+};
+
+/// Map path and summarize it. The summary is valid only if this succeeds;
+/// errno is set when the file could not be mapped.
+bool read_elf_summary(const char *path, elf_summary &s);
+
+} // namespace mz
+
+#endif
@@ -0,0 +1,71 @@
+///
+#ifndef MZ_FIELDS_HPP
+#define MZ_FIELDS_HPP
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mz {
+
+/// Line-oriented records use TAB between fields and LF between records.
+/// Field values escape backslash, TAB and LF so any string but NUL
+/// round-trips.
+inline void append_escaped(std::string &out, std::string_view sv) {
+  for (auto c : sv) {
+    switch (c) {
+    case '\\':
+      out.append("\\\\");
+      break;
+    case '\n':
+      out.append("\\n");
+      break;
+    case '\t':
+      out.append("\\t");
+      break;
+    default:
+      out.push_back(c);
+      break;
+    }
+  }
+}
+
+inline std::string unescape(std::string_view sv) {
+  std::string out;
+  out.reserve(sv.size());
+  for (size_t i = 0; i < sv.size(); i++) {
+    if (sv[i] != '\\' || i + 1 == sv.size()) {
+      out.push_back(sv[i]);
+      continue;
+    }
+    switch (sv[++i]) {
+    case 'n':
+      out.push_back('\n');
+      break;
+    case 't':
+      out.push_back('\t');
+      break;
+    default:
+      out.push_back(sv[i]);
+      break;
+    }
+  }
+  return out;
+}
+
+/// Split a record into its (still escaped) fields.
+inline std::vector<std::string_view> split_fields(std::string_view line) {
+  std::vector<std::string_view> fields;
+  for (;;) {
+    auto pos = line.find('\t');
+    fields.push_back(line.substr(0, pos));
+    if (pos == std::string_view::npos) {
+      break;
+    }
+    line.remove_prefix(pos + 1);
+  }
+  return fields;
+}
+
+} // namespace mz
+
+#endif
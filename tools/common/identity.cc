@@ -0,0 +1,53 @@
+///
+#include <sys/stat.h>
+#include "identity.hpp"
+
+namespace mz {
+
+static void fill_identity(const struct stat &st, file_identity &id) {
+  id.dev = static_cast<uint64_t>(st.st_dev);
+  id.ino = static_cast<uint64_t>(st.st_ino);
+  id.size = static_cast<uint64_t>(st.st_size);
+  id.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                st.st_mtim.tv_nsec;
+  id.ctime_ns = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 +
+                st.st_ctim.tv_nsec;
+}
+
+size_t identity_hash::operator()(const file_identity &id) const {
+  // splitmix64 over the fields; inode and mtime carry most of the entropy.
+  auto mix = [](uint64_t h, uint64_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+  };
+  uint64_t h = mix(0, id.ino);
+  h = mix(h, id.dev);
+  h = mix(h, id.size);
+  h = mix(h, static_cast<uint64_t>(id.mtime_ns));
+  h = mix(h, static_cast<uint64_t>(id.ctime_ns));
+  return static_cast<size_t>(h);
+}
+
+bool stat_identity(const char *path, file_identity &id) {
+  struct stat st;
+  if (::stat(path, &st) != 0) {
+    return false;
+  }
+  fill_identity(st, id);
+  return true;
+}
+
+bool stat_identity(int fd, file_identity &id) {
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    return false;
+  }
+  fill_identity(st, id);
+  return true;
+}
+
+} // namespace mz
@@ -0,0 +1,35 @@
+///
+#ifndef MZ_IDENTITY_HPP
+#define MZ_IDENTITY_HPP
+#include <cstddef>
+#include <cstdint>
+
+namespace mz {
+
+/// Identity of a file on disk, as far as stat(2) can tell.
+struct file_identity {
+  uint64_t dev{0};
+  uint64_t ino{0};
+  uint64_t size{0};
+  int64_t mtime_ns{0};
+  int64_t ctime_ns{0};
+  /// Full match: any write, chmod, rename over or replacement of the file
+  /// changes at least one of these.
+  bool operator==(const file_identity &o) const {
+    return dev == o.dev && ino == o.ino && size == o.size &&
+           mtime_ns == o.mtime_ns && ctime_ns == o.ctime_ns;
+  }
+  bool operator!=(const file_identity &o) const { return !(*this == o); }
+};
+
+/// Hash of every field, for tables keyed by identity.
+struct identity_hash {
+  size_t operator()(const file_identity &id) const;
+};
+
+bool stat_identity(const char *path, file_identity &id);
+bool stat_identity(int fd, file_identity &id);
+
+} // namespace mz
+
+#endif
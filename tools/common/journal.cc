@@ -0,0 +1,144 @@
+///
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "fields.hpp"
+#include "journal.hpp"
+#include "sink.hpp"
+
+namespace mz {
+
+constexpr std::string_view journal_magic = "# cmchrpath journal v1\n";
+
+journal::~journal() {
+  if (fd_ != -1) {
+    ::close(fd_);
+  }
+}
+
+bool journal::open(const std::string &file, std::string *emsg) {
+  fd_ = ::open(file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  if (fd_ == -1) {
+    if (emsg) {
+      *emsg = "Error opening journal " + file + ": " + strerror(errno);
+    }
+    return false;
+  }
+  struct stat st;
+  if (::fstat(fd_, &st) == 0 && st.st_size == 0) {
+    write_full(fd_, journal_magic.data(), journal_magic.size());
+  }
+  return true;
+}
+
+bool journal::append(const journal_record &r) {
+  std::string line;
+  format(r, line);
+  return write_full(fd_, line.data(), line.size());
+}
+
+void journal::format(const journal_record &r, std::string &line) {
+  line.append(std::to_string(r.id.ino)).append("\t");
+  line.append(std::to_string(r.id.size)).append("\t");
+  line.append(std::to_string(r.id.mtime_ns)).append("\t");
+  line.append(std::to_string(r.result)).append("\t");
+  // Paths may contain anything but NUL; keep records one per line.
+  append_escaped(line, r.path);
+  line.push_back('\n');
+}
+
+static bool parse_field(std::string_view &line, long long &value) {
+  auto pos = line.find('\t');
+  if (pos == std::string_view::npos || pos == 0) {
+    return false;
+  }
+  bool negative = line[0] == '-';
+  long long v = 0;
+  for (size_t i = negative ? 1 : 0; i < pos; i++) {
+    if (line[i] < '0' || line[i] > '9') {
+      return false;
+    }
+    v = v * 10 + (line[i] - '0');
+  }
+  value = negative ? -v : v;
+  line.remove_prefix(pos + 1);
+  return true;
+}
+
+bool journal::parse(std::string_view line, journal_record &r) {
+  long long ino, size, mtime, result;
+  if (!parse_field(line, ino) || !parse_field(line, size) ||
+      !parse_field(line, mtime) || !parse_field(line, result)) {
+    return false;
+  }
+  r.id.ino = static_cast<uint64_t>(ino);
+  r.id.size = static_cast<uint64_t>(size);
+  r.id.mtime_ns = mtime;
+  r.result = static_cast<int>(result);
+  r.path = unescape(line);
+  return !r.path.empty();
+}
+
+bool journal::load(const std::string &file, journal_map &records,
+                   std::string *emsg) {
+  std::string text;
+  if (!read_file(file.c_str(), text)) {
+    if (errno == ENOENT) {
+      // Nothing journaled yet.
+      return true;
+    }
+    if (emsg) {
+      *emsg = "Error reading journal " + file + ": " + strerror(errno);
+    }
+    return false;
+  }
+  std::string_view sv(text);
+  journal_record r;
+  while (!sv.empty()) {
+    auto pos = sv.find('\n');
+    if (pos == std::string_view::npos) {
+      // Torn tail from an interrupted append.
+      break;
+    }
+    auto line = sv.substr(0, pos);
+    sv.remove_prefix(pos + 1);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    if (parse(line, r)) {
+      auto path = r.path;
+      records[path] = std::move(r);
+    }
+  }
+  return true;
+}
+
+bool journal::store(const std::string &file, const journal_map &records,
+                    std::string *emsg) {
+  std::vector<const journal_record *> sorted;
+  sorted.reserve(records.size());
+  for (const auto &kv : records) {
+    sorted.push_back(&kv.second);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const journal_record *a, const journal_record *b) {
+              return a->path < b->path;
+            });
+  std::string text(journal_magic);
+  for (auto r : sorted) {
+    format(*r, text);
+  }
+  if (!replace_file(file, text.data(), text.size())) {
+    if (emsg) {
+      *emsg = "Error writing journal " + file + ": " + strerror(errno);
+    }
+    return false;
+  }
+  return true;
+}
+
+} // namespace mz
@@ -0,0 +1,59 @@
+///
+#ifndef MZ_JOURNAL_HPP
+#define MZ_JOURNAL_HPP
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "identity.hpp"
+
+namespace mz {
+
+/// One completed file. result is the exit status of its processing.
+struct journal_record {
+  std::string path;
+  file_identity id;
+  int result{0};
+  /// The journal stores inode, size and mtime; that is what must still match
+  /// for the record to apply to the file on disk.
+  bool matches(const file_identity &other) const {
+    return id.ino == other.ino && id.size == other.size &&
+           id.mtime_ns == other.mtime_ns;
+  }
+};
+
+using journal_map = std::unordered_map<std::string, journal_record>;
+
+/// journal is an append-only log of completed files. Every record is one
+/// text line written with a single write(2) on an O_APPEND descriptor, so an
+/// interrupted run leaves at most one torn line at the end, which load()
+/// ignores.
+///
+///   # cmchrpath journal v1
+///   <ino>\t<size>\t<mtime_ns>\t<result>\t<escaped path>
+class journal {
+public:
+  journal() = default;
+  journal(const journal &) = delete;
+  journal &operator=(const journal &) = delete;
+  ~journal();
+  bool open(const std::string &file, std::string *emsg);
+  bool append(const journal_record &r);
+  bool is_open() const { return fd_ != -1; }
+  /// Read a journal. Later records for the same path replace earlier ones.
+  static bool load(const std::string &file, journal_map &records,
+                   std::string *emsg);
+  /// Write records sorted by path to file, replacing it atomically. Used to
+  /// merge the journals of sharded runs.
+  static bool store(const std::string &file, const journal_map &records,
+                    std::string *emsg);
+  static void format(const journal_record &r, std::string &line);
+  static bool parse(std::string_view line, journal_record &r);
+
+private:
+  int fd_{-1};
+};
+
+} // namespace mz
+
+#endif
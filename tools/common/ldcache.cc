@@ -0,0 +1,265 @@
+///
+#include <cerrno>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ldcache.hpp"
+
+namespace mz {
+
+namespace {
+
+constexpr char old_magic[] = "ld.so-1.7.0";
+constexpr char new_magic[] = "glibc-ld.so.cache1.1";
+constexpr size_t old_header_size = 16; /// magic, padding, entry count
+constexpr size_t old_entry_size = 12;
+constexpr size_t header_size = 48;
+constexpr size_t entry_size = 24;
+constexpr uint32_t extension_magic = 0xeaa42174;
+constexpr uint32_t extension_tag_glibc_hwcaps = 1;
+
+constexpr uint8_t endian_mask = 3;
+constexpr uint8_t endian_unset = 0;
+constexpr uint8_t endian_little = 2;
+constexpr uint8_t endian_big = 3;
+
+constexpr int32_t flag_type_mask = 0x00ff;
+constexpr int32_t flag_elf_libc6 = 0x0003;
+constexpr int32_t flag_abi_mask = 0xff00;
+
+constexpr uint64_t hwcap_extension = uint64_t(1) << 62;
+
+constexpr bool host_msb = __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__;
+
+// Whether an entry with ABI flag abi is for the given class and machine.
+// ldconfig marks the libraries of an architecture's secondary ABIs; those
+// of its first one carry no flag.
+bool abi_matches(int32_t abi, uint8_t elfclass, uint16_t machine) {
+  bool is64 = elfclass == ELFCLASS64;
+  switch (machine) {
+  case EM_X86_64:
+    return abi == (is64 ? 0x0300 : 0x0800);
+  case EM_SPARCV9:
+    return abi == 0x0100;
+  case EM_IA_64:
+    return abi == 0x0200;
+  case EM_S390:
+    return abi == (is64 ? 0x0400 : 0);
+  case EM_PPC64:
+    return abi == 0x0500;
+  case EM_MIPS:
+    // n32 and n64, in either NaN encoding; o32 in either.
+    return is64 ? abi == 0x0700 || abi == 0x0e00
+                : abi == 0 || abi == 0x0600 || abi == 0x0c00 || abi == 0x0d00;
+  case EM_ARM:
+    return abi == 0x0900 || abi == 0x0b00 || abi == 0;
+  case EM_AARCH64:
+    return abi == 0x0a00;
+  case EM_RISCV:
+    return abi == 0x0f00 || abi == 0x1000;
+  case 258: // EM_LOONGARCH
+    return abi == 0x1100 || abi == 0x1200;
+  default:
+    break;
+  }
+  return abi == 0;
+}
+
+} // namespace
+
+ld_so_cache::~ld_so_cache() {
+  if (base_ != nullptr) {
+    ::munmap(const_cast<char *>(base_), size_);
+  }
+}
+
+uint32_t ld_so_cache::u32(const char *p) const {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return swap_ ? __builtin_bswap32(v) : v;
+}
+
+uint64_t ld_so_cache::u64(const char *p) const {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return swap_ ? __builtin_bswap64(v) : v;
+}
+
+std::string_view ld_so_cache::string(uint32_t offset) const {
+  auto first = header_ + offset;
+  auto end = base_ + size_;
+  if (offset >= static_cast<size_t>(end - header_)) {
+    return std::string_view();
+  }
+  auto nul = static_cast<const char *>(memchr(first, 0, end - first));
+  if (nul == nullptr) {
+    return std::string_view();
+  }
+  return std::string_view(first, nul - first);
+}
+
+std::string_view ld_so_cache::hwcaps_name(uint32_t i) const {
+  if (i >= hwcaps_count_) {
+    return std::string_view();
+  }
+  return string(u32(hwcaps_ + 4 * size_t(i)));
+}
+
+bool ld_so_cache::open(const std::string &file, std::string *emsg) {
+  auto fail = [&](const char *why) {
+    if (emsg) {
+      *emsg = "Error opening library cache " + file + ": " + why;
+    }
+    return false;
+  };
+  int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return fail(strerror(errno));
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < header_size) {
+    ::close(fd);
+    return fail("not a library cache");
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void *p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    return fail(strerror(errno));
+  }
+  base_ = static_cast<const char *>(p);
+  size_ = size;
+  auto reject = [&](const char *why) {
+    ::munmap(p, size);
+    base_ = nullptr;
+    size_ = 0;
+    return fail(why);
+  };
+
+  // An old-format cache carries the new one after its own entries, at the
+  // next 8-byte boundary. The old entries are of no use to this loader.
+  size_t offset = 0;
+  if (memcmp(base_, old_magic, sizeof(old_magic) - 1) == 0) {
+    uint32_t old_count;
+    memcpy(&old_count, base_ + 12, sizeof(old_count));
+    offset = (old_header_size + size_t(old_count) * old_entry_size + 7) &
+             ~size_t(7);
+  }
+  if (offset > size - header_size ||
+      memcmp(base_ + offset, new_magic, sizeof(new_magic) - 1) != 0) {
+    return reject("not a glibc-ld.so.cache1.1 file");
+  }
+  header_ = base_ + offset;
+  // Caches written before the byte order was recorded are the host's.
+  switch (static_cast<uint8_t>(header_[28]) & endian_mask) {
+  case endian_unset:
+    swap_ = false;
+    break;
+  case endian_little:
+    swap_ = host_msb;
+    break;
+  case endian_big:
+    swap_ = !host_msb;
+    break;
+  default:
+    return reject("library cache of unknown byte order");
+  }
+  count_ = u32(header_ + 20);
+  entries_ = header_ + header_size;
+  if (count_ > (size - offset - header_size) / entry_size) {
+    return reject("library cache entries past the end of the file");
+  }
+
+  // The extensions are optional; a damaged one only loses hwcaps entries.
+  uint32_t ext = u32(header_ + 32);
+  size_t avail = size - offset;
+  if (ext != 0 && ext <= avail - 8 && u32(header_ + ext) == extension_magic) {
+    uint32_t sections = u32(header_ + ext + 4);
+    for (uint32_t i = 0; i < sections && ext + 8 + (i + 1) * 16ull <= avail;
+         i++) {
+      const char *s = header_ + ext + 8 + i * 16;
+      uint32_t soff = u32(s + 8), ssize = u32(s + 12);
+      if (u32(s) == extension_tag_glibc_hwcaps && soff <= avail &&
+          ssize <= avail - soff) {
+        hwcaps_ = header_ + soff;
+        hwcaps_count_ = ssize / 4;
+      }
+    }
+  }
+  return true;
+}
+
+void ld_so_cache::prefer_hwcaps(std::vector<std::string> names) {
+  std::lock_guard<std::mutex> lock(mu_);
+  preferred_ = std::move(names);
+  indexes_.clear();
+}
+
+const ld_so_cache::index &ld_so_cache::index_for(uint8_t elfclass,
+                                                 uint16_t machine) const {
+  uint32_t key = uint32_t(elfclass) << 16 | machine;
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = indexes_.find(key);
+  if (it != indexes_.end()) {
+    return it->second;
+  }
+  // The rank of an entry: its glibc-hwcaps name's place in preferred_,
+  // then the baseline. Entries of other hwcaps, and the legacy hwcap
+  // subdirectories the loader no longer searches, are left out. The file
+  // is sorted by soname, so the first entry of a rank wins.
+  std::unordered_map<std::string_view, size_t> ranks;
+  index &idx = indexes_[key];
+  for (uint32_t i = 0; i < count_; i++) {
+    const char *e = entries_ + size_t(i) * entry_size;
+    auto flags = static_cast<int32_t>(u32(e));
+    if ((flags & flag_type_mask) != flag_elf_libc6 ||
+        !abi_matches(flags & flag_abi_mask, elfclass, machine)) {
+      continue;
+    }
+    uint64_t hwcap = u64(e + 16);
+    size_t rank = preferred_.size();
+    if ((hwcap >> 32) == (hwcap_extension >> 32)) {
+      auto name = hwcaps_name(static_cast<uint32_t>(hwcap));
+      rank = 0;
+      while (rank < preferred_.size() && preferred_[rank] != name) {
+        rank++;
+      }
+      if (rank == preferred_.size()) {
+        continue;
+      }
+    } else if (hwcap != 0) {
+      continue;
+    }
+    auto soname = string(u32(e + 4));
+    auto path = string(u32(e + 8));
+    if (soname.empty() || path.empty()) {
+      continue;
+    }
+    auto r = ranks.emplace(soname, rank);
+    if (r.second || rank < r.first->second) {
+      r.first->second = rank;
+      idx[soname] = path;
+    }
+  }
+  return idx;
+}
+
+bool ld_so_cache::find(std::string_view soname, uint8_t elfclass,
+                       uint16_t machine, std::string_view &path) const {
+  if (base_ == nullptr) {
+    return false;
+  }
+  auto const &idx = index_for(elfclass, machine);
+  auto it = idx.find(soname);
+  if (it == idx.end()) {
+    return false;
+  }
+  path = it->second;
+  return true;
+}
+
+} // namespace mz
@@ -0,0 +1,70 @@
+///
+#ifndef MZ_LDCACHE_HPP
+#define MZ_LDCACHE_HPP
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mz {
+
+/// ld_so_cache is a read-only view of a glibc library cache
+/// (/etc/ld.so.cache, or the one of a sysroot), queried in place through
+/// the mapping. The "glibc-ld.so.cache1.1" format is read in either byte
+/// order, alone or after the entries of the old "ld.so-1.7.0" format:
+///
+///   header      magic, entry count, string size, byte order, extensions
+///   entries     flags (type, and the ABI the library is for), soname and
+///               path as string offsets, hwcap
+///   strings
+///   extensions  the glibc-hwcaps subdirectory names entries refer to
+///
+/// The first lookup for a class and machine builds a soname-to-entry hash
+/// index of the entries for that ABI; later lookups are one probe.
+class ld_so_cache {
+public:
+  ld_so_cache() = default;
+  ld_so_cache(const ld_so_cache &) = delete;
+  ld_so_cache &operator=(const ld_so_cache &) = delete;
+  ~ld_so_cache();
+  bool open(const std::string &file, std::string *emsg);
+  bool is_open() const { return base_ != nullptr; }
+  /// Entries of all ABIs, as in the file.
+  size_t size() const { return count_; }
+  /// Entries under glibc-hwcaps/<name> for these names are taken over the
+  /// baseline one, the first name best. By default only baseline entries
+  /// are, as the loader does on a CPU that supports no hwcaps level. Call
+  /// it before the first find.
+  void prefer_hwcaps(std::vector<std::string> names);
+  /// The path of soname for a consumer of the given class and machine.
+  /// Safe to call from several threads.
+  bool find(std::string_view soname, uint8_t elfclass, uint16_t machine,
+            std::string_view &path) const;
+
+private:
+  using index = std::unordered_map<std::string_view, std::string_view>;
+  const index &index_for(uint8_t elfclass, uint16_t machine) const;
+  uint32_t u32(const char *p) const;
+  uint64_t u64(const char *p) const;
+  std::string_view string(uint32_t offset) const;
+  std::string_view hwcaps_name(uint32_t i) const;
+
+  const char *base_{nullptr};
+  size_t size_{0};
+  const char *header_{nullptr}; /// string offsets are relative to it
+  const char *entries_{nullptr};
+  uint32_t count_{0};
+  const char *hwcaps_{nullptr}; /// string offsets of glibc-hwcaps names
+  uint32_t hwcaps_count_{0};
+  bool swap_{false};
+  std::vector<std::string> preferred_;
+  mutable std::mutex mu_;
+  mutable std::unordered_map<uint32_t, index> indexes_;
+};
+
+} // namespace mz
+
+#endif
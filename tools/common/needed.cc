@@ -0,0 +1,178 @@
+///
+#include <elf.h>
+#include <memory>
+#include <unordered_map>
+#include "elfreloc.hpp"
+#include "elfsym.hpp"
+#include "elfview.hpp"
+#include "needed.hpp"
+
+namespace mz {
+
+namespace {
+
+// The dynamic symbols of one object of the closure, read on first use.
+struct object_symbols {
+  mapped_elf file;
+  elf_view view;
+  std::vector<elf_symbol> symbols;
+  std::vector<const elf_symbol *> undefined;
+  std::unordered_map<std::string_view, std::vector<const elf_symbol *>>
+      exports;
+  bool ok{false};
+
+  bool open(const std::string &path) {
+    if (path.empty() || !file.open(path.c_str()) ||
+        !read_elf_view(file.data(), file.size(), view) ||
+        !read_dynamic_symbols(view, symbols)) {
+      return false;
+    }
+    for (auto const &s : symbols) {
+      if (s.name.empty() || (s.bind != STB_GLOBAL && s.bind != STB_WEAK &&
+                             s.bind != STB_GNU_UNIQUE)) {
+        continue;
+      }
+      if (!s.defined()) {
+        undefined.push_back(&s);
+      } else if (s.visibility == STV_DEFAULT ||
+                 s.visibility == STV_PROTECTED) {
+        exports[s.name].push_back(&s);
+      }
+    }
+    ok = true;
+    return true;
+  }
+
+  // Whether a reference binds to a definition here: a reference with no
+  // version takes the default one, a versioned one that version or an
+  // unversioned definition.
+  bool defines(const elf_symbol &ref) const {
+    auto it = exports.find(ref.name);
+    if (it == exports.end()) {
+      return false;
+    }
+    for (auto const *def : it->second) {
+      if (ref.version.empty() ? !def->hidden
+                              : def->version == ref.version ||
+                                    (def->version.empty() && !def->hidden)) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+} // namespace
+
+bool analyze_needed(const std::vector<closure_object> &objects,
+                    std::vector<needed_use> &uses, std::string *emsg) {
+  uses.clear();
+  if (objects.empty()) {
+    return true;
+  }
+  std::vector<std::unique_ptr<object_symbols>> tables(objects.size());
+  auto table = [&](uint32_t i) -> const object_symbols & {
+    if (!tables[i]) {
+      tables[i].reset(new object_symbols);
+      tables[i]->open(objects[i].path);
+    }
+    return *tables[i];
+  };
+  auto const &root = table(0);
+  if (!root.ok) {
+    if (emsg) {
+      *emsg = objects[0].path + ": unable to read the dynamic symbols";
+    }
+    return false;
+  }
+  // An executable's copies of library data bind to the library as much as
+  // its undefined symbols do: the loader fills each copy from the
+  // original. They are defined with the library's version when it has
+  // one, and named by a copy relocation either way.
+  std::vector<const elf_symbol *> refs = root.undefined;
+  std::vector<uint32_t> copied;
+  if (!read_copy_relocations(root.view, copied)) {
+    if (emsg) {
+      *emsg = objects[0].path + ": unable to read the dynamic relocations";
+    }
+    return false;
+  }
+  for (auto const &sym : root.symbols) {
+    if (sym.defined() && !sym.version_file.empty()) {
+      refs.push_back(&sym);
+    }
+  }
+  for (uint32_t i : copied) {
+    if (i < root.symbols.size() && root.symbols[i].version_file.empty()) {
+      refs.push_back(&root.symbols[i]);
+    }
+  }
+  auto const &needed = objects[0].summary.needed;
+  for (size_t j = 0; j < needed.size(); j++) {
+    needed_use u;
+    u.name = needed[j];
+    if (j < objects[0].needed.size()) {
+      u.object = objects[0].needed[j];
+    }
+    if (u.object >= objects.size() || u.object == 0) {
+      uses.push_back(std::move(u));
+      continue;
+    }
+    auto const &lib = table(u.object);
+    u.known = lib.ok;
+    for (auto const *ref : refs) {
+      if (ref->version_file == u.name) {
+        u.versioned = true;
+      }
+      if (lib.ok && lib.defines(*ref)) {
+        u.symbols++;
+      }
+    }
+    uses.push_back(std::move(u));
+  }
+
+  // An entry the root makes no use of may still hold a library in the
+  // closure that others bind to. What the closure keeps without it is
+  // what the root's other entries reach.
+  for (size_t j = 0; j < uses.size(); j++) {
+    auto &u = uses[j];
+    if (u.used()) {
+      continue;
+    }
+    std::vector<bool> kept(objects.size(), false);
+    std::vector<uint32_t> stack{0};
+    kept[0] = true;
+    while (!stack.empty()) {
+      uint32_t i = stack.back();
+      stack.pop_back();
+      auto const &next = objects[i].needed;
+      for (size_t k = 0; k < next.size(); k++) {
+        if ((i == 0 && k == j) || next[k] >= objects.size() || kept[next[k]]) {
+          continue;
+        }
+        kept[next[k]] = true;
+        stack.push_back(next[k]);
+      }
+    }
+    for (uint32_t lost = 1; lost < objects.size() && !u.relied_on; lost++) {
+      if (kept[lost]) {
+        continue;
+      }
+      auto const &defs = table(lost);
+      for (uint32_t i = 0; i < objects.size() && !u.relied_on; i++) {
+        if (!kept[i]) {
+          continue;
+        }
+        for (auto const *ref : i == 0 ? refs : table(i).undefined) {
+          if (defs.defines(*ref)) {
+            u.relied_on = true;
+            break;
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+} // namespace mz
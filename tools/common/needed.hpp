@@ -0,0 +1,41 @@
+///
+#ifndef MZ_NEEDED_HPP
+#define MZ_NEEDED_HPP
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "resolver.hpp"
+
+namespace mz {
+
+/// How the root of a dependency closure uses one of its DT_NEEDED entries.
+struct needed_use {
+  std::string name;            /// the DT_NEEDED entry
+  uint32_t object{UINT32_MAX}; /// its object in the closure
+  bool known{false};           /// its symbols could be read
+  /// The root's undefined symbols, and copies of data it holds, that the
+  /// library defines.
+  size_t symbols{0};
+  bool versioned{false};       /// the root needs a version of it by name
+  /// Without the entry the closure would lose it, or a library it brings
+  /// in, while something left in the closure binds to a symbol it defines.
+  bool relied_on{false};
+  bool used() const { return !known || symbols != 0 || versioned || relied_on; }
+};
+
+/// For each DT_NEEDED entry of the root of a closure from
+/// dependency_resolver, in order, whether the root uses it: whether a
+/// library defines one of the root's undefined dynamic symbols (weak ones
+/// included, with a matching version) or the original of data the root
+/// copy-relocates, is named by the root's version needs, or is kept in
+/// the closure for the sake of another object. An entry that is unused
+/// by all three only costs the loader an open, a mapping and its
+/// relocations; its constructors are the one thing lost with it.
+/// Libraries not found or not readable count as used.
+bool analyze_needed(const std::vector<closure_object> &objects,
+                    std::vector<needed_use> &uses, std::string *emsg);
+
+} // namespace mz
+
+#endif
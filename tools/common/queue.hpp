@@ -0,0 +1,253 @@
+///
+#ifndef MZ_QUEUE_HPP
+#define MZ_QUEUE_HPP
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace mz {
+
+struct queue_stats {
+  size_t capacity{0};
+  uint64_t pushes{0};
+  /// Sum of the depth seen by every push; divide by pushes for the mean.
+  uint64_t depth_sum{0};
+  size_t max_depth{0};
+  /// Time producers spent blocked on a full queue (backpressure).
+  uint64_t full_wait_ns{0};
+  /// Time consumers spent blocked on an empty queue (starvation).
+  uint64_t empty_wait_ns{0};
+};
+
+/// wait_point lets threads sleep until another thread makes progress on a
+/// lock-free structure, without a lock on the fast path: a thread that made
+/// progress pays a fence and a load unless someone is asleep.
+class wait_point {
+public:
+  /// Sleep until ready() holds. ready() is called without the lock, so it
+  /// may notify other wait_points.
+  template <typename F> void wait(F &&ready) {
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (;;) {
+      auto epoch = epoch_.load(std::memory_order_acquire);
+      if (ready()) {
+        break;
+      }
+      std::unique_lock<std::mutex> lock(mu_);
+      cv_.wait(lock, [&] {
+        return epoch_.load(std::memory_order_relaxed) != epoch;
+      });
+    }
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  /// Wake the sleepers, after making the progress they wait for.
+  void notify() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_relaxed) != 0) {
+      wake();
+    }
+  }
+  void wake() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      epoch_.fetch_add(1, std::memory_order_release);
+    }
+    cv_.notify_all();
+  }
+
+private:
+  std::atomic<uint32_t> waiters_{0};
+  std::atomic<uint64_t> epoch_{0};
+  std::mutex mu_;
+  std::condition_variable cv_;
+};
+
+/// bounded_queue is a fixed-capacity multi-producer multi-consumer ring
+/// (Vyukov's sequence-numbered cells). try_push/try_pop never block;
+/// push/pop back off by spinning and yielding, then sleep until the other
+/// side makes room or brings an element, which is how a full queue pushes
+/// back on the stage feeding it.
+template <typename T> class bounded_queue {
+public:
+  explicit bounded_queue(size_t capacity) {
+    size_t n = 2;
+    while (n < capacity) {
+      n <<= 1;
+    }
+    mask_ = n - 1;
+    cells_.reset(new cell[n]);
+    for (size_t i = 0; i < n; i++) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+  bounded_queue(const bounded_queue &) = delete;
+  bounded_queue &operator=(const bounded_queue &) = delete;
+
+  bool try_push(T &v) {
+    cell *c;
+    auto pos = enqueue_.load(std::memory_order_relaxed);
+    for (;;) {
+      c = &cells_[pos & mask_];
+      auto seq = c->seq.load(std::memory_order_acquire);
+      auto dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (dif == 0) {
+        if (enqueue_.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = enqueue_.load(std::memory_order_relaxed);
+      }
+    }
+    c->data = std::move(v);
+    c->seq.store(pos + 1, std::memory_order_release);
+    not_empty_.notify();
+    auto d = depth();
+    pushes_.fetch_add(1, std::memory_order_relaxed);
+    depth_sum_.fetch_add(d, std::memory_order_relaxed);
+    auto m = max_depth_.load(std::memory_order_relaxed);
+    while (d > m && !max_depth_.compare_exchange_weak(
+                        m, d, std::memory_order_relaxed)) {
+    }
+    return true;
+  }
+
+  bool try_pop(T &v) {
+    cell *c;
+    auto pos = dequeue_.load(std::memory_order_relaxed);
+    for (;;) {
+      c = &cells_[pos & mask_];
+      auto seq = c->seq.load(std::memory_order_acquire);
+      auto dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (dif == 0) {
+        if (dequeue_.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = dequeue_.load(std::memory_order_relaxed);
+      }
+    }
+    v = std::move(c->data);
+    c->seq.store(pos + mask_ + 1, std::memory_order_release);
+    not_full_.notify();
+    return true;
+  }
+
+  void push(T v) {
+    if (try_push(v)) {
+      return;
+    }
+    auto begin = std::chrono::steady_clock::now();
+    unsigned spins = 0;
+    for (; spins < spin_limit && !try_push(v); spins++) {
+      backoff(spins);
+    }
+    if (spins == spin_limit) {
+      not_full_.wait([&] { return try_push(v); });
+    }
+    full_wait_ns_.fetch_add(elapsed_ns(begin), std::memory_order_relaxed);
+  }
+
+  /// Blocks until an element is available. Returns false once the queue is
+  /// closed and drained.
+  bool pop(T &v) {
+    if (try_pop(v)) {
+      return true;
+    }
+    auto begin = std::chrono::steady_clock::now();
+    bool result = false;
+    auto ready = [&] {
+      if (try_pop(v)) {
+        result = true;
+        return true;
+      }
+      if (closed_.load(std::memory_order_acquire)) {
+        result = try_pop(v);
+        return true;
+      }
+      return false;
+    };
+    unsigned spins = 0;
+    for (; spins < spin_limit && !ready(); spins++) {
+      backoff(spins);
+    }
+    if (spins == spin_limit) {
+      not_empty_.wait(ready);
+    }
+    empty_wait_ns_.fetch_add(elapsed_ns(begin), std::memory_order_relaxed);
+    return result;
+  }
+
+  /// No more pushes will follow.
+  void close() {
+    closed_.store(true, std::memory_order_release);
+    not_empty_.wake();
+  }
+
+  size_t depth() const {
+    auto e = enqueue_.load(std::memory_order_relaxed);
+    auto d = dequeue_.load(std::memory_order_relaxed);
+    return e > d ? e - d : 0;
+  }
+  size_t capacity() const { return mask_ + 1; }
+
+  queue_stats stats() const {
+    queue_stats s;
+    s.capacity = capacity();
+    s.pushes = pushes_.load(std::memory_order_relaxed);
+    s.depth_sum = depth_sum_.load(std::memory_order_relaxed);
+    s.max_depth = max_depth_.load(std::memory_order_relaxed);
+    s.full_wait_ns = full_wait_ns_.load(std::memory_order_relaxed);
+    s.empty_wait_ns = empty_wait_ns_.load(std::memory_order_relaxed);
+    return s;
+  }
+
+private:
+  struct cell {
+    std::atomic<size_t> seq;
+    T data;
+  };
+  static constexpr unsigned spin_limit = 128;
+  static void backoff(unsigned spins) {
+    if (spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  static uint64_t elapsed_ns(std::chrono::steady_clock::time_point begin) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - begin)
+            .count());
+  }
+  alignas(64) std::atomic<size_t> enqueue_{0};
+  alignas(64) std::atomic<size_t> dequeue_{0};
+  alignas(64) std::atomic<bool> closed_{false};
+  std::atomic<uint64_t> pushes_{0};
+  std::atomic<uint64_t> depth_sum_{0};
+  std::atomic<size_t> max_depth_{0};
+  std::atomic<uint64_t> full_wait_ns_{0};
+  std::atomic<uint64_t> empty_wait_ns_{0};
+  wait_point not_empty_;
+  wait_point not_full_;
+  std::unique_ptr<cell[]> cells_;
+  size_t mask_{0};
+};
+
+} // namespace mz
+
+#endif
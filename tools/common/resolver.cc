@@ -0,0 +1,514 @@
+///
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include "elfview.hpp"
+#include "resolver.hpp"
+#include "workers.hpp"
+
+namespace mz {
+
+namespace {
+
+// The multiarch directory name of a machine, as Debian and its
+// derivatives lay out /lib and /usr/lib.
+const char *multiarch(uint8_t elfclass, uint16_t machine) {
+  bool is64 = elfclass == ELFCLASS64;
+  switch (machine) {
+  case EM_X86_64:
+    return is64 ? "x86_64-linux-gnu" : "x86_64-linux-gnux32";
+  case EM_386:
+    return "i386-linux-gnu";
+  case EM_AARCH64:
+    return "aarch64-linux-gnu";
+  case EM_ARM:
+    return "arm-linux-gnueabihf";
+  case EM_PPC64:
+    return "powerpc64le-linux-gnu";
+  case EM_S390:
+    return is64 ? "s390x-linux-gnu" : nullptr;
+  case EM_RISCV:
+    return is64 ? "riscv64-linux-gnu" : nullptr;
+  default:
+    break;
+  }
+  return nullptr;
+}
+
+// AT_PLATFORM of a machine, which $PLATFORM expands to.
+const char *platform_name(uint16_t machine) {
+  switch (machine) {
+  case EM_X86_64:
+    return "x86_64";
+  case EM_386:
+    return "i686";
+  case EM_AARCH64:
+    return "aarch64";
+  case EM_PPC64:
+    return "powerpc64le";
+  case EM_S390:
+    return "s390x";
+  case EM_RISCV:
+    return "riscv64";
+  default:
+    break;
+  }
+  return "";
+}
+
+std::string dirname(const std::string &path) {
+  auto slash = path.rfind('/');
+  if (slash == std::string::npos) {
+    return ".";
+  }
+  return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+// Replace $NAME and ${NAME} in s.
+void substitute(std::string &s, std::string_view name,
+                const std::string &value) {
+  std::string plain = "$" + std::string(name);
+  std::string braced = "${" + std::string(name) + "}";
+  for (auto const &token : {braced, plain}) {
+    for (size_t pos = 0; (pos = s.find(token, pos)) != std::string::npos;) {
+      auto end = pos + token.size();
+      // $ORIGINAL is not $ORIGIN.
+      if (token == plain && end < s.size() &&
+          (isalnum(static_cast<unsigned char>(s[end])) || s[end] == '_')) {
+        pos = end;
+        continue;
+      }
+      s.replace(pos, token.size(), value);
+      pos += value.size();
+    }
+  }
+}
+
+} // namespace
+
+const char *search_source_name(search_source s) {
+  switch (s) {
+  case source_none:
+    return "not found";
+  case source_path:
+    return "path";
+  case source_loaded:
+    return "loaded";
+  case source_rpath:
+    return "RPATH";
+  case source_ld_library_path:
+    return "LD_LIBRARY_PATH";
+  case source_runpath:
+    return "RUNPATH";
+  case source_cache:
+    return "cache";
+  case source_default:
+    return "system";
+  }
+  return "unknown";
+}
+
+std::vector<uint32_t>
+search_path_hits(const std::vector<closure_object> &objects,
+                 search_source source) {
+  std::vector<uint32_t> hits;
+  if (objects.empty()) {
+    return hits;
+  }
+  auto const &s = objects[0].summary;
+  auto const &list = source == source_rpath ? s.rpath : s.runpath;
+  if (!list.present) {
+    return hits;
+  }
+  hits.resize(std::count(list.value.begin(), list.value.end(), ':') + 1);
+  for (auto const &o : objects) {
+    if (o.owner == 0 && o.source == source && o.element < hits.size()) {
+      hits[o.element]++;
+    }
+  }
+  return hits;
+}
+
+dependency_resolver::dependency_resolver(resolver_options opts)
+    : opts_(std::move(opts)) {
+  while (opts_.sysroot.size() > 1 && opts_.sysroot.back() == '/') {
+    opts_.sysroot.pop_back();
+  }
+  if (opts_.sysroot == "/") {
+    opts_.sysroot.clear();
+  }
+}
+
+std::string dependency_resolver::rooted(std::string dir) const {
+  while (dir.size() > 1 && dir.back() == '/') {
+    dir.pop_back();
+  }
+  if (!opts_.sysroot.empty() && !dir.empty() && dir[0] == '/') {
+    dir.insert(0, opts_.sysroot);
+  }
+  return dir;
+}
+
+void dependency_resolver::target(uint8_t elfclass, uint16_t machine) {
+  elfclass_ = elfclass;
+  machine_ = machine;
+  bool is64 = elfclass == ELFCLASS64;
+  const char *triplet = multiarch(elfclass, machine);
+  // A tree with a multiarch directory for the machine is laid out as
+  // Debian's, whose loader searches it and then /lib and /usr/lib; other
+  // loaders search lib64 or lib.
+  struct stat st;
+  std::string multilib = std::string("lib/") + (triplet ? triplet : "");
+  bool debian = triplet != nullptr &&
+                (stat(rooted("/" + multilib).c_str(), &st) == 0 ||
+                 stat(rooted("/usr/" + multilib).c_str(), &st) == 0);
+  const char *libdir = debian ? multilib.c_str() : is64 ? "lib64" : "lib";
+  lib_ = opts_.lib.empty() ? libdir : opts_.lib;
+  platform_ = opts_.platform.empty() ? platform_name(machine) : opts_.platform;
+  default_dirs_.clear();
+  if (!opts_.default_dirs.empty()) {
+    for (auto const &d : opts_.default_dirs) {
+      default_dirs_.push_back(rooted(d));
+    }
+    return;
+  }
+  default_dirs_.push_back(rooted(std::string("/") + libdir));
+  default_dirs_.push_back(rooted(std::string("/usr/") + libdir));
+  if (debian) {
+    default_dirs_.push_back(rooted("/lib"));
+    default_dirs_.push_back(rooted("/usr/lib"));
+  }
+}
+
+void dependency_resolver::expand(std::string_view list,
+                                 const std::string &origin,
+                                 search_source source, uint32_t owner,
+                                 std::vector<search_dir> &dirs) const {
+  for (uint32_t element = 0;; element++) {
+    auto colon = list.find(':');
+    std::string dir(list.substr(0, colon));
+    // An empty element is the current directory, as for the loader.
+    if (dir.empty()) {
+      dir = ".";
+    }
+    // $ORIGIN is a directory of the tree being resolved already.
+    bool relative = dir.compare(0, 7, "$ORIGIN") == 0 ||
+                    dir.compare(0, 9, "${ORIGIN}") == 0;
+    substitute(dir, "ORIGIN", origin);
+    substitute(dir, "LIB", lib_);
+    substitute(dir, "PLATFORM", platform_);
+    if (relative) {
+      while (dir.size() > 1 && dir.back() == '/') {
+        dir.pop_back();
+      }
+    } else {
+      dir = rooted(std::move(dir));
+    }
+    dirs.push_back(search_dir{std::move(dir), source, owner, element});
+    if (colon == std::string_view::npos) {
+      break;
+    }
+    list.remove_prefix(colon + 1);
+  }
+}
+
+std::vector<search_dir>
+dependency_resolver::search_path(const std::vector<closure_object> &objects,
+                                 uint32_t index) const {
+  auto origin = [&](uint32_t i) {
+    return i == 0 ? root_origin_ : dirname(objects[i].path);
+  };
+  std::vector<search_dir> dirs;
+  auto const &s = objects[index].summary;
+  // An object with a RUNPATH ignores every RPATH, and the RPATH of an
+  // object that has a RUNPATH is ignored.
+  if (!s.runpath.present) {
+    for (uint32_t i = index; i != none; i = objects[i].loader) {
+      auto const &l = objects[i].summary;
+      if (l.rpath.present && !l.runpath.present) {
+        expand(l.rpath.value, origin(i), source_rpath, i, dirs);
+      }
+    }
+  }
+  for (auto const &entry : opts_.ld_library_path) {
+    expand(entry, root_origin_, source_ld_library_path, none, dirs);
+  }
+  if (s.runpath.present) {
+    expand(s.runpath.value, origin(index), source_runpath, index, dirs);
+  }
+  return dirs;
+}
+
+std::vector<search_dir>
+dependency_resolver::elements(const std::vector<closure_object> &objects,
+                              uint32_t index, search_source source) const {
+  std::vector<search_dir> dirs;
+  auto const &s = objects[index].summary;
+  auto const &list = source == source_rpath ? s.rpath : s.runpath;
+  if (list.present) {
+    expand(list.value, index == 0 ? root_origin_ : dirname(objects[index].path),
+           source, index, dirs);
+  }
+  return dirs;
+}
+
+bool dependency_resolver::provides(const std::string &dir,
+                                   const std::string &name) {
+  std::string path;
+  return probe(dir, name, path);
+}
+
+void dependency_resolver::find(const std::string &name,
+                               const std::vector<search_dir> &dirs,
+                               closure_object &o) {
+  found f = lookup(name, dirs);
+  o.path = std::move(f.path);
+  o.source = f.source;
+  if (f.hit < dirs.size()) {
+    o.owner = dirs[f.hit].owner;
+    o.element = dirs[f.hit].element;
+  }
+  for (auto place : f.failed) {
+    search_dir d = place < dirs.size()
+                       ? dirs[place]
+                       : search_dir{default_dirs_[place - dirs.size()],
+                                    source_default};
+    d.exists = list(d.dir) != nullptr;
+    o.failed.push_back(std::move(d));
+  }
+}
+
+dependency_resolver::found
+dependency_resolver::lookup(const std::string &name,
+                            const std::vector<search_dir> &dirs) {
+  std::string key = name;
+  key.push_back('\0');
+  key.push_back(static_cast<char>(elfclass_));
+  key.append(std::to_string(machine_));
+  for (auto const &d : dirs) {
+    key.push_back('\0');
+    key.push_back(static_cast<char>('0' + d.source));
+    key.append(d.dir);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = lookups_.find(key);
+    if (it != lookups_.end()) {
+      return it->second;
+    }
+  }
+  // Two workers may search for the same key at once; both get the same
+  // answer.
+  found f = search(name, dirs);
+  std::lock_guard<std::mutex> lock(mu_);
+  lookups_.emplace(std::move(key), f);
+  return f;
+}
+
+dependency_resolver::found
+dependency_resolver::search(const std::string &name,
+                            const std::vector<search_dir> &dirs) {
+  found f;
+  uint32_t place = 0;
+  for (auto const &d : dirs) {
+    if (probe(d.dir, name, f.path)) {
+      f.source = d.source;
+      f.hit = place;
+      return f;
+    }
+    f.failed.push_back(place++);
+  }
+  std::string cached;
+  if (opts_.cache && opts_.cache(name, elfclass_, machine_, cached)) {
+    cached = rooted(std::move(cached));
+    if (kind(cached) == (uint32_t(elfclass_) << 16 | machine_)) {
+      f.path = std::move(cached);
+      f.source = source_cache;
+      return f;
+    }
+  }
+  for (auto const &d : default_dirs_) {
+    if (probe(d, name, f.path)) {
+      f.source = source_default;
+      f.hit = place;
+      return f;
+    }
+    f.failed.push_back(place++);
+  }
+  f.path.clear();
+  return f;
+}
+
+bool dependency_resolver::probe(const std::string &dir,
+                                const std::string &name, std::string &path) {
+  auto names = list(dir);
+  if (names == nullptr || names->count(name) == 0) {
+    return false;
+  }
+  path = dir;
+  if (path.back() != '/') {
+    path.push_back('/');
+  }
+  path.append(name);
+  return kind(path) == (uint32_t(elfclass_) << 16 | machine_);
+}
+
+uint32_t dependency_resolver::kind(const std::string &path) {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = files_.find(path);
+    if (it != files_.end()) {
+      return it->second;
+    }
+  }
+  uint32_t k = 0;
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd != -1) {
+    // e_ident, e_type and e_machine are at the same offsets in both
+    // classes.
+    unsigned char h[20];
+    if (pread(fd, h, sizeof(h), 0) == static_cast<ssize_t>(sizeof(h)) &&
+        memcmp(h, ELFMAG, SELFMAG) == 0) {
+      uint16_t machine = h[EI_DATA] == ELFDATA2MSB ? h[18] << 8 | h[19]
+                                                   : h[19] << 8 | h[18];
+      k = uint32_t(h[EI_CLASS]) << 16 | machine;
+    }
+    close(fd);
+  }
+  std::lock_guard<std::mutex> lock(mu_);
+  files_.emplace(path, k);
+  return k;
+}
+
+std::shared_ptr<const dependency_resolver::listing>
+dependency_resolver::list(const std::string &dir) {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = listings_.find(dir);
+    if (it != listings_.end()) {
+      return it->second;
+    }
+  }
+  std::shared_ptr<listing> names;
+  if (DIR *d = opendir(dir.c_str())) {
+    names = std::make_shared<listing>();
+    while (auto *e = readdir(d)) {
+      names->emplace(e->d_name);
+    }
+    closedir(d);
+  }
+  std::lock_guard<std::mutex> lock(mu_);
+  return listings_.emplace(dir, std::move(names)).first->second;
+}
+
+bool dependency_resolver::resolve(const std::string &path,
+                                  std::vector<closure_object> &objects,
+                                  std::string *emsg) {
+  objects.clear();
+  closure_object root;
+  root.name = path;
+  root.path = path;
+  root.source = source_path;
+  if (!read_elf_summary(path.c_str(), root.summary)) {
+    if (emsg) {
+      *emsg = path + ": not a readable ELF file";
+    }
+    return false;
+  }
+  target(root.summary.elfclass, root.summary.machine);
+  char real[PATH_MAX];
+  root_origin_ = dirname(realpath(path.c_str(), real) ? real : path);
+  objects.push_back(std::move(root));
+
+  // The names and paths the objects loaded so far go by.
+  std::unordered_map<std::string, uint32_t> names;
+  auto known = [&](uint32_t i) {
+    auto const &o = objects[i];
+    names.emplace(o.name, i);
+    if (!o.path.empty()) {
+      names.emplace(o.path, i);
+    }
+    if (o.summary.soname.present) {
+      names.emplace(o.summary.soname.value, i);
+    }
+  };
+  known(0);
+  std::vector<uint32_t> level{0};
+  while (!level.empty()) {
+    // Search for the needs of the level in parallel; objects and names
+    // are only read meanwhile.
+    std::vector<std::vector<closure_object>> results(level.size());
+    run_workers(opts_.jobs, level.size(), [&](size_t i, unsigned) {
+      auto const &needed = objects[level[i]].summary.needed;
+      auto &out = results[i];
+      out.resize(needed.size());
+      std::vector<search_dir> dirs;
+      bool planned = false;
+      for (size_t j = 0; j < needed.size(); j++) {
+        auto const &name = needed[j];
+        if (names.count(name) != 0) {
+          continue;
+        }
+        if (name.find('/') != std::string::npos) {
+          if (kind(name) == (uint32_t(elfclass_) << 16 | machine_)) {
+            out[j].path = name;
+            out[j].source = source_path;
+          }
+          continue;
+        }
+        if (!planned) {
+          dirs = search_path(objects, level[i]);
+          planned = true;
+        }
+        find(name, dirs, out[j]);
+      }
+    });
+    // Add what was found in need order, as the loader maps it.
+    std::vector<uint32_t> next;
+    for (size_t i = 0; i < level.size(); i++) {
+      uint32_t loader = level[i];
+      // objects grows below; the list of needs is copied out of it.
+      auto const needed = objects[loader].summary.needed;
+      for (size_t j = 0; j < needed.size(); j++) {
+        auto it = names.find(needed[j]);
+        if (it == names.end() && !results[i][j].path.empty()) {
+          it = names.find(results[i][j].path);
+        }
+        if (it != names.end()) {
+          objects[loader].needed.push_back(it->second);
+          continue;
+        }
+        closure_object o = std::move(results[i][j]);
+        o.name = needed[j];
+        o.loader = loader;
+        o.depth = objects[loader].depth + 1;
+        auto index = static_cast<uint32_t>(objects.size());
+        objects.push_back(std::move(o));
+        objects[loader].needed.push_back(index);
+        known(index);
+        next.push_back(index);
+      }
+    }
+    run_workers(opts_.jobs, next.size(), [&](size_t i, unsigned) {
+      auto &o = objects[next[i]];
+      if (!o.path.empty()) {
+        read_elf_summary(o.path.c_str(), o.summary);
+      }
+    });
+    for (auto index : next) {
+      known(index);
+    }
+    level = std::move(next);
+  }
+  return true;
+}
+
+} // namespace mz
@@ -0,0 +1,161 @@
+///
+#ifndef MZ_RESOLVER_HPP
+#define MZ_RESOLVER_HPP
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "summary.hpp"
+
+namespace mz {
+
+/// Where the loader finds a DT_NEEDED entry.
+enum search_source : uint8_t {
+  source_none,            /// not found
+  source_path,            /// the name has a slash and is opened as is
+  source_loaded,          /// an object already loaded goes by the name
+  source_rpath,           /// DT_RPATH of the needing object or its loaders
+  source_ld_library_path, /// LD_LIBRARY_PATH
+  source_runpath,         /// DT_RUNPATH of the needing object
+  source_cache,           /// the library cache (ld.so.cache)
+  source_default,         /// the system directories
+};
+
+const char *search_source_name(search_source s);
+
+/// Look soname up in a library cache for a consumer of the given class and
+/// machine, setting path to where it is. False if the cache has no entry.
+using library_cache_lookup =
+    std::function<bool(std::string_view soname, uint8_t elfclass,
+                       uint16_t machine, std::string &path)>;
+
+struct resolver_options {
+  std::vector<std::string> ld_library_path;
+  /// Prefixed to absolute search directories and cache results, to resolve
+  /// a tree built for another system. $ORIGIN is already inside it.
+  std::string sysroot;
+  /// $LIB and $PLATFORM; empty for what the target machine usually has.
+  std::string lib;
+  std::string platform;
+  /// The system directories; empty for those of the target machine.
+  std::vector<std::string> default_dirs;
+  library_cache_lookup cache;
+  unsigned jobs{1};
+};
+
+/// A directory the loader tries for a name.
+struct search_dir {
+  std::string dir;
+  search_source source{source_none};
+  uint32_t owner{UINT32_MAX}; /// the object of the RPATH or RUNPATH entry
+  uint32_t element{UINT32_MAX}; /// its place in that RPATH or RUNPATH
+  bool exists{true};            /// false if it is missing or unreadable
+};
+
+/// One object of a dependency closure.
+struct closure_object {
+  std::string name; /// the DT_NEEDED name; the path given for the root
+  std::string path; /// empty if not found
+  search_source source{source_none};
+  uint32_t loader{UINT32_MAX}; /// the object that first needed it
+  uint32_t owner{UINT32_MAX}; /// the object whose RPATH or RUNPATH found it
+  uint32_t element{UINT32_MAX}; /// the place of the entry in it
+  uint32_t depth{0};
+  /// The directories tried in vain before it was found, in search order;
+  /// all of them if it was not. Empty for the root.
+  std::vector<search_dir> failed;
+  elf_summary summary; /// valid if found and readable
+  /// The object each DT_NEEDED entry resolved to, in order.
+  std::vector<uint32_t> needed;
+};
+
+/// How many objects of a closure each element of the root's RPATH or
+/// RUNPATH (source_rpath or source_runpath) provided, in order.
+std::vector<uint32_t>
+search_path_hits(const std::vector<closure_object> &objects,
+                 search_source source);
+
+/// dependency_resolver computes what the glibc loader would map for a
+/// program without running it. A DT_NEEDED name is searched for in
+///
+///   DT_RPATH of the needing object, then of the object that loaded it,
+///            and so on up to the executable (only if the needing object
+///            has no DT_RUNPATH)
+///   LD_LIBRARY_PATH
+///   DT_RUNPATH of the needing object
+///   the library cache
+///   the system directories
+///
+/// with $ORIGIN, $LIB and $PLATFORM expanded, taking the first file of the
+/// root's class and machine. A name an object already in the closure goes
+/// by is not searched for. Lookups are memoized by name and search path,
+/// and directory listings are read once, so one resolver answers a batch
+/// of programs from memory after the first few.
+class dependency_resolver {
+public:
+  static constexpr uint32_t none = UINT32_MAX;
+  explicit dependency_resolver(resolver_options opts);
+  dependency_resolver(const dependency_resolver &) = delete;
+  dependency_resolver &operator=(const dependency_resolver &) = delete;
+  /// The closure of the program at path in load order: breadth-first, the
+  /// dependencies of each level in the order they are needed. Objects of a
+  /// level are read and searched for in parallel. False if path is not a
+  /// readable ELF file. One resolve runs at a time.
+  bool resolve(const std::string &path, std::vector<closure_object> &objects,
+               std::string *emsg);
+  /// The directories of the RPATH (source_rpath) or RUNPATH
+  /// (source_runpath) of an object of the last closure, one per element.
+  std::vector<search_dir> elements(const std::vector<closure_object> &objects,
+                                   uint32_t index, search_source source) const;
+  /// Whether dir holds a file name the loader would take for the last root.
+  bool provides(const std::string &dir, const std::string &name);
+
+private:
+  /// A search outcome, with directories as places in the search path
+  /// followed by the system directories, so it holds for any object with
+  /// the same search path.
+  struct found {
+    std::string path;
+    search_source source{source_none};
+    uint32_t hit{none};
+    std::vector<uint32_t> failed;
+  };
+  using listing = std::unordered_set<std::string>;
+  void target(uint8_t elfclass, uint16_t machine);
+  std::string rooted(std::string dir) const;
+  std::vector<search_dir>
+  search_path(const std::vector<closure_object> &objects,
+              uint32_t index) const;
+  void expand(std::string_view list, const std::string &origin,
+              search_source source, uint32_t owner,
+              std::vector<search_dir> &dirs) const;
+  void find(const std::string &name, const std::vector<search_dir> &dirs,
+            closure_object &o);
+  found lookup(const std::string &name, const std::vector<search_dir> &dirs);
+  found search(const std::string &name, const std::vector<search_dir> &dirs);
+  bool probe(const std::string &dir, const std::string &name,
+             std::string &path);
+  uint32_t kind(const std::string &path);
+  std::shared_ptr<const listing> list(const std::string &dir);
+
+  resolver_options opts_;
+  uint8_t elfclass_{0};
+  uint16_t machine_{0};
+  std::string lib_;
+  std::string platform_;
+  std::vector<std::string> default_dirs_;
+  std::string root_origin_;
+  std::mutex mu_;
+  std::unordered_map<std::string, found> lookups_;
+  std::unordered_map<std::string, std::shared_ptr<const listing>> listings_;
+  std::unordered_map<std::string, uint32_t> files_; /// class << 16 | machine
+};
+
+} // namespace mz
+
+#endif
@@ -0,0 +1,234 @@
+///
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include "shmcache.hpp"
+
+namespace mz {
+
+constexpr uint32_t shm_magic = 0x4d5a5348; // "MZSH"
+constexpr uint32_t shm_version = 1;
+
+enum shm_state : uint32_t { state_empty, state_initializing, state_ready };
+
+struct shm_cache::header {
+  std::atomic<uint32_t> state;
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slot_count; /// a power of two
+  uint32_t slot_size;
+  uint32_t reserved;
+  std::atomic<uint64_t> hand; /// the CLOCK hand, shared by all processes
+  char padding[32];
+};
+
+constexpr size_t payload_capacity = shm_cache::slot_size - 56;
+
+struct shm_cache::slot {
+  /// 0: never written, odd: being written, even: published.
+  std::atomic<uint64_t> seq;
+  std::atomic<uint32_t> referenced;
+  uint32_t length;
+  uint64_t key[5];
+  char payload[payload_capacity];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shared-memory counters must be address-free");
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "shared-memory counters must be address-free");
+
+static void make_key(const file_identity &id, uint64_t key[5]) {
+  key[0] = id.dev;
+  key[1] = id.ino;
+  key[2] = id.size;
+  key[3] = static_cast<uint64_t>(id.mtime_ns);
+  key[4] = static_cast<uint64_t>(id.ctime_ns);
+}
+
+shm_cache::~shm_cache() {
+  if (base_ != nullptr) {
+    ::munmap(base_, size_);
+  }
+}
+
+shm_cache::slot *shm_cache::at(uint64_t index) const {
+  static_assert(sizeof(header) == 64, "");
+  static_assert(sizeof(slot) == slot_size, "");
+  return reinterpret_cast<slot *>(base_ + sizeof(header) +
+                                  (index & mask_) * header_->slot_size);
+}
+
+bool shm_cache::open(const std::string &name, std::string *emsg,
+                     uint32_t slots) {
+  auto fail = [&](const char *what) {
+    if (emsg) {
+      *emsg = std::string("Error ") + what + " shared cache " + name + ": " +
+              strerror(errno);
+    }
+    return false;
+  };
+  uint32_t count = window;
+  while (count < slots) {
+    count <<= 1;
+  }
+  int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd == -1) {
+    return fail("opening");
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    return fail("opening");
+  }
+  // Another user could create the name first and feed us summaries.
+  if (st.st_uid != ::geteuid() || (st.st_mode & 077) != 0) {
+    ::close(fd);
+    errno = EACCES;
+    return fail("trusting");
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  if (size == 0) {
+    // Every creator sizes the segment the same way, so racing here is
+    // harmless; the new pages read as zero, which is an empty table.
+    size = sizeof(header) + static_cast<size_t>(count) * slot_size;
+    if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+      ::close(fd);
+      return fail("sizing");
+    }
+  }
+  if (size < sizeof(header)) {
+    ::close(fd);
+    errno = EINVAL;
+    return fail("mapping");
+  }
+  void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    return fail("mapping");
+  }
+  auto h = static_cast<header *>(p);
+  uint32_t state = state_empty;
+  if (h->state.compare_exchange_strong(state, state_initializing,
+                                       std::memory_order_acq_rel)) {
+    h->magic = shm_magic;
+    h->version = shm_version;
+    h->slot_size = slot_size;
+    h->slot_count = static_cast<uint32_t>((size - sizeof(header)) / slot_size);
+    h->state.store(state_ready, std::memory_order_release);
+  } else {
+    // Another process is setting it up; that takes microseconds.
+    for (int i = 0; i < 1000 && h->state.load(std::memory_order_acquire) !=
+                                    state_ready;
+         i++) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+  uint32_t n = h->slot_count;
+  if (h->state.load(std::memory_order_acquire) != state_ready ||
+      h->magic != shm_magic || h->version != shm_version ||
+      h->slot_size != slot_size || n < window || (n & (n - 1)) != 0 ||
+      sizeof(header) + static_cast<size_t>(n) * slot_size > size) {
+    ::munmap(p, size);
+    errno = EPROTO;
+    return fail("attaching");
+  }
+  base_ = static_cast<char *>(p);
+  size_ = size;
+  header_ = h;
+  mask_ = n - 1;
+  return true;
+}
+
+bool shm_cache::find(const file_identity &id, elf_summary &s) {
+  if (header_ == nullptr) {
+    return false;
+  }
+  uint64_t key[5];
+  make_key(id, key);
+  uint64_t first = identity_hash()(id);
+  char payload[payload_capacity];
+  for (uint32_t i = 0; i < window; i++) {
+    slot *sl = at(first + i);
+    uint64_t seq = sl->seq.load(std::memory_order_acquire);
+    if (seq == 0 || (seq & 1) != 0 || memcmp(sl->key, key, sizeof(key)) != 0) {
+      continue;
+    }
+    uint32_t length = sl->length;
+    if (length > payload_capacity) {
+      continue;
+    }
+    memcpy(payload, sl->payload, length);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sl->seq.load(std::memory_order_relaxed) != seq ||
+        memcmp(sl->key, key, sizeof(key)) != 0) {
+      // Overwritten while we copied it.
+      continue;
+    }
+    if (decode_summary(std::string_view(payload, length), s)) {
+      sl->referenced.store(1, std::memory_order_relaxed);
+      hits_++;
+      return true;
+    }
+  }
+  misses_++;
+  return false;
+}
+
+void shm_cache::store(const file_identity &id, const elf_summary &s) {
+  if (header_ == nullptr) {
+    return;
+  }
+  std::string payload;
+  encode_summary(s, payload);
+  if (payload.size() > payload_capacity) {
+    return;
+  }
+  uint64_t key[5];
+  make_key(id, key);
+  uint64_t first = identity_hash()(id);
+  // Reuse the slot of the same key or a free one in the window, else
+  // sweep the window from the hand and take the first slot not hit since
+  // the last sweep.
+  slot *victim = nullptr;
+  for (uint32_t i = 0; i < window && victim == nullptr; i++) {
+    slot *sl = at(first + i);
+    uint64_t seq = sl->seq.load(std::memory_order_acquire);
+    if (seq == 0 ||
+        ((seq & 1) == 0 && memcmp(sl->key, key, sizeof(key)) == 0)) {
+      victim = sl;
+    }
+  }
+  if (victim == nullptr) {
+    uint64_t hand = header_->hand.fetch_add(1, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < window && victim == nullptr; i++) {
+      slot *sl = at(first + (hand + i) % window);
+      if (sl->referenced.exchange(0, std::memory_order_relaxed) == 0) {
+        victim = sl;
+      }
+    }
+    if (victim == nullptr) {
+      victim = at(first + hand % window);
+    }
+  }
+  uint64_t seq = victim->seq.load(std::memory_order_acquire);
+  if ((seq & 1) != 0 ||
+      !victim->seq.compare_exchange_strong(seq, seq + 1,
+                                           std::memory_order_acquire)) {
+    // Someone else is writing it; their entry is as good as ours.
+    return;
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(victim->key, key, sizeof(key));
+  victim->length = static_cast<uint32_t>(payload.size());
+  memcpy(victim->payload, payload.data(), payload.size());
+  victim->referenced.store(1, std::memory_order_relaxed);
+  victim->seq.store(seq + 2, std::memory_order_release);
+}
+
+} // namespace mz
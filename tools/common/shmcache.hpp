@@ -0,0 +1,62 @@
+///
+#ifndef MZ_SHMCACHE_HPP
+#define MZ_SHMCACHE_HPP
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "identity.hpp"
+#include "summary.hpp"
+
+namespace mz {
+
+/// shm_cache is a table of ELF summaries in a POSIX shared-memory segment,
+/// shared by every process that opens the same name. It lets the many
+/// short-lived processes of a parallel build reuse each other's parses
+/// without a daemon.
+///
+/// The table is a fixed array of fixed-size slots, so the segment never
+/// grows. A key hashes to a window of `window` consecutive slots. Every slot
+/// is guarded by a sequence counter: a writer claims a slot by moving the
+/// counter to odd with a CAS and publishes by moving it to the next even
+/// value; readers copy the slot and retry or give up if the counter moved.
+/// Nobody ever waits for a lock, and a process killed mid-write costs one
+/// slot until the segment is removed.
+///
+/// When a window is full the victim is chosen by CLOCK: slots hit since the
+/// hand last passed have their reference bit cleared and are spared once.
+class shm_cache {
+public:
+  static constexpr uint32_t default_slots = 8192;
+  static constexpr uint32_t slot_size = 1024;
+  static constexpr uint32_t window = 8;
+  shm_cache() = default;
+  shm_cache(const shm_cache &) = delete;
+  shm_cache &operator=(const shm_cache &) = delete;
+  ~shm_cache();
+  /// Open or create the segment. name is a shm_open(3) name such as
+  /// "/cmchrpath". slots applies only when the segment is created; a
+  /// segment of another version is refused, remove it from /dev/shm.
+  bool open(const std::string &name, std::string *emsg,
+            uint32_t slots = default_slots);
+  bool find(const file_identity &id, elf_summary &s);
+  /// Summaries that do not fit in a slot are not stored.
+  void store(const file_identity &id, const elf_summary &s);
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+private:
+  struct header;
+  struct slot;
+  slot *at(uint64_t index) const;
+  char *base_{nullptr};
+  size_t size_{0};
+  header *header_{nullptr};
+  uint64_t mask_{0};
+  std::atomic_size_t hits_{0};
+  std::atomic_size_t misses_{0};
+};
+
+} // namespace mz
+
+#endif
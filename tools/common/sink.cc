@@ -0,0 +1,124 @@
+///
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include "sink.hpp"
+
+namespace mz {
+
+bool write_full(int fd, const char *data, size_t size) {
+  while (size != 0) {
+    auto n = ::write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool read_file(const char *path, std::string &text) {
+  bool stdin_ = path[0] == '-' && path[1] == 0;
+  int fd = stdin_ ? STDIN_FILENO : ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  char buf[64 * 1024];
+  ssize_t n;
+  bool result = true;
+  while ((n = ::read(fd, buf, sizeof(buf))) != 0) {
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      result = false;
+      break;
+    }
+    text.append(buf, static_cast<size_t>(n));
+  }
+  if (!stdin_) {
+    int e = errno;
+    ::close(fd);
+    errno = e;
+  }
+  return result;
+}
+
+bool replace_file(const std::string &path, const char *data, size_t size) {
+  auto tmp = path + ".tmp." + std::to_string(getpid());
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    return false;
+  }
+  if (!write_full(fd, data, size) || ::fsync(fd) != 0) {
+    int e = errno;
+    ::close(fd);
+    ::unlink(tmp.c_str());
+    errno = e;
+    return false;
+  }
+  ::close(fd);
+  if (::rename(tmp.c_str(), path.c_str()) != 0) {
+    int e = errno;
+    ::unlink(tmp.c_str());
+    errno = e;
+    return false;
+  }
+  return true;
+}
+
+void ordered_sink::commit(size_t seq, std::string &buffer) {
+  std::unique_lock<std::mutex> lock(mu_);
+  advanced_.wait(lock, [&] { return seq - next_ < window_; });
+  if (seq != next_) {
+    // Arrived early, park it until its predecessors are done.
+    pending_[seq].swap(buffer);
+    buffer.clear();
+    return;
+  }
+  out_.append(buffer);
+  buffer.clear();
+  next_++;
+  for (auto it = pending_.begin();
+       it != pending_.end() && it->first == next_;
+       it = pending_.erase(it)) {
+    out_.append(it->second);
+    next_++;
+  }
+  advanced_.notify_all();
+  if (out_.size() >= threshold_) {
+    drain(lock);
+  }
+}
+
+void ordered_sink::admit(size_t seq) {
+  std::unique_lock<std::mutex> lock(mu_);
+  advanced_.wait(lock, [&] { return seq - next_ < window_; });
+}
+
+void ordered_sink::flush() {
+  std::unique_lock<std::mutex> lock(mu_);
+  drain(lock);
+}
+
+// Hand the ready text to the writer outside the main lock. wmu_ is acquired
+// before mu_ is released so chunks are written in the order they were
+// formed.
+void ordered_sink::drain(std::unique_lock<std::mutex> &lock) {
+  if (out_.empty()) {
+    return;
+  }
+  std::string chunk;
+  chunk.reserve(threshold_);
+  chunk.swap(out_);
+  std::lock_guard<std::mutex> wlock(wmu_);
+  lock.unlock();
+  write_full(fd_, chunk.data(), chunk.size());
+}
+
+} // namespace mz
@@ -0,0 +1,66 @@
+///
+#ifndef MZ_SINK_HPP
+#define MZ_SINK_HPP
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace mz {
+
+/// ordered_sink receives the output of items processed by parallel workers
+/// and emits it in input order. Text is accumulated and written with a
+/// single write(2) once it grows past the flush threshold, so workers never
+/// contend on the stdio lock and the output of a run is deterministic.
+/// Output that arrives early waits for its predecessors, at most window
+/// items of it: a stalled item makes the ones after it wait, rather than
+/// their output pile up.
+class ordered_sink {
+public:
+  explicit ordered_sink(int fd, size_t threshold = 64 * 1024,
+                        size_t window = 1024)
+      : fd_(fd), threshold_(threshold), window_(window) {}
+  ordered_sink(const ordered_sink &) = delete;
+  ordered_sink &operator=(const ordered_sink &) = delete;
+  ~ordered_sink() { flush(); }
+  /// Commit the output of item `seq`. Every seq in [0, N) must be committed
+  /// exactly once. Blocks while seq is window or more items past the
+  /// oldest uncommitted one, which must be on its way from another thread.
+  /// The buffer is left empty with its capacity intact so a worker can
+  /// reuse it for its next item.
+  void commit(size_t seq, std::string &buffer);
+  /// Block until item `seq` is within the window. A producer that admits
+  /// items this way keeps commit from ever blocking, so workers that hand
+  /// items on through queues cannot all be stuck behind a full one.
+  void admit(size_t seq);
+  /// Write everything that is ready.
+  void flush();
+  int fd() const { return fd_; }
+
+private:
+  void drain(std::unique_lock<std::mutex> &lock);
+  int fd_{-1};
+  size_t threshold_{0};
+  size_t window_{0};
+  size_t next_{0};
+  std::string out_;
+  std::map<size_t, std::string> pending_;
+  std::mutex mu_;
+  std::condition_variable advanced_; /// next_ moved
+  std::mutex wmu_; /// held while a chunk is being written, keeps chunks ordered
+};
+
+/// Write the whole buffer to fd, retrying on EINTR and short writes.
+bool write_full(int fd, const char *data, size_t size);
+
+/// Read a whole file ("-" is stdin) into text. errno is set on failure.
+bool read_file(const char *path, std::string &text);
+
+/// Replace path with data atomically: write a temporary file next to it,
+/// fsync, then rename over.
+bool replace_file(const std::string &path, const char *data, size_t size);
+
+} // namespace mz
+
+#endif
@@ -0,0 +1,139 @@
+///
+#include <cstring>
+#include "summary.hpp"
+
+namespace mz {
+
+template <typename T> static void put(std::string &out, T v) {
+  out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+template <typename T> static bool get(std::string_view &in, T &v) {
+  if (in.size() < sizeof(v)) {
+    return false;
+  }
+  memcpy(&v, in.data(), sizeof(v));
+  in.remove_prefix(sizeof(v));
+  return true;
+}
+
+static void put_string(std::string &out, const std::string &s) {
+  put(out, static_cast<uint32_t>(s.size()));
+  out.append(s);
+}
+
+static bool get_string(std::string_view &in, std::string &s) {
+  uint32_t size;
+  if (!get(in, size) || in.size() < size) {
+    return false;
+  }
+  s.assign(in.data(), size);
+  in.remove_prefix(size);
+  return true;
+}
+
+// Layout: flags, the header bytes, then for each present string its
+// position, size and value, then the NEEDED count and values. Host byte
+// order; the encoding never leaves the machine.
+void encode_summary(const elf_summary &s, std::string &out) {
+  uint8_t flags = (s.valid ? 1 : 0) | (s.soname.present ? 2 : 0) |
+                  (s.rpath.present ? 4 : 0) | (s.runpath.present ? 8 : 0);
+  put(out, flags);
+  put(out, s.elfclass);
+  put(out, s.endian);
+  put(out, s.version);
+  put(out, s.osabi);
+  put(out, s.abiversion);
+  put(out, s.type);
+  put(out, s.machine);
+  for (auto const *e : {&s.soname, &s.rpath, &s.runpath}) {
+    if (e->present) {
+      put(out, e->position);
+      put(out, e->size);
+      put_string(out, e->value);
+    }
+  }
+  put(out, static_cast<uint32_t>(s.needed.size()));
+  for (auto const &n : s.needed) {
+    put_string(out, n);
+  }
+}
+
+bool decode_summary(std::string_view in, elf_summary &s) {
+  s = elf_summary();
+  uint8_t flags;
+  if (!get(in, flags) || !get(in, s.elfclass) || !get(in, s.endian) ||
+      !get(in, s.version) || !get(in, s.osabi) || !get(in, s.abiversion) ||
+      !get(in, s.type) || !get(in, s.machine)) {
+    return false;
+  }
+  s.valid = (flags & 1) != 0;
+  uint8_t bit = 2;
+  for (auto *e : {&s.soname, &s.rpath, &s.runpath}) {
+    if ((flags & bit) != 0) {
+      if (!get(in, e->position) || !get(in, e->size) ||
+          !get_string(in, e->value)) {
+        return false;
+      }
+      e->present = true;
+    }
+    bit <<= 1;
+  }
+  uint32_t count;
+  if (!get(in, count) || count > in.size() / sizeof(uint32_t)) {
+    return false;
+  }
+  s.needed.resize(count);
+  for (auto &n : s.needed) {
+    if (!get_string(in, n)) {
+      return false;
+    }
+  }
+  return in.empty();
+}
+
+bool summary_cache::find(const std::string &path, const file_identity &id,
+                         elf_summary &s) {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = entries_.find(path);
+  if (it == entries_.end()) {
+    return false;
+  }
+  if (it->second.id != id) {
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+    return false;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second.lru);
+  s = it->second.summary;
+  return true;
+}
+
+void summary_cache::store(const std::string &path, const file_identity &id,
+                          const elf_summary &s) {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = entries_.find(path);
+  if (it != entries_.end()) {
+    it->second.id = id;
+    it->second.summary = s;
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    return;
+  }
+  if (entries_.size() >= capacity_ && !lru_.empty()) {
+    entries_.erase(lru_.back());
+    lru_.pop_back();
+  }
+  lru_.push_front(path);
+  entries_.emplace(path, entry{id, s, lru_.begin()});
+}
+
+void summary_cache::erase(const std::string &path) {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = entries_.find(path);
+  if (it != entries_.end()) {
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+  }
+}
+
+} // namespace mz
@@ -0,0 +1,74 @@
+///
+#ifndef MZ_SUMMARY_HPP
+#define MZ_SUMMARY_HPP
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "identity.hpp"
+
+namespace mz {
+
+/// A string from the dynamic string table and the slot it occupies.
+struct elf_string {
+  std::string value;
+  uint64_t position{0};
+  uint64_t size{0};
+  bool present{false};
+};
+
+/// What the tools need to know about a parsed ELF file, without the file.
+struct elf_summary {
+  bool valid{false};
+  uint8_t elfclass{0}; /// ELFCLASS32 or ELFCLASS64
+  uint8_t endian{0};   /// ELFDATA2LSB or ELFDATA2MSB
+  uint8_t version{0}; /// EI_VERSION
+  uint8_t osabi{0};
+  uint8_t abiversion{0};
+  uint16_t type{0};    /// e_type
+  uint16_t machine{0}; /// e_machine
+  elf_string soname;
+  elf_string rpath;
+  elf_string runpath;
+  std::vector<std::string> needed;
+  /// RPATH if present, else RUNPATH: what `cmchrpath -l` reports.
+  const std::string &search_path() const {
+    return rpath.present ? rpath.value : runpath.value;
+  }
+};
+
+/// Serialize a summary into a flat byte string, and back. decode_summary
+/// rejects truncated or malformed input.
+void encode_summary(const elf_summary &s, std::string &out);
+bool decode_summary(std::string_view in, elf_summary &s);
+
+/// summary_cache keeps summaries in memory keyed by path and hands them out
+/// only while the file's identity is unchanged. It holds at most `capacity`
+/// entries and evicts the least recently used.
+class summary_cache {
+public:
+  explicit summary_cache(size_t capacity = 1 << 16) : capacity_(capacity) {}
+  bool find(const std::string &path, const file_identity &id,
+            elf_summary &s);
+  void store(const std::string &path, const file_identity &id,
+             const elf_summary &s);
+  void erase(const std::string &path);
+
+private:
+  struct entry {
+    file_identity id;
+    elf_summary summary;
+    std::list<std::string>::iterator lru;
+  };
+  size_t capacity_;
+  std::unordered_map<std::string, entry> entries_;
+  std::list<std::string> lru_; /// front is most recent
+  std::mutex mu_;
+};
+
+} // namespace mz
+
+#endif
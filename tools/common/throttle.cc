@@ -0,0 +1,134 @@
+///
+#include <algorithm>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#include "throttle.hpp"
+
+namespace mz {
+
+io_throttle::clock::time_point
+io_throttle::reserve(clock::time_point &next, uint64_t amount, uint64_t rate,
+                     clock::time_point now) {
+  if (rate == 0) {
+    return now;
+  }
+  // Idle time beyond the burst allowance is not banked.
+  if (next < now - burst_) {
+    next = now - burst_;
+  }
+  next += std::chrono::duration_cast<clock::duration>(
+      std::chrono::duration<double>(static_cast<double>(amount) /
+                                    static_cast<double>(rate)));
+  return next;
+}
+
+void io_throttle::charge(uint64_t bytes, uint64_t ops) {
+  if (!enabled()) {
+    return;
+  }
+  clock::time_point until;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto now = clock::now();
+    // The work is already done; wait until both timelines have paid for it.
+    until = (std::max)(reserve(next_bytes_, bytes, bytes_per_sec_, now),
+                       reserve(next_ops_, ops, ops_per_sec_, now));
+  }
+  std::this_thread::sleep_until(until);
+}
+
+bool parse_quantity(std::string_view sv, uint64_t &value) {
+  if (sv.empty()) {
+    return false;
+  }
+  uint64_t v = 0;
+  size_t i = 0;
+  for (; i < sv.size() && sv[i] >= '0' && sv[i] <= '9'; i++) {
+    uint64_t d = static_cast<uint64_t>(sv[i] - '0');
+    if (v > (UINT64_MAX - d) / 10) {
+      return false;
+    }
+    v = v * 10 + d;
+  }
+  if (i == 0) {
+    return false;
+  }
+  if (i + 1 == sv.size()) {
+    unsigned shift;
+    switch (sv[i]) {
+    case 'k':
+    case 'K':
+      shift = 10;
+      break;
+    case 'm':
+    case 'M':
+      shift = 20;
+      break;
+    case 'g':
+    case 'G':
+      shift = 30;
+      break;
+    default:
+      return false;
+    }
+    if (v > UINT64_MAX >> shift) {
+      return false;
+    }
+    v <<= shift;
+  } else if (i != sv.size()) {
+    return false;
+  }
+  value = v;
+  return true;
+}
+
+bool set_ioprio_idle() {
+#if defined(__linux__) && defined(SYS_ioprio_set)
+  // From linux/ioprio.h, which is not always installed.
+  constexpr int ioprio_class_shift = 13;
+  constexpr int ioprio_class_idle = 3;
+  constexpr int ioprio_who_process = 1;
+  return syscall(SYS_ioprio_set, ioprio_who_process, 0,
+                 ioprio_class_idle << ioprio_class_shift) == 0;
+#else
+  return false;
+#endif
+}
+
+bool drop_cached_ranges(
+    const char *path,
+    const std::vector<std::pair<unsigned long, unsigned long>> &ranges) {
+#if defined(POSIX_FADV_DONTNEED)
+  if (ranges.empty()) {
+    return true;
+  }
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  static const unsigned long page =
+      static_cast<unsigned long>(sysconf(_SC_PAGESIZE));
+  bool result = true;
+  for (const auto &r : ranges) {
+    auto begin = r.first & ~(page - 1);
+    auto end = (r.first + r.second + page - 1) & ~(page - 1);
+    if (posix_fadvise(fd, static_cast<off_t>(begin),
+                      static_cast<off_t>(end - begin),
+                      POSIX_FADV_DONTNEED) != 0) {
+      result = false;
+    }
+  }
+  ::close(fd);
+  return result;
+#else
+  (void)path;
+  (void)ranges;
+  return false;
+#endif
+}
+
+} // namespace mz
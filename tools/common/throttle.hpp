@@ -0,0 +1,53 @@
+///
+#ifndef MZ_THROTTLE_HPP
+#define MZ_THROTTLE_HPP
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace mz {
+
+/// io_throttle caps the byte rate and operation rate of all workers
+/// together. Each charge() appends its cost to a virtual timeline per limit
+/// and sleeps until the timeline has caught up; up to `burst` worth of idle
+/// time can be spent at once. A limit of zero disables that dimension.
+class io_throttle {
+public:
+  using clock = std::chrono::steady_clock;
+  io_throttle() = default;
+  io_throttle(uint64_t bytes_per_sec, uint64_t ops_per_sec)
+      : bytes_per_sec_(bytes_per_sec), ops_per_sec_(ops_per_sec) {}
+  bool enabled() const { return bytes_per_sec_ != 0 || ops_per_sec_ != 0; }
+  /// Account for I/O already done and wait until the budget covers it.
+  void charge(uint64_t bytes, uint64_t ops);
+
+private:
+  clock::time_point reserve(clock::time_point &next, uint64_t amount,
+                            uint64_t rate, clock::time_point now);
+  uint64_t bytes_per_sec_{0};
+  uint64_t ops_per_sec_{0};
+  clock::duration burst_{std::chrono::milliseconds(100)};
+  clock::time_point next_bytes_{};
+  clock::time_point next_ops_{};
+  std::mutex mu_;
+};
+
+/// Parse "512K", "20M", "1G" style quantities (powers of 1024).
+bool parse_quantity(std::string_view sv, uint64_t &value);
+
+/// Put the calling process in the idle I/O scheduling class. Threads created
+/// afterwards inherit it. Returns false where unsupported.
+bool set_ioprio_idle();
+
+/// Drop the pages backing the given (offset, length) ranges of the file
+/// from the page cache. Ranges are widened to page boundaries.
+bool drop_cached_ranges(
+    const char *path,
+    const std::vector<std::pair<unsigned long, unsigned long>> &ranges);
+
+} // namespace mz
+
+#endif
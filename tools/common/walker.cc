@@ -0,0 +1,159 @@
+///
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "walker.hpp"
+
+namespace mz {
+
+bool shard_spec::parse(std::string_view sv) {
+  auto pos = sv.find('/');
+  if (pos == std::string_view::npos || pos == 0 || pos + 1 == sv.size()) {
+    return false;
+  }
+  uint64_t v[2] = {0, 0};
+  std::string_view part[2] = {sv.substr(0, pos), sv.substr(pos + 1)};
+  for (int i = 0; i < 2; i++) {
+    for (auto c : part[i]) {
+      if (c < '0' || c > '9') {
+        return false;
+      }
+      v[i] = v[i] * 10 + static_cast<uint64_t>(c - '0');
+      if (v[i] > UINT32_MAX) {
+        return false;
+      }
+    }
+  }
+  if (v[1] == 0 || v[0] >= v[1]) {
+    return false;
+  }
+  index = static_cast<uint32_t>(v[0]);
+  count = static_cast<uint32_t>(v[1]);
+  return true;
+}
+
+bool shard_spec::selects(std::string_view relative) const {
+  if (count <= 1) {
+    return true;
+  }
+  return fnv1a64(normalize_relative(relative)) % count == index;
+}
+
+std::string_view normalize_relative(std::string_view sv) {
+  while (sv.size() >= 2 && sv[0] == '.' && sv[1] == '/') {
+    sv.remove_prefix(2);
+    while (!sv.empty() && sv[0] == '/') {
+      sv.remove_prefix(1);
+    }
+  }
+  return sv;
+}
+
+bool walk_tree(const std::string &root, const walk_callback &fn) {
+  // Iterative depth-first walk; the stack holds directories relative to
+  // root.
+  std::vector<std::string> stack;
+  std::string base = root;
+  while (base.size() > 1 && base.back() == '/') {
+    base.pop_back();
+  }
+  DIR *top = opendir(base.c_str());
+  if (top == nullptr) {
+    return false;
+  }
+  closedir(top);
+  stack.emplace_back();
+  std::string path;
+  std::string relative;
+  while (!stack.empty()) {
+    auto dir = std::move(stack.back());
+    stack.pop_back();
+    auto dirpath = dir.empty() ? base : base + "/" + dir;
+    DIR *d = opendir(dirpath.c_str());
+    if (d == nullptr) {
+      continue;
+    }
+    struct dirent *e;
+    while ((e = readdir(d)) != nullptr) {
+      std::string_view name(e->d_name);
+      if (name == "." || name == "..") {
+        continue;
+      }
+      relative.assign(dir);
+      if (!relative.empty()) {
+        relative.push_back('/');
+      }
+      relative.append(name);
+      path.assign(base).append("/").append(relative);
+      auto type = e->d_type;
+      if (type == DT_UNKNOWN) {
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0) {
+          continue;
+        }
+        type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : 0;
+      }
+      if (type == DT_DIR) {
+        stack.push_back(relative);
+      } else if (type == DT_REG) {
+        fn(path, relative);
+      }
+    }
+    closedir(d);
+  }
+  return true;
+}
+
+bool is_directory(const char *path) {
+  struct stat st;
+  return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool is_elf_file(const char *path) { return sniff_elf(path, false); }
+
+// Decode an unsigned field of the given width and byte order.
+static uint64_t decode(const unsigned char *p, int width, bool msb) {
+  uint64_t v = 0;
+  for (int i = 0; i < width; i++) {
+    v |= static_cast<uint64_t>(p[msb ? width - 1 - i : i]) << (8 * i);
+  }
+  return v;
+}
+
+bool sniff_elf(const char *path, bool prefetch) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  // Large enough for the 64-bit ELF header.
+  unsigned char h[64] = {0};
+  auto n = pread(fd, h, prefetch ? sizeof(h) : 4, 0);
+  bool elf = n >= 4 && h[0] == 0x7f && h[1] == 'E' && h[2] == 'L' &&
+             h[3] == 'F';
+#if defined(POSIX_FADV_WILLNEED)
+  if (elf && prefetch && n == static_cast<ssize_t>(sizeof(h))) {
+    bool msb = h[5] == 2;
+    uint64_t shoff = 0, shentsize = 0, shnum = 0;
+    if (h[4] == 2) {
+      shoff = decode(h + 0x28, 8, msb);
+      shentsize = decode(h + 0x3a, 2, msb);
+      shnum = decode(h + 0x3c, 2, msb);
+    } else if (h[4] == 1) {
+      shoff = decode(h + 0x20, 4, msb);
+      shentsize = decode(h + 0x2e, 2, msb);
+      shnum = decode(h + 0x30, 2, msb);
+    }
+    if (shoff != 0 && shnum != 0) {
+      posix_fadvise(fd, static_cast<off_t>(shoff),
+                    static_cast<off_t>(shentsize * shnum),
+                    POSIX_FADV_WILLNEED);
+    }
+  }
+#endif
+  close(fd);
+  return elf;
+}
+
+} // namespace mz
@@ -0,0 +1,59 @@
+///
+#ifndef MZ_WALKER_HPP
+#define MZ_WALKER_HPP
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace mz {
+
+/// shard_spec selects a stable subset of paths: `i/N` keeps the paths whose
+/// hash modulo N equals i (0 <= i < N). The hash is taken over the path
+/// relative to the walk root (or the manifest entry as written), so every
+/// node computes the same partition regardless of traversal order or mount
+/// point.
+struct shard_spec {
+  uint32_t index{0};
+  uint32_t count{1};
+  bool parse(std::string_view sv);
+  bool selects(std::string_view relative) const;
+};
+
+/// 64-bit FNV-1a, used where a hash must be stable across builds and hosts.
+/// A seed other than 0 perturbs the offset basis, giving a different hash
+/// under which names that collide may not.
+inline uint64_t fnv1a64(std::string_view sv, uint64_t seed = 0) {
+  uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+  for (auto c : sv) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+/// Strip leading "./" components so equivalent spellings hash the same.
+std::string_view normalize_relative(std::string_view sv);
+
+using walk_callback =
+    std::function<void(const std::string &path, std::string_view relative)>;
+
+/// Recursively enumerate the regular files under root without following
+/// symbolic links. Unreadable directories are skipped. Returns false if root
+/// itself cannot be opened.
+bool walk_tree(const std::string &root, const walk_callback &fn);
+
+/// True if path names a directory.
+bool is_directory(const char *path);
+
+/// True if the file starts with the ELF magic.
+bool is_elf_file(const char *path);
+
+/// Like is_elf_file, and when prefetch is set, ask the kernel to start
+/// reading the section header table (which usually sits at the end of the
+/// file) so a parser reaching for it next finds it in the page cache.
+bool sniff_elf(const char *path, bool prefetch);
+
+} // namespace mz
+
+#endif
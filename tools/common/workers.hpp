@@ -0,0 +1,73 @@
+///
+#ifndef MZ_WORKERS_HPP
+#define MZ_WORKERS_HPP
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace mz {
+
+/// Resolve a -j value: 0 means one worker per hardware thread.
+inline unsigned resolve_jobs(unsigned jobs) {
+  if (jobs != 0) {
+    return jobs;
+  }
+  auto n = std::thread::hardware_concurrency();
+  return n == 0 ? 1 : n;
+}
+
+/// Parse a decimal count such as a -j value: digits only, no more than
+/// UINT32_MAX.
+inline bool parse_count(std::string_view sv, unsigned &value) {
+  if (sv.empty()) {
+    return false;
+  }
+  uint64_t v = 0;
+  for (auto c : sv) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    v = v * 10 + static_cast<uint64_t>(c - '0');
+    if (v > UINT32_MAX) {
+      return false;
+    }
+  }
+  value = static_cast<unsigned>(v);
+  return true;
+}
+
+/// Call fn(index, worker) for every index in [0, count) using `jobs` worker
+/// threads. Indexes are handed out in order, one at a time.
+template <typename Fn> void run_workers(unsigned jobs, size_t count, Fn &&fn) {
+  jobs = resolve_jobs(jobs);
+  if (jobs > count) {
+    jobs = static_cast<unsigned>(count);
+  }
+  if (jobs <= 1) {
+    for (size_t i = 0; i < count; i++) {
+      fn(i, 0u);
+    }
+    return;
+  }
+  std::atomic<size_t> cursor{0};
+  std::vector<std::thread> threads;
+  threads.reserve(jobs);
+  for (unsigned w = 0; w < jobs; w++) {
+    threads.emplace_back([&, w] {
+      size_t i;
+      while ((i = cursor.fetch_add(1, std::memory_order_relaxed)) < count) {
+        fn(i, w);
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+} // namespace mz
+
+#endif
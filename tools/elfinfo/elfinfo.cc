@@ -1,56 +1,975 @@
 ////
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <getopt.h>
+#include <numeric>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include "diskcache.hpp"
 #include "elf.hpp"
+#include "elfhash.hpp"
+#include "elfindex.hpp"
+#include "elfreloc.hpp"
+#include "elfsym.hpp"
+#include "elfview.hpp"
+#include "ldcache.hpp"
+#include "resolver.hpp"
+#include "elf_musl.h"
+#include "sink.hpp"
+#include "walker.hpp"
+#include "workers.hpp"
 
-int azelf(const char *file) {
-  mz::elf_memview emv;
-  if (!emv.mapview(file)) {
-    fprintf(stderr, "mapview %s\n", strerror(errno));
-    return 1;
-  }
-  mz::elf_minutiae_t em;
-  if (!emv.inquisitive(em)) {
-    fprintf(stderr, "inquisitive %s\n", strerror(errno));
-    return 1;
-  }
-  fprintf(stderr, "File: %s\n", file);
+void describe(const char *file, const mz::elf_summary &s, std::string &out) {
+  out.append("File: ").append(file).append("\n");
   mz::AttributesTables ats;
-  ats.Append("Address space", em.bit64 ? "64-bit" : "32-bit");
-  ats.Append("Endian", em.endian == mz::endian::LittleEndian ? "LSB" : "MSB");
-  std::string ver("version ");
-
+  ats.Append("Address space", s.elfclass == ELFCLASS64 ? "64-bit" : "32-bit");
+  ats.Append("Endian", s.endian == ELFDATA2LSB ? "LSB" : "MSB");
   ats.Append("OS/ABI", std::string("version ")
-                           .append(std::to_string(em.version))
+                           .append(std::to_string(s.version))
                            .append(" (")
-                           .append(em.osabi)
+                           .append(mz::osabi(s.osabi))
                            .append(")"));
-  ats.Append("Type", em.etype);
-  if (!em.rpath.empty()) {
-    ats.Append("RPATH", em.rpath);
+  ats.Append("Type", mz::elf_object_type(s.type));
+  if (!s.rpath.value.empty()) {
+    ats.Append("RPATH", s.rpath.value);
+  }
+  if (!s.runpath.value.empty()) {
+
+    ats.Append("RUPATH", s.runpath.value);
+  }
+  if (!s.soname.value.empty()) {
+    ats.Append("SONAME", s.soname.value);
+  }
+  if (!s.needed.empty()) {
+    ats.Append("Depends", s.needed);
+  }
+  ats.DumpAppend(out);
+  out.append("\n");
+}
+
+// Parse file with the mapped reader, and its exports if symbols is set.
+// Failures are described in out.
+bool parse_summary(const char *file, mz::elf_summary &s, std::string &out,
+                   std::vector<mz::index_symbol> *symbols = nullptr) {
+  mz::mapped_elf m;
+  if (!m.open(file)) {
+    out.append(file).append(": ").append(strerror(errno)).append("\n");
+    return false;
+  }
+  mz::elf_view v;
+  if (!mz::read_elf_view(m.data(), m.size(), v)) {
+    out.append(file).append(": not a well-formed ELF file\n");
+    return false;
+  }
+  v.summarize(s);
+  // A file whose symbols cannot be read is still described.
+  if (symbols != nullptr && !mz::read_index_symbols(v, *symbols)) {
+    symbols->clear();
+  }
+  return true;
+}
+
+// Walked files are skipped silently unless they are ELF.
+int azelf(const char *file, bool walked, std::string &out,
+          mz::disk_cache *cache) {
+  // The identity is taken before the file is read, so a change made while
+  // it is being parsed invalidates what is stored.
+  mz::file_identity id;
+  bool cacheable = cache != nullptr && mz::stat_identity(file, id);
+  mz::elf_summary s;
+  if (cacheable && cache->find(id, s) && (s.valid || walked)) {
+    if (s.valid) {
+      describe(file, s, out);
+    }
+    return 0;
+  }
+  if (walked && !mz::is_elf_file(file)) {
+    if (cacheable) {
+      cache->store(id, s);
+    }
+    return 0;
+  }
+  if (!parse_summary(file, s, out)) {
+    return 1;
+  }
+  if (cacheable) {
+    cache->store(id, s);
+  }
+  describe(file, s, out);
+  return 0;
+}
+
+void usage(const char *arg0) {
+  fprintf(stderr,
+          "usage: %s [-j <n>] [--stdout] [--shard <i>/<n>] [--cache <file>] "
+          "elf-file|dir...\n"
+          "       %s --index <file> [-j <n>] [--shard <i>/<n>] "
+          "elf-file|dir...\n"
+          "       %s --query <file> soname:<name>|rpath:<path>|"
+          "runpath:<path>|path:<file>|needs:<soname>|rdeps:<soname>|"
+          "symbol:<name>[@<version>]...\n"
+          "       %s --deps|--search-cost [-j <n>] [--sysroot <dir>] "
+          "[--ld-cache <file>] [--hwcaps-subdirs <n>] elf-file|dir...\n"
+          "       %s --hash-quality|--relocs [-j <n>] [--shard <i>/<n>] "
+          "elf-file|dir...\n"
+          "       %s --find-symbol <name>[@<version>] [-j <n>] "
+          "[--shard <i>/<n>] elf-file|dir...\n"
+          "\n"
+          "--index writes an index of the files, re-reading only those whose\n"
+          "identity changed since the index was last written. --query\n"
+          "answers from the index: the files with a SONAME, RPATH or RUNPATH,\n"
+          "the description of a file, the files that need a library, or\n"
+          "everything that needs it directly or through other libraries,\n"
+          "or the files that export a symbol, in any version or the one\n"
+          "given. rdeps follows a needed name to every indexed file with\n"
+          "that SONAME, class and machine, not only the one the loader\n"
+          "would pick, so it may list more files than depend on the\n"
+          "library. --find-symbol finds the exporters of a symbol without\n"
+          "an index, asking each file's DT_GNU_HASH bloom filter and chain\n"
+          "before its symbols.\n"
+          "--deps lists the libraries the loader would map for each file, as\n"
+          "ldd does, without running it. --sysroot resolves a tree built for\n"
+          "another system, ignoring LD_LIBRARY_PATH. The library cache is\n"
+          "/etc/ld.so.cache under the sysroot unless --ld-cache names one.\n"
+          "--search-cost counts the opens the loader wastes on directories\n"
+          "that do not hold a library, per library and per search path\n"
+          "entry, and ranks the files by it. --hwcaps-subdirs is how many\n"
+          "subdirectories the loader tries in each directory first (the\n"
+          "search path of LD_DEBUG=libs shows them); 0 by default.\n"
+          "--hash-quality shows the symbol hash tables of each file: the\n"
+          "bloom filter fill, the chain lengths, and the entries a lookup\n"
+          "compares on average. Files with only DT_HASH are flagged, and the\n"
+          "files are ranked by what a lookup of a name they do not define\n"
+          "costs, the common case for all but the last library searched.\n"
+          "--relocs shows the dynamic relocations of each file and what\n"
+          "linking it with -z pack-relative-relocs would save, totals them,\n"
+          "and ranks the files by the saving.\n",
+          arg0, arg0, arg0, arg0, arg0, arg0);
+}
+
+enum LongOption : int {
+  OptStdout = 256,
+  OptShard,
+  OptCache,
+  OptIndex,
+  OptQuery,
+  OptDeps,
+  OptSysroot,
+  OptLdCache,
+  OptSearchCost,
+  OptHwcapsSubdirs,
+  OptHashQuality,
+  OptRelocs,
+  OptFindSymbol,
+};
+
+// A file to inspect, and whether the tree walker found it.
+struct scan_item {
+  std::string path;
+  bool walked{false};
+};
+
+void collect_files(char *const *first, char *const *last,
+                   const mz::shard_spec &shard, std::vector<scan_item> &items) {
+  for (; first != last; ++first) {
+    if (!mz::is_directory(*first)) {
+      if (shard.selects(*first)) {
+        items.push_back(scan_item{*first, false});
+      }
+      continue;
+    }
+    mz::walk_tree(*first, [&](const std::string &path,
+                              std::string_view relative) {
+      if (shard.selects(relative)) {
+        items.push_back(scan_item{path, true});
+      }
+    });
   }
-  if (!em.rupath.empty()) {
+}
 
-    ats.Append("RUPATH", em.rupath);
+// Build or refresh an index of items. Records of unchanged files are
+// copied from the previous index, so a refresh costs one stat per file.
+int build_index(const char *file, unsigned jobs,
+                const std::vector<scan_item> &items) {
+  std::string emsg;
+  mz::elf_index old;
+  struct stat st;
+  if (stat(file, &st) == 0 && !old.open(file, &emsg)) {
+    fprintf(stderr, "%s; rebuilding it\n", emsg.c_str());
   }
-  if (!em.soname.empty()) {
-    ats.Append("SONAME", em.soname);
+  std::vector<mz::index_entry> entries(items.size());
+  std::vector<char> keep(items.size(), 0);
+  std::atomic_size_t parsed{0};
+  mz::run_workers(jobs, items.size(), [&](size_t i, unsigned) {
+    auto &e = entries[i];
+    e.path = items[i].path;
+    if (!mz::stat_identity(e.path.c_str(), e.id)) {
+      return;
+    }
+    keep[i] = 1;
+    uint32_t r = old.is_open() ? old.find_path(e.path) : mz::elf_index::none;
+    mz::file_identity id;
+    if (r != mz::elf_index::none && old.identity(r, id) && id == e.id &&
+        old.summary(r, e.summary) && old.symbols(r, e.symbols)) {
+      return;
+    }
+    parsed++;
+    // Files that are not ELF get a record too, or every refresh would
+    // read them again.
+    std::string ignored;
+    if (mz::is_elf_file(e.path.c_str()) &&
+        !parse_summary(e.path.c_str(), e.summary, ignored, &e.symbols)) {
+      e.summary = mz::elf_summary();
+      e.symbols.clear();
+    }
+  });
+  size_t n = 0;
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (keep[i]) {
+      if (n != i) {
+        entries[n] = std::move(entries[i]);
+      }
+      n++;
+    }
   }
-  if (!em.deps.empty()) {
-    ats.Append("Depends", em.deps);
+  entries.resize(n);
+  if (!mz::write_elf_index(file, entries, &emsg)) {
+    fprintf(stderr, "%s\n", emsg.c_str());
+    return 1;
   }
-  ats.DumpWrite(stderr);
-  fprintf(stderr, "\n");
+  fprintf(stderr, "index: %zu files, %zu parsed\n", entries.size(),
+          parsed.load());
   return 0;
 }
 
-int main(int argc, char const *argv[]) {
-  if (argc < 2) {
-    fprintf(stderr, "usage: %s elf-file\n", argv[0]);
+// A symbol name as readelf shows it: name@version for a hidden version,
+// name@@version for the default one.
+std::string symbol_text(std::string_view name, std::string_view version,
+                        bool hidden) {
+  std::string text(name);
+  if (!version.empty()) {
+    text.append(hidden ? "@" : "@@").append(version);
+  }
+  return text;
+}
+
+// Split name@version or name@@version; version is empty for a bare name.
+void split_symbol(std::string_view term, std::string_view &name,
+                  std::string_view &version) {
+  auto at = term.find('@');
+  name = term.substr(0, at);
+  version = at == std::string_view::npos ? std::string_view()
+                                         : term.substr(term.rfind('@') + 1);
+}
+
+// Answer kind:value terms from an index. Exits 1 if a term matched nothing.
+int query_index(const char *file, char *const *first, char *const *last,
+                int outfd) {
+  std::string emsg;
+  mz::elf_index index;
+  if (!index.open(file, &emsg)) {
+    fprintf(stderr, "%s\n", emsg.c_str());
+    return 1;
+  }
+  // rdeps is not a table of its own: it walks the needed table. symbol
+  // looks a name up in the symbol table.
+  constexpr auto rdeps = mz::table_count;
+  constexpr auto symbol = static_cast<mz::index_table>(mz::table_count + 1);
+  const struct {
+    std::string_view kind;
+    mz::index_table table;
+  } kinds[] = {{"soname", mz::table_soname},   {"rpath", mz::table_rpath},
+               {"runpath", mz::table_runpath}, {"path", mz::table_path},
+               {"needs", mz::table_needed},    {"rdeps", rdeps},
+               {"symbol", symbol}};
+  int rc = 0;
+  std::string out;
+  for (; first != last; ++first) {
+    std::string_view term(*first);
+    auto colon = term.find(':');
+    auto kind = term.substr(0, colon);
+    auto value = colon == std::string_view::npos ? std::string_view()
+                                                 : term.substr(colon + 1);
+    auto it = std::find_if(std::begin(kinds), std::end(kinds),
+                           [&](auto const &k) { return k.kind == kind; });
+    if (colon == std::string_view::npos || it == std::end(kinds)) {
+      fprintf(stderr, "invalid query %s\n", *first);
+      return 1;
+    }
+    size_t found = 0;
+    if (it->table == symbol) {
+      std::string_view name, version;
+      split_symbol(value, name, version);
+      for (auto const &d : index.definitions(name)) {
+        mz::elf_summary s;
+        if ((!version.empty() && d.version != version) ||
+            !index.summary(d.record, s) || !s.valid) {
+          continue;
+        }
+        out.append(index.path(d.record)).append("\t");
+        out.append(symbol_text(name, d.version, d.hidden)).append("\n");
+        found++;
+      }
+      rc = found == 0 ? 1 : rc;
+      continue;
+    }
+    std::vector<uint32_t> records;
+    if (it->table == rdeps) {
+      records = index.dependents(value, true);
+    } else {
+      auto postings = index.lookup(it->table, value);
+      records.assign(postings.begin(), postings.end());
+    }
+    for (uint32_t r : records) {
+      mz::elf_summary s;
+      if (!index.summary(r, s) || !s.valid) {
+        continue;
+      }
+      std::string path(index.path(r));
+      if (it->table == mz::table_path) {
+        describe(path.c_str(), s, out);
+      } else {
+        out.append(path).append("\n");
+      }
+      found++;
+    }
+    if (found == 0) {
+      rc = 1;
+    }
+  }
+  mz::write_full(outfd, out.data(), out.size());
+  return rc;
+}
+
+// The closure of a file as ldd lists it. False if something is missing.
+bool describe_deps(const std::string &path,
+                   const std::vector<mz::closure_object> &objects,
+                   std::string &out) {
+  bool ok = true;
+  out.append(path).append(":\n");
+  for (size_t i = 1; i < objects.size(); i++) {
+    auto const &o = objects[i];
+    out.append("\t").append(o.name).append(" => ");
+    if (o.path.empty()) {
+      out.append("not found\n");
+      ok = false;
+    } else {
+      out.append(o.path).append("\n");
+    }
+  }
+  return ok;
+}
+
+std::string plural(size_t n, const char *what) {
+  return std::to_string(n) + " " + what + (n == 1 ? "" : "s");
+}
+
+// What the loader spends searching for the closure of a file, returning
+// the number of wasted syscalls. The loader tries subdirs hwcaps and
+// platform subdirectories in a directory before the directory itself.
+// It remembers whether each of them exists from the first miss, which
+// costs an open and a stat. After that, a miss costs an open if the
+// directory exists and nothing if it does not.
+size_t describe_cost(const std::string &path,
+                     const std::vector<mz::closure_object> &objects,
+                     unsigned subdirs, std::string &out) {
+  struct entry_cost {
+    mz::search_source source;
+    uint32_t owner;
+    std::string dir;
+    size_t hits{0};
+    size_t opens{0};
+    size_t stats{0};
+    bool exists{true};
+  };
+  std::vector<entry_cost> entries;
+  auto entry = [&](mz::search_source source, uint32_t owner,
+                   const std::string &dir) -> entry_cost & {
+    for (auto &e : entries) {
+      if (e.source == source && e.owner == owner && e.dir == dir) {
+        return e;
+      }
+    }
+    entries.push_back(entry_cost{source, owner, dir});
+    return entries.back();
+  };
+  // Directories the loader has tried, and whether they exist.
+  std::unordered_map<std::string, bool> seen;
+  size_t opens = 0, stats = 0;
+  std::string libraries;
+  for (size_t i = 1; i < objects.size(); i++) {
+    auto const &o = objects[i];
+    size_t mine = 0;
+    for (auto const &d : o.failed) {
+      auto &e = entry(d.source, d.owner, d.dir);
+      e.exists = d.exists;
+      auto r = seen.emplace(d.dir, d.exists);
+      if (r.second) {
+        e.opens += 1 + subdirs;
+        e.stats += 1 + subdirs;
+        mine += 1 + subdirs;
+        stats += 1 + subdirs;
+      } else if (r.first->second) {
+        e.opens++;
+        mine++;
+      }
+    }
+    // A library found in a directory the loader had not tried yet was
+    // looked for in its subdirectories first.
+    if (o.source != mz::source_cache && o.source != mz::source_path &&
+        !o.path.empty()) {
+      auto dir = o.path.substr(0, o.path.rfind('/'));
+      auto &e = entry(o.source, o.owner, dir);
+      e.hits++;
+      if (seen.emplace(dir, true).second) {
+        e.opens += subdirs;
+        e.stats += subdirs;
+        mine += subdirs;
+        stats += subdirs;
+      }
+    }
+    opens += mine;
+    if (mine != 0 || o.path.empty()) {
+      libraries.append("\t").append(o.name).append(" => ");
+      libraries.append(o.path.empty() ? "not found" : o.path);
+      libraries.append(": ").append(plural(mine, "failed open")).append("\n");
+    }
+  }
+  out.append(path).append(": ");
+  out.append(plural(opens + stats, "wasted syscall")).append(" (");
+  out.append(plural(opens, "failed open")).append(", ");
+  out.append(plural(stats, "stat")).append(")\n");
+  out.append(libraries);
+  for (auto const &e : entries) {
+    out.append("\t").append(mz::search_source_name(e.source)).append(" ");
+    out.append(e.dir);
+    if (e.owner != mz::dependency_resolver::none) {
+      out.append(" of ").append(objects[e.owner].name);
+    }
+    out.append(": ").append(plural(e.hits, "hit")).append(", ");
+    out.append(plural(e.opens, "failed open")).append(", ");
+    out.append(plural(e.stats, "stat"));
+    out.append(e.exists ? "\n" : ", missing\n");
+  }
+  return opens + stats;
+}
+
+std::string fixed(double v, int digits) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", digits, v);
+  return buf;
+}
+
+// Run report on the image of every item in parallel, writing what it
+// appends in the order of the items. Walked files that are not ELF are
+// skipped. report returns false if the tables it reads are malformed.
+// Returns 1 if some file could not be read.
+template <typename F>
+int report_images(const std::vector<scan_item> &items, unsigned jobs,
+                  int outfd, F &&report) {
+  std::atomic_bool failed{false};
+  mz::ordered_sink sink(outfd);
+  std::vector<std::string> buffers(mz::resolve_jobs(jobs));
+  mz::run_workers(jobs, items.size(), [&](size_t i, unsigned worker) {
+    auto &buffer = buffers[worker];
+    auto const &item = items[i];
+    mz::mapped_elf m;
+    mz::elf_view v;
+    if (item.walked && !mz::is_elf_file(item.path.c_str())) {
+      // Not ELF: nothing to say.
+    } else if (!m.open(item.path.c_str())) {
+      buffer.append(item.path).append(": ").append(strerror(errno));
+      buffer.append("\n");
+      failed = true;
+    } else if (!mz::read_elf_view(m.data(), m.size(), v) ||
+               !report(i, v, buffer)) {
+      buffer.append(item.path).append(": not a well-formed ELF file\n");
+      failed = true;
+    }
+    sink.commit(i, buffer);
+  });
+  sink.flush();
+  return failed ? 1 : 0;
+}
+
+// The symbol hash tables of a file, the one the loader uses first.
+void describe_hash(const std::string &path, const mz::hash_tables &t,
+                   std::string &out) {
+  out.append(path).append(":");
+  if (!t.gnu.present) {
+    out.append(" no DT_GNU_HASH,");
+  }
+  auto const &h = t.used();
+  out.append(t.gnu.present ? " DT_GNU_HASH, " : " DT_HASH, ");
+  out.append(plural(h.symbols, "symbol")).append(" in ");
+  out.append(plural(h.buckets, "bucket")).append(", longest chain ");
+  out.append(std::to_string(h.longest)).append("\n");
+  if (h.bloom_words != 0) {
+    out.append("\tbloom filter: ");
+    out.append(plural(h.bloom_words, (std::to_string(h.bloom_word_bits) +
+                                      "-bit word").c_str()));
+    out.append(", shift ").append(std::to_string(h.bloom_shift));
+    out.append(", ").append(fixed(100 * h.bloom_fill(), 1));
+    out.append("% of bits set, ").append(fixed(100 * h.bloom_pass, 1));
+    out.append("% of misses pass\n");
+  }
+  out.append("\tchains:");
+  for (size_t n = 0; n < h.chains.size(); n++) {
+    out.append(" ").append(std::to_string(n));
+    out.append(n + 1 == h.chains.size() ? "+:" : ":");
+    out.append(std::to_string(h.chains[n]));
+  }
+  out.append("\n\tprobes: ").append(fixed(h.probes_hit, 2));
+  out.append(" per hit, ").append(fixed(h.probes_miss, 2));
+  out.append(" per miss\n");
+}
+
+// Show the hash tables of every item and rank the files by the chain
+// entries a lookup that misses compares. Those without DT_GNU_HASH
+// compare strings where the others compare hashes, so they rank first.
+int describe_hashes(const std::vector<scan_item> &items, unsigned jobs,
+                    int outfd) {
+  struct ranked {
+    bool gnu{true};
+    double probes{-1};
+  };
+  std::vector<ranked> ranks(items.size());
+  int rc = report_images(
+      items, jobs, outfd,
+      [&](size_t i, const mz::elf_view &v, std::string &out) {
+        mz::hash_tables t;
+        if (!mz::read_hash_tables(v, t)) {
+          return false;
+        }
+        if (t.used().present) {
+          describe_hash(items[i].path, t, out);
+          ranks[i] = ranked{t.gnu.present, t.used().probes_miss};
+        } else if (!items[i].walked) {
+          out.append(items[i].path).append(": no symbol hash table\n");
+        }
+        return true;
+      });
+  std::vector<size_t> order;
+  size_t sysv = 0;
+  for (size_t i = 0; i < items.size(); i++) {
+    if (ranks[i].probes >= 0) {
+      order.push_back(i);
+      sysv += ranks[i].gnu ? 0 : 1;
+    }
+  }
+  std::string out;
+  if (order.size() > 1) {
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      if (ranks[a].gnu != ranks[b].gnu) {
+        return !ranks[a].gnu;
+      }
+      return ranks[a].probes > ranks[b].probes;
+    });
+    out.append("\nprobes per miss by file");
+    if (sysv != 0) {
+      out.append(", ").append(plural(sysv, "file"));
+      out.append(" without DT_GNU_HASH first");
+    }
+    out.append(":\n");
+    for (auto i : order) {
+      out.append(fixed(ranks[i].probes, 2)).append("\t");
+      out.append(items[i].path);
+      out.append(ranks[i].gnu ? "\n" : " (no DT_GNU_HASH)\n");
+    }
+  }
+  mz::write_full(outfd, out.data(), out.size());
+  return rc;
+}
+
+// The dynamic relocations of a file, and what packing the relative ones
+// would save.
+void describe_relocs(const std::string &path, const mz::reloc_stats &r,
+                     std::string &out) {
+  const char *tag = r.rela ? "DT_RELA" : "DT_REL";
+  out.append(path).append(": ");
+  out.append(plural(r.total(), "relocation"));
+  out.append(" in ").append(plural(r.size, "byte")).append(" of ");
+  out.append(tag).append(", ").append(tag).append("COUNT ");
+  out.append(std::to_string(r.count)).append("\n");
+  out.append("\t").append(std::to_string(r.relative)).append(" relative, ");
+  out.append(std::to_string(r.symbolic)).append(" symbolic against ");
+  out.append(plural(r.symbols, "symbol")).append(", ");
+  out.append(plural(r.copies, "copy relocation")).append(", ");
+  out.append(std::to_string(r.ifuncs)).append(" IRELATIVE, ");
+  out.append(std::to_string(r.other)).append(" other\n");
+  out.append("\t").append(plural(r.plt, "PLT relocation"));
+  if (r.plt != 0) {
+    out.append(r.bind_now ? ", resolved at startup" : ", resolved lazily");
+  }
+  out.append("\n\t");
+  if (r.has_relr()) {
+    out.append("DT_RELR: ").append(plural(r.relr_size, "byte"));
+    out.append(" for ").append(plural(r.relr_relative, "relative relocation"));
+  } else {
+    out.append("no DT_RELR");
+  }
+  out.append(", ").append(plural(r.pages, "page")).append(" written\n");
+  if (r.saving() != 0) {
+    out.append("\t-z pack-relative-relocs would save ");
+    out.append(plural(r.saving(), "byte")).append(": ");
+    out.append(plural(r.packable, "relative relocation")).append(" in ");
+    out.append(plural(r.packed_size, "byte")).append(" of DT_RELR\n");
+  }
+}
+
+// Show the relocations of every item, their totals, and the files ranked
+// by what packing their relative relocations would save.
+int describe_relocations(const std::vector<scan_item> &items, unsigned jobs,
+                         int outfd) {
+  std::vector<mz::reloc_stats> stats(items.size());
+  std::vector<char> valid(items.size(), 0);
+  int rc = report_images(
+      items, jobs, outfd,
+      [&](size_t i, const mz::elf_view &v, std::string &out) {
+        if (!v.dynamic) {
+          if (!items[i].walked) {
+            out.append(items[i].path).append(": no dynamic table\n");
+          }
+          return true;
+        }
+        if (!mz::read_relocations(v, stats[i])) {
+          return false;
+        }
+        valid[i] = 1;
+        describe_relocs(items[i].path, stats[i], out);
+        return true;
+      });
+  mz::reloc_stats total;
+  size_t files = 0, relr = 0;
+  std::vector<size_t> order;
+  for (size_t i = 0; i < items.size(); i++) {
+    if (!valid[i]) {
+      continue;
+    }
+    auto const &r = stats[i];
+    files++;
+    relr += r.has_relr() ? 1 : 0;
+    total.size += r.size;
+    total.relative += r.relative;
+    total.symbolic += r.symbolic;
+    total.copies += r.copies;
+    total.ifuncs += r.ifuncs;
+    total.other += r.other;
+    total.plt += r.plt;
+    total.relr_relative += r.relr_relative;
+    total.pages += r.pages;
+    if (r.saving() != 0) {
+      order.push_back(i);
+    }
+  }
+  std::string out;
+  if (files > 1) {
+    uint64_t saving = 0;
+    for (auto i : order) {
+      saving += stats[i].saving();
+    }
+    out.append("\ntotal: ").append(plural(files, "file")).append(", ");
+    out.append(plural(total.total(), "relocation"));
+    out.append(" in ").append(plural(total.size, "byte")).append("\n\t");
+    out.append(std::to_string(total.relative)).append(" relative, ");
+    out.append(std::to_string(total.symbolic)).append(" symbolic, ");
+    out.append(plural(total.copies, "copy relocation")).append(", ");
+    out.append(std::to_string(total.ifuncs)).append(" IRELATIVE, ");
+    out.append(std::to_string(total.other)).append(" other, ");
+    out.append(std::to_string(total.plt)).append(" PLT\n\t");
+    out.append(std::to_string(relr)).append(" with DT_RELR for ");
+    out.append(plural(total.relr_relative, "relative relocation"));
+    out.append(", ").append(plural(total.pages, "page")).append(" written\n");
+    out.append("\t-z pack-relative-relocs would save ");
+    out.append(plural(saving, "byte")).append(" in ");
+    out.append(plural(order.size(), "file")).append("\n");
+  }
+  if (order.size() > 1) {
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return stats[a].saving() > stats[b].saving();
+    });
+    out.append("\nbytes -z pack-relative-relocs would save by file:\n");
+    for (auto i : order) {
+      out.append(std::to_string(stats[i].saving())).append("\t");
+      out.append(items[i].path).append("\n");
+    }
+  }
+  mz::write_full(outfd, out.data(), out.size());
+  return rc;
+}
+
+// Print the files that export a symbol, in the version given if any. Each
+// file's GNU hash table is asked first, as the loader does, so only the
+// files it cannot rule out have their symbols read; files without one are
+// read in full. Returns 1 if no file exports it.
+int find_symbol(const std::vector<scan_item> &items, unsigned jobs,
+                std::string_view term, int outfd) {
+  std::string_view name, version;
+  split_symbol(term, name, version);
+  std::atomic_size_t found{0};
+  int rc = report_images(
+      items, jobs, outfd,
+      [&](size_t i, const mz::elf_view &v, std::string &out) {
+        if (!v.dynamic) {
+          return true;
+        }
+        std::vector<uint32_t> candidates;
+        bool hashed = mz::gnu_hash_lookup(v, name, candidates);
+        if (hashed && candidates.empty()) {
+          return true;
+        }
+        std::vector<mz::elf_symbol> syms;
+        if (!mz::read_dynamic_symbols(v, syms)) {
+          return false;
+        }
+        if (!hashed) {
+          candidates.resize(syms.size());
+          std::iota(candidates.begin(), candidates.end(), 0);
+        }
+        for (uint32_t n : candidates) {
+          if (n >= syms.size()) {
+            continue;
+          }
+          auto const &s = syms[n];
+          if (s.name != name || !s.exported() ||
+              (!version.empty() && s.version != version)) {
+            continue;
+          }
+          out.append(items[i].path).append("\t");
+          out.append(symbol_text(name, s.version, s.hidden)).append("\n");
+          found++;
+        }
+        return true;
+      });
+  return rc != 0 || found == 0 ? 1 : 0;
+}
+
+// Print the closure of every item, as ldd does, or with cost what the
+// loader wastes on finding it. The resolver is shared, so libraries
+// common to the items are searched for once.
+int resolve_deps(const std::vector<scan_item> &items, unsigned jobs,
+                 const char *sysroot, const char *ldcache, bool cost,
+                 unsigned subdirs, int outfd) {
+  // A missing default cache is no error: the loader goes without too.
+  mz::ld_so_cache cache;
+  std::string emsg;
+  if (ldcache != nullptr) {
+    if (!cache.open(ldcache, &emsg)) {
+      fprintf(stderr, "%s\n", emsg.c_str());
+      return 1;
+    }
+  } else {
+    cache.open(std::string(sysroot ? sysroot : "") + "/etc/ld.so.cache",
+               nullptr);
+  }
+  mz::resolver_options opts;
+  opts.jobs = jobs;
+  if (cache.is_open()) {
+    opts.cache = [&cache](std::string_view soname, uint8_t elfclass,
+                          uint16_t machine, std::string &path) {
+      std::string_view found;
+      if (!cache.find(soname, elfclass, machine, found)) {
+        return false;
+      }
+      path.assign(found.data(), found.size());
+      return true;
+    };
+  }
+  if (sysroot != nullptr) {
+    opts.sysroot = sysroot;
+  } else if (const char *env = getenv("LD_LIBRARY_PATH")) {
+    // The loader splits LD_LIBRARY_PATH at ';' as well as ':'.
+    std::string_view sv(env);
+    for (;;) {
+      auto sep = sv.find_first_of(":;");
+      opts.ld_library_path.emplace_back(sv.substr(0, sep));
+      if (sep == std::string_view::npos) {
+        break;
+      }
+      sv.remove_prefix(sep + 1);
+    }
+  }
+  mz::dependency_resolver resolver(std::move(opts));
+  int rc = 0;
+  std::string out;
+  std::vector<mz::closure_object> objects;
+  std::vector<std::pair<size_t, std::string>> ranking;
+  for (auto const &item : items) {
+    if (item.walked && !mz::is_elf_file(item.path.c_str())) {
+      continue;
+    }
+    if (!resolver.resolve(item.path, objects, &emsg)) {
+      out.append(emsg).append("\n");
+      rc = 1;
+      continue;
+    }
+    if (!cost) {
+      rc |= describe_deps(item.path, objects, out) ? 0 : 1;
+    } else {
+      ranking.emplace_back(describe_cost(item.path, objects, subdirs, out),
+                           item.path);
+    }
+    mz::write_full(outfd, out.data(), out.size());
+    out.clear();
+  }
+  if (ranking.size() > 1) {
+    std::stable_sort(ranking.begin(), ranking.end(),
+                     [](auto const &a, auto const &b) {
+                       return a.first > b.first;
+                     });
+    out.append("\nwasted syscalls by file:\n");
+    for (auto const &r : ranking) {
+      out.append(std::to_string(r.first)).append("\t");
+      out.append(r.second).append("\n");
+    }
+  }
+  mz::write_full(outfd, out.data(), out.size());
+  return rc;
+}
+
+int main(int argc, char *const argv[]) {
+  unsigned jobs = 1;
+  int outfd = STDERR_FILENO;
+  mz::shard_spec shard;
+  const char *cachefile = nullptr;
+  const char *indexfile = nullptr;
+  const char *queryfile = nullptr;
+  const char *sysroot = nullptr;
+  const char *ldcache = nullptr;
+  bool deps = false;
+  bool cost = false;
+  bool hashes = false;
+  bool relocs = false;
+  const char *findsym = nullptr;
+  unsigned subdirs = 0;
+  const option lopts[] = {
+      {"cache", required_argument, nullptr, OptCache},
+      {"deps", no_argument, nullptr, OptDeps},
+      {"find-symbol", required_argument, nullptr, OptFindSymbol},
+      {"hash-quality", no_argument, nullptr, OptHashQuality},
+      {"help", no_argument, nullptr, 'h'},
+      {"hwcaps-subdirs", required_argument, nullptr, OptHwcapsSubdirs},
+      {"index", required_argument, nullptr, OptIndex},
+      {"jobs", required_argument, nullptr, 'j'},
+      {"ld-cache", required_argument, nullptr, OptLdCache},
+      {"query", required_argument, nullptr, OptQuery},
+      {"relocs", no_argument, nullptr, OptRelocs},
+      {"search-cost", no_argument, nullptr, OptSearchCost},
+      {"shard", required_argument, nullptr, OptShard},
+      {"stdout", no_argument, nullptr, OptStdout},
+      {"sysroot", required_argument, nullptr, OptSysroot},
+      {nullptr, 0, nullptr, 0} ///
+  };
+  int ch = 0;
+  while ((ch = getopt_long(argc, argv, "hj:", lopts, nullptr)) != -1) {
+    switch (ch) {
+    case 'j':
+      if (!mz::parse_count(optarg, jobs)) {
+        fprintf(stderr, "invalid -j %s, expected a number\n", optarg);
+        return 1;
+      }
+      break;
+    case OptStdout:
+      outfd = STDOUT_FILENO;
+      break;
+    case OptShard:
+      if (!shard.parse(optarg)) {
+        fprintf(stderr, "invalid --shard %s, expected i/n with 0 <= i < n\n",
+                optarg);
+        return 1;
+      }
+      break;
+    case OptCache:
+      cachefile = optarg;
+      break;
+    case OptIndex:
+      indexfile = optarg;
+      break;
+    case OptQuery:
+      queryfile = optarg;
+      break;
+    case OptDeps:
+      deps = true;
+      break;
+    case OptSysroot:
+      sysroot = optarg;
+      break;
+    case OptLdCache:
+      ldcache = optarg;
+      break;
+    case OptSearchCost:
+      deps = true;
+      cost = true;
+      break;
+    case OptHwcapsSubdirs:
+      if (!mz::parse_count(optarg, subdirs)) {
+        fprintf(stderr, "invalid --hwcaps-subdirs %s, expected a number\n",
+                optarg);
+        return 1;
+      }
+      break;
+    case OptHashQuality:
+      hashes = true;
+      break;
+    case OptRelocs:
+      relocs = true;
+      break;
+    case OptFindSymbol:
+      findsym = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (optind >= argc) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (queryfile != nullptr) {
+    return query_index(queryfile, argv + optind, argv + argc, outfd);
+  }
+  std::string emsg;
+  mz::disk_cache cache;
+  if (cachefile != nullptr && !cache.open(cachefile, &emsg)) {
+    fprintf(stderr, "%s\n", emsg.c_str());
     return 1;
   }
-  for (int i = 1; i < argc; i++) {
-    azelf(argv[i]);
+  std::vector<scan_item> items;
+  collect_files(argv + optind, argv + argc, shard, items);
+  if (indexfile != nullptr) {
+    return build_index(indexfile, jobs, items);
+  }
+  if (hashes) {
+    return describe_hashes(items, jobs, outfd);
+  }
+  if (relocs) {
+    return describe_relocations(items, jobs, outfd);
+  }
+  if (findsym != nullptr) {
+    return find_symbol(items, jobs, findsym, outfd);
+  }
+  if (deps) {
+    return resolve_deps(items, jobs, sysroot, ldcache, cost, subdirs,
+                        outfd);
+  }
+  mz::ordered_sink sink(outfd);
+  std::vector<std::string> buffers(mz::resolve_jobs(jobs));
+  mz::run_workers(jobs, items.size(), [&](size_t i, unsigned worker) {
+    auto &buffer = buffers[worker];
+    azelf(items[i].path.c_str(), items[i].walked, buffer,
+          cachefile != nullptr ? &cache : nullptr);
+    sink.commit(i, buffer);
+  });
+  sink.flush();
+  if (cachefile != nullptr && !cache.commit(&emsg)) {
+    fprintf(stderr, "%s\n", emsg.c_str());
+    return 1;
   }
   return 0;
 }
@@ -0,0 +1,360 @@
+///
+#include "cmelf.h"
+#include "cmELF.h"
+#include "cmRPath.h"
+#include "workers.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <new>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+struct cmelf_file {
+  template <typename... Args>
+  explicit cmelf_file(Args &&...args) : elf(std::forward<Args>(args)...) {}
+  cmELF elf;
+  std::vector<std::string> needed;
+  bool needed_loaded{false};
+};
+
+struct cmelf_plan {
+  cmake::RPathPlan plan;
+};
+
+namespace {
+
+// Nothing may unwind into C callers; the only exception the parser and
+// planner throw is an allocation failure.
+template <typename Fn> int guarded(Fn &&fn) {
+  try {
+    return fn();
+  } catch (const std::bad_alloc &) {
+    return CMELF_ERR_NOMEM;
+  }
+}
+
+int elf_status(const cmELF &elf) {
+  switch (elf.GetStatus()) {
+  case cmELF::StatusValid:
+    return elf ? CMELF_OK : CMELF_ERR_MALFORMED;
+  case cmELF::StatusOpenFailed:
+    return CMELF_ERR_OPEN;
+  case cmELF::StatusReadFailed:
+    return CMELF_ERR_READ;
+  case cmELF::StatusNotELF:
+    return CMELF_ERR_NOT_ELF;
+  case cmELF::StatusMalformed:
+    break;
+  }
+  return CMELF_ERR_MALFORMED;
+}
+
+int plan_status(const cmake::RPathPlan &plan) {
+  switch (plan.Error) {
+  case cmake::RPathPlan::ErrorNone:
+    return CMELF_OK;
+  case cmake::RPathPlan::ErrorNoEntry:
+    return CMELF_ERR_NO_RPATH;
+  case cmake::RPathPlan::ErrorMismatch:
+    return CMELF_ERR_MISMATCH;
+  case cmake::RPathPlan::ErrorTooLong:
+    return CMELF_ERR_TOO_LONG;
+  case cmake::RPathPlan::ErrorMalformed:
+    break;
+  }
+  return CMELF_ERR_MALFORMED;
+}
+
+template <typename... Args> int open_file(cmelf_file **file, Args &&...args) {
+  if (file == nullptr) {
+    return CMELF_ERR_ARGUMENT;
+  }
+  *file = nullptr;
+  return guarded([&]() -> int {
+    auto *f = new cmelf_file(std::forward<Args>(args)...);
+    int status = elf_status(f->elf);
+    if (status != CMELF_OK) {
+      int saved = errno;
+      delete f;
+      errno = saved;
+      return status;
+    }
+    *file = f;
+    return CMELF_OK;
+  });
+}
+
+int load_needed(cmelf_file *file) {
+  if (!file->needed_loaded) {
+    file->needed = file->elf.GetNeeded();
+    file->needed_loaded = true;
+  }
+  return file->elf ? CMELF_OK : CMELF_ERR_MALFORMED;
+}
+
+int make_plan(cmelf_file *file, cmelf_plan **plan, bool remove,
+              const char *old_rpath, const char *new_rpath) {
+  if (file == nullptr || plan == nullptr || (!remove && new_rpath == nullptr)) {
+    return CMELF_ERR_ARGUMENT;
+  }
+  *plan = nullptr;
+  return guarded([&]() -> int {
+    auto *p = new cmelf_plan;
+    bool ok;
+    if (remove) {
+      ok = cmake::PlanRemoveRPath(file->elf, p->plan, nullptr);
+    } else {
+      std::string old;
+      if (old_rpath != nullptr) {
+        old = old_rpath;
+      } else if (auto *se = file->elf.GetRunPath()) {
+        old = se->Value;
+      } else if (auto *se = file->elf.GetRPath()) {
+        old = se->Value;
+      }
+      ok = cmake::PlanChangeRPath(file->elf, old, new_rpath, p->plan,
+                                  nullptr);
+    }
+    int status = ok ? CMELF_OK : plan_status(p->plan);
+    if (ok && !file->elf) {
+      status = CMELF_ERR_MALFORMED;
+    }
+    if (status != CMELF_OK) {
+      delete p;
+      return status;
+    }
+    *plan = p;
+    return CMELF_OK;
+  });
+}
+
+} // namespace
+
+const char *cmelf_strerror(int status) {
+  switch (status) {
+  case CMELF_OK:
+    return "success";
+  case CMELF_NOT_FOUND:
+    return "no such entry";
+  case CMELF_ERR_ARGUMENT:
+    return "invalid argument";
+  case CMELF_ERR_NOMEM:
+    return "out of memory";
+  case CMELF_ERR_OPEN:
+    return "cannot open file";
+  case CMELF_ERR_READ:
+    return "cannot read file";
+  case CMELF_ERR_NOT_ELF:
+    return "not an ELF file";
+  case CMELF_ERR_MALFORMED:
+    return "malformed ELF file";
+  case CMELF_ERR_NO_RPATH:
+    return "no RPATH or RUNPATH entry to edit";
+  case CMELF_ERR_MISMATCH:
+    return "current path does not contain the old path";
+  case CMELF_ERR_TOO_LONG:
+    return "new path does not fit in place";
+  case CMELF_ERR_WRITE:
+    return "cannot write file";
+  }
+  return "unknown status";
+}
+
+int cmelf_open(const char *path, cmelf_file **file) {
+  if (path == nullptr) {
+    return CMELF_ERR_ARGUMENT;
+  }
+  return open_file(file, path);
+}
+
+int cmelf_open_buffer(const void *data, size_t size, cmelf_file **file) {
+  if (data == nullptr && size != 0) {
+    return CMELF_ERR_ARGUMENT;
+  }
+  return open_file(file, data, static_cast<unsigned long>(size));
+}
+
+void cmelf_close(cmelf_file *file) { delete file; }
+
+int cmelf_header_info(cmelf_file *file, cmelf_header *header) {
+  if (file == nullptr || header == nullptr) {
+    return CMELF_ERR_ARGUMENT;
+  }
+  cmELF::HeaderInfo info;
+  if (!file->elf.GetHeaderInfo(info)) {
+    return CMELF_ERR_MALFORMED;
+  }
+  header->elfclass = info.Class;
+  header->msb = info.MSB ? 1 : 0;
+  header->type = info.Type;
+  header->machine = info.Machine;
+  header->version = info.Version;
+  header->osabi = info.OSABI;
+  header->abiversion = info.ABIVersion;
+  return CMELF_OK;
+}
+
+int cmelf_string(cmelf_file *file, cmelf_tag tag, const char **value,
+                 size_t *size) {
+  if (file == nullptr || value == nullptr) {
+    return CMELF_ERR_ARGUMENT;
+  }
+  return guarded([&]() -> int {
+    cmELF::StringEntry const *se = nullptr;
+    switch (tag) {
+    case CMELF_TAG_SONAME:
+      se = file->elf.GetSOName();
+      break;
+    case CMELF_TAG_RPATH:
+      se = file->elf.GetRPath();
+      break;
+    case CMELF_TAG_RUNPATH:
+      se = file->elf.GetRunPath();
+      break;
+    default:
+      return CMELF_ERR_ARGUMENT;
+    }
+    if (se == nullptr) {
+      return file->elf ? CMELF_NOT_FOUND : CMELF_ERR_MALFORMED;
+    }
+    *value = se->Value.c_str();
+    if (size != nullptr) {
+      *size = se->Value.size();
+    }
+    return CMELF_OK;
+  });
+}
+
+int cmelf_needed_count(cmelf_file *file, size_t *count) {
+  if (file == nullptr || count == nullptr) {
+    return CMELF_ERR_ARGUMENT;
+  }
+  return guarded([&]() -> int {
+    int status = load_needed(file);
+    *count = file->needed.size();
+    return status;
+  });
+}
+
+int cmelf_needed(cmelf_file *file, size_t index, const char **value,
+                 size_t *size) {
+  if (file == nullptr || value == nullptr) {
+    return CMELF_ERR_ARGUMENT;
+  }
+  return guarded([&]() -> int {
+    int status = load_needed(file);
+    if (status != CMELF_OK) {
+      return status;
+    }
+    if (index >= file->needed.size()) {
+      return CMELF_NOT_FOUND;
+    }
+    *value = file->needed[index].c_str();
+    if (size != nullptr) {
+      *size = file->needed[index].size();
+    }
+    return CMELF_OK;
+  });
+}
+
+int cmelf_plan_change(cmelf_file *file, const char *old_rpath,
+                      const char *new_rpath, cmelf_plan **plan) {
+  return make_plan(file, plan, false, old_rpath, new_rpath);
+}
+
+int cmelf_plan_remove(cmelf_file *file, cmelf_plan **plan) {
+  return make_plan(file, plan, true, nullptr, nullptr);
+}
+
+int cmelf_plan_empty(const cmelf_plan *plan) {
+  return plan == nullptr || plan->plan.Empty() ? 1 : 0;
+}
+
+void cmelf_plan_free(cmelf_plan *plan) { delete plan; }
+
+int cmelf_apply(const cmelf_plan *plan, const char *path, int *changed) {
+  if (plan == nullptr || path == nullptr) {
+    return CMELF_ERR_ARGUMENT;
+  }
+  if (changed != nullptr) {
+    *changed = 0;
+  }
+  if (plan->plan.Empty()) {
+    return CMELF_OK;
+  }
+  int fd = open(path, O_WRONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return CMELF_ERR_OPEN;
+  }
+  return guarded([&]() -> int {
+    bool wrote = false;
+    bool ok = cmake::ApplyRPathPlan(fd, plan->plan, nullptr, &wrote);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    if (changed != nullptr) {
+      *changed = wrote ? 1 : 0;
+    }
+    return ok ? CMELF_OK : CMELF_ERR_WRITE;
+  });
+}
+
+int cmelf_apply_buffer(const cmelf_plan *plan, void *data, size_t size,
+                       int *changed) {
+  if (plan == nullptr || (data == nullptr && size != 0)) {
+    return CMELF_ERR_ARGUMENT;
+  }
+  bool wrote = false;
+  bool ok = cmake::ApplyRPathPlan(static_cast<char *>(data),
+                                  static_cast<unsigned long>(size),
+                                  plan->plan, &wrote);
+  if (changed != nullptr) {
+    *changed = wrote ? 1 : 0;
+  }
+  return ok ? CMELF_OK : CMELF_ERR_ARGUMENT;
+}
+
+int cmelf_edit_batch(cmelf_edit *edits, size_t count, unsigned jobs) {
+  if (edits == nullptr && count != 0) {
+    return CMELF_ERR_ARGUMENT;
+  }
+  mz::run_workers(jobs, count, [&](size_t i, unsigned) {
+    cmelf_edit &e = edits[i];
+    e.changed = 0;
+    cmelf_file *file = nullptr;
+    cmelf_plan *plan = nullptr;
+    e.status = cmelf_open(e.path, &file);
+    if (e.status == CMELF_OK) {
+      e.status = e.new_rpath == nullptr
+                     ? cmelf_plan_remove(file, &plan)
+                     : cmelf_plan_change(file, nullptr, e.new_rpath, &plan);
+      // Close before writing, as cmchrpath does.
+      cmelf_close(file);
+    }
+    if (e.status == CMELF_OK) {
+      e.status = cmelf_apply(plan, e.path, &e.changed);
+    }
+    cmelf_plan_free(plan);
+  });
+  for (size_t i = 0; i < count; i++) {
+    if (edits[i].status != CMELF_OK) {
+      return edits[i].status;
+    }
+  }
+  return CMELF_OK;
+}
+
+void cmelf_visit_batch(const char *const *paths, size_t count, unsigned jobs,
+                       cmelf_visit_fn visit, void *context) {
+  if ((paths == nullptr && count != 0) || visit == nullptr) {
+    return;
+  }
+  mz::run_workers(jobs, count, [&](size_t i, unsigned) {
+    cmelf_file *file = nullptr;
+    int status = cmelf_open(paths[i], &file);
+    visit(context, i, status, file);
+    cmelf_close(file);
+  });
+}
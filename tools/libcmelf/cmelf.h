@@ -0,0 +1,125 @@
+/*
+ * cmelf.h: C interface to the cmchrpath ELF parser and rpath editor, for
+ * tools that inspect or edit many files in-process instead of running
+ * cmchrpath once per file.
+ *
+ * Every function that can fail returns a cmelf_status; nothing on these
+ * paths formats a message. cmelf_strerror names a status.
+ *
+ * A cmelf_file is not thread-safe: lookups fill caches inside it. Separate
+ * files may be used from separate threads at once.
+ */
+#ifndef CMELF_H
+#define CMELF_H
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(CMELF_BUILDING) && defined(__GNUC__)
+#define CMELF_API __attribute__((visibility("default")))
+#else
+#define CMELF_API
+#endif
+
+typedef enum cmelf_status {
+  CMELF_OK = 0,
+  CMELF_NOT_FOUND,     /* the file has no such entry */
+  CMELF_ERR_ARGUMENT,  /* a required pointer was NULL */
+  CMELF_ERR_NOMEM,
+  CMELF_ERR_OPEN,      /* the file could not be opened; see errno */
+  CMELF_ERR_READ,      /* the file is too short or could not be read */
+  CMELF_ERR_NOT_ELF,   /* the file does not start with an ELF identification */
+  CMELF_ERR_MALFORMED, /* the file is ELF but its structure is broken */
+  CMELF_ERR_NO_RPATH,  /* a replacement needs an RPATH or RUNPATH to edit */
+  CMELF_ERR_MISMATCH,  /* the current path does not contain the old one */
+  CMELF_ERR_TOO_LONG,  /* the new path does not fit in place */
+  CMELF_ERR_WRITE      /* the file could not be written; see errno */
+} cmelf_status;
+
+typedef enum cmelf_tag {
+  CMELF_TAG_SONAME,
+  CMELF_TAG_RPATH,
+  CMELF_TAG_RUNPATH
+} cmelf_tag;
+
+typedef struct cmelf_header {
+  unsigned elfclass; /* 32 or 64 */
+  int msb;           /* most significant byte first */
+  unsigned type;     /* e_type */
+  unsigned machine;  /* e_machine */
+  unsigned version;  /* EI_VERSION */
+  unsigned osabi;    /* EI_OSABI */
+  unsigned abiversion;
+} cmelf_header;
+
+typedef struct cmelf_file cmelf_file;
+typedef struct cmelf_plan cmelf_plan;
+
+CMELF_API const char *cmelf_strerror(int status);
+
+/* Open a file, or a copy of one in memory that must outlive the handle.
+   On failure *file is NULL. */
+CMELF_API int cmelf_open(const char *path, cmelf_file **file);
+CMELF_API int cmelf_open_buffer(const void *data, size_t size,
+                                cmelf_file **file);
+CMELF_API void cmelf_close(cmelf_file *file);
+
+CMELF_API int cmelf_header_info(cmelf_file *file, cmelf_header *header);
+
+/* The string of a dynamic tag. *value is NUL-terminated and valid until
+   the file is closed; *size (optional) is its length. */
+CMELF_API int cmelf_string(cmelf_file *file, cmelf_tag tag,
+                           const char **value, size_t *size);
+
+/* The DT_NEEDED entries in file order; CMELF_NOT_FOUND past the last. */
+CMELF_API int cmelf_needed_count(cmelf_file *file, size_t *count);
+CMELF_API int cmelf_needed(cmelf_file *file, size_t index, const char **value,
+                           size_t *size);
+
+/* Plan an edit without writing anything. old_rpath NULL replaces the
+   whole search path (RUNPATH, else RPATH), as cmchrpath -r does. A plan
+   stays valid after its file is closed. */
+CMELF_API int cmelf_plan_change(cmelf_file *file, const char *old_rpath,
+                                const char *new_rpath, cmelf_plan **plan);
+CMELF_API int cmelf_plan_remove(cmelf_file *file, cmelf_plan **plan);
+/* Whether applying the plan would write nothing. */
+CMELF_API int cmelf_plan_empty(const cmelf_plan *plan);
+CMELF_API void cmelf_plan_free(cmelf_plan *plan);
+
+/* Apply a plan to the file it was made from, on disk or in memory.
+   changed (optional) is set to whether anything was written. */
+CMELF_API int cmelf_apply(const cmelf_plan *plan, const char *path,
+                          int *changed);
+CMELF_API int cmelf_apply_buffer(const cmelf_plan *plan, void *data,
+                                 size_t size, int *changed);
+
+/* One edit of a batch: new_rpath replaces the whole search path, NULL
+   removes the RPATH and RUNPATH. status and changed are outputs. */
+typedef struct cmelf_edit {
+  const char *path;
+  const char *new_rpath;
+  int status;
+  int changed;
+} cmelf_edit;
+
+/* Apply count edits with jobs threads (0: one per hardware thread).
+   Returns CMELF_OK, or the status of the first edit that failed. */
+CMELF_API int cmelf_edit_batch(cmelf_edit *edits, size_t count,
+                               unsigned jobs);
+
+/* Open count files with jobs threads and call visit for each, on the
+   thread that opened it and in no particular order. file is NULL when
+   status is not CMELF_OK, and is closed when visit returns. */
+typedef void (*cmelf_visit_fn)(void *context, size_t index, int status,
+                               cmelf_file *file);
+CMELF_API void cmelf_visit_batch(const char *const *paths, size_t count,
+                                 unsigned jobs, cmelf_visit_fn visit,
+                                 void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif